@@ -0,0 +1,141 @@
+#include "yadfa.h"
+
+namespace {
+// analyses each analysis is built from
+unsigned dependencies(analysis_kind kind) {
+  switch (kind) {
+    case analysis_blocks:
+      return analysis_cfg;
+    case analysis_dominators:
+      return analysis_blocks;
+    case analysis_liveness:
+      return analysis_blocks | analysis_universe;
+    case analysis_intervals:
+      return analysis_blocks | analysis_universe | analysis_liveness;
+    case analysis_evolution:
+      return analysis_blocks | analysis_dominators;
+    default:
+      return analysis_none;
+  }
+}
+
+const analysis_kind all_analyses[] = {analysis_cfg,      analysis_use_def,    analysis_universe,
+                                      analysis_blocks,   analysis_dominators, analysis_liveness,
+                                      analysis_intervals, analysis_evolution};
+}  // namespace
+
+analysis_manager::analysis_manager(const instruction_vec& i_vec, const label_table& table,
+                                   const liveness_options& options)
+    : i_vec(i_vec), table(table), options(options) {}
+
+void analysis_manager::computed(analysis_kind kind) {
+  cached |= kind;
+  ++counts[kind];
+}
+
+const control_flow_graph& analysis_manager::cfg() {
+  if (!is_cached(analysis_cfg)) {
+    cfg_result = build_cfg(i_vec, table);
+    computed(analysis_cfg);
+  }
+  return cfg_result;
+}
+
+const gen_set& analysis_manager::uses() {
+  if (!is_cached(analysis_use_def)) {
+    uses_result.clear();
+    defs_result.clear();
+    build_use_def_sets(i_vec, uses_result, defs_result);
+    computed(analysis_use_def);
+  }
+  return uses_result;
+}
+
+const kill_set& analysis_manager::defs() {
+  uses();
+  return defs_result;
+}
+
+const variable_universe& analysis_manager::universe() {
+  if (!is_cached(analysis_universe)) {
+    universe_result = build_variable_universe(i_vec);
+    computed(analysis_universe);
+  }
+  return universe_result;
+}
+
+const block_graph& analysis_manager::blocks() {
+  if (!is_cached(analysis_blocks)) {
+    blocks_result = build_basic_blocks(i_vec, cfg());
+    computed(analysis_blocks);
+  }
+  return blocks_result;
+}
+
+const dominator_tree& analysis_manager::dominators() {
+  if (!is_cached(analysis_dominators)) {
+    dominators_result = build_dominator_tree(blocks());
+    computed(analysis_dominators);
+  }
+  return dominators_result;
+}
+
+const block_liveness& analysis_manager::liveness() {
+  if (!is_cached(analysis_liveness)) {
+    liveness_result = block_liveness_analysis(i_vec, blocks(), universe(), options);
+    has_instruction_liveness = false;
+    computed(analysis_liveness);
+  }
+  return liveness_result;
+}
+
+const liveness_sets& analysis_manager::instruction_liveness() {
+  liveness();
+  if (!has_instruction_liveness) {
+    instruction_liveness_result = expand_block_liveness(i_vec, blocks(), universe(), liveness());
+    has_instruction_liveness = true;
+  }
+  return instruction_liveness_result;
+}
+
+const live_interval_vec& analysis_manager::intervals() {
+  if (!is_cached(analysis_intervals)) {
+    intervals_result = build_live_intervals(i_vec, blocks(), universe(), liveness());
+    has_live_ranges = false;
+    computed(analysis_intervals);
+  }
+  return intervals_result;
+}
+
+const variable_interval_map& analysis_manager::live_ranges() {
+  intervals();
+  if (!has_live_ranges) {
+    live_ranges_result = variable_live_ranges(intervals());
+    has_live_ranges = true;
+  }
+  return live_ranges_result;
+}
+
+const scalar_evolution& analysis_manager::evolution() {
+  if (!is_cached(analysis_evolution)) {
+    evolution_result = scalar_evolution(i_vec, blocks(), dominators());
+    computed(analysis_evolution);
+  }
+  return evolution_result;
+}
+
+void analysis_manager::invalidate(unsigned preserved) {
+  // dependencies come before their users in all_analyses
+  unsigned kept = cached & preserved;
+  for (auto kind : all_analyses) {
+    if ((dependencies(kind) & ~kept) != 0) {
+      kept &= ~kind;
+    }
+  }
+  cached = kept;
+}
+
+size_t analysis_manager::computations(analysis_kind kind) const {
+  auto count = counts.find(kind);
+  return count == counts.end() ? 0 : count->second;
+}
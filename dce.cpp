@@ -0,0 +1,117 @@
+#include "yadfa.h"
+
+namespace {
+// instructions kept for their effect, not for values they define
+bool is_root(const instruction& instr) {
+  switch (instr.type) {
+    case op_var:
+    case op_mov:
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_shl:
+    case op_sar:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+    case op_phi:
+    case op_new:
+    case op_alloca:
+      return false;
+    case op_div:
+    case op_udiv:
+      return may_trap(instr);
+    default:
+      // calls, branches, labels, stack operations, delete, functions
+      return true;
+  }
+}
+}  // namespace
+
+bool may_trap(const instruction& instr) {
+  if (instr.type != op_div && instr.type != op_udiv) {
+    return false;
+  }
+  const auto& divisor = static_cast<const three_addr_instruction&>(instr).arg_3;
+  return !is_constant(divisor) || std::stoll(divisor) == 0 ||
+         (instr.type == op_div && std::stoll(divisor) == -1);
+}
+
+void eliminate_dead_code(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  eliminate_dead_code(i_vec, table, analyses, stats);
+}
+
+void eliminate_dead_code(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                         optimization_stats& stats) {
+  const auto& universe = analyses.universe();
+  std::vector<std::vector<int>> definitions(universe.size());
+  std::vector<std::string> args;
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    args.clear();
+    instruction_defs(*i_vec[i_index], args);
+    for (const auto& def : args) {
+      definitions[universe.find(def)].push_back(i_index);
+    }
+  }
+
+  // mark: every definition of variable read by marked instruction may reach it,
+  // so each instruction and variable enters work list at most once
+  std::vector<bool> marked(i_vec.size(), false);
+  std::vector<bool> needed(universe.size(), false);
+  std::vector<int> work_list;
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (is_root(*i_vec[i_index])) {
+      marked[i_index] = true;
+      work_list.push_back(i_index);
+    }
+  }
+  while (!work_list.empty()) {
+    auto i_index = work_list.back();
+    work_list.pop_back();
+    args.clear();
+    instruction_uses(*i_vec[i_index], args);
+    for (const auto& use : args) {
+      auto var_index = universe.find(use);
+      if (needed[var_index]) {
+        continue;
+      }
+      needed[var_index] = true;
+      for (auto def : definitions[var_index]) {
+        if (!marked[def]) {
+          marked[def] = true;
+          work_list.push_back(def);
+        }
+      }
+    }
+  }
+
+  // sweep: declarations stay only for variables which are still read or written
+  std::vector<bool> erased(i_vec.size(), false);
+  std::vector<bool> referenced(universe.size(), false);
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type == op_var || !marked[i_index]) {
+      continue;
+    }
+    visit_use_operands(*i_vec[i_index], [&](std::string& arg) { referenced[universe.find(arg)] = true; });
+    visit_def_operands(*i_vec[i_index], [&](std::string& arg) { referenced[universe.find(arg)] = true; });
+  }
+  size_t removed = 0;
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    const auto& instr = *i_vec[i_index];
+    if (instr.type == op_var) {
+      auto var_index = universe.find(static_cast<const binary_instruction&>(instr).arg_1);
+      erased[i_index] = var_index < 0 || !referenced[var_index];
+    } else {
+      erased[i_index] = !marked[i_index];
+    }
+    removed += erased[i_index];
+  }
+  if (removed != 0) {
+    stats.dead_instructions += removed;
+    erase_instructions(i_vec, table, erased);
+  }
+}
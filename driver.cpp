@@ -7,10 +7,64 @@ void usage() {
   std::cerr << "\traw-cfg - output of raw context free graph representation" << std::endl;
   std::cerr << "\tdot-cfg - output of dot context free graph representation" << std::endl;
   std::cerr << "\tuse-def - output of use def sets" << std::endl;
-  std::cerr << "\tanalysis (liveness)" << std::endl;
-  std::cerr << "\toptimize" << std::endl;
-  std::cerr << "\texec" << std::endl;
-  std::cerr << "\tdump-x86" << std::endl;
+  std::cerr << "\tanalysis (liveness | parallel-liveness)" << std::endl;
+  std::cerr << "\toptimize [options] - output of optimized program" << std::endl;
+  std::cerr << "\tstats [options] - statistics of optimizations and passes" << std::endl;
+  std::cerr << "\tssa - output of program in SSA form" << std::endl;
+  std::cerr << "\tssa-roundtrip - output of program translated to SSA and back" << std::endl;
+  std::cerr << "\texec [options]" << std::endl;
+  std::cerr << "\tdump-x86 [options]" << std::endl;
+  std::cerr << "where options : " << std::endl;
+  std::cerr << "\t-O0 .. -O3 - optimization level, optimize and stats default to -O2" << std::endl;
+  std::cerr << "\t--passes=pass,fixpoint(pass,...),... - explicit pass pipeline" << std::endl;
+  std::cerr << "\t--unroll-factor=N - iterations of loop body run between checks" << std::endl;
+  std::cerr << "\t--profile-generate=FILE - exec writes counts of blocks and branches to FILE"
+            << std::endl;
+  std::cerr << "\t--profile-use=FILE - inlining, unrolling, coalescing and block layout"
+            << " read counts from FILE" << std::endl;
+}
+
+// files profile is written to and read from, empty when not used
+struct profile_files {
+  std::string generate;
+  std::string use;
+};
+
+// options are between command and program, returns false on unknown option
+bool parse_pipeline_options(int argc, char* argv[], std::string& pipeline,
+                            unroll_options& unrolling, profile_files& profiling) {
+  size_t unroll_factor = 0;
+  for (int arg_index = 2; arg_index < argc - 1; ++arg_index) {
+    std::string option = argv[arg_index];
+    if (option.size() == 3 && option.compare(0, 2, "-O") == 0 && option[2] >= '0' &&
+        option[2] <= '3') {
+      pipeline = optimization_pipeline(option[2] - '0');
+      unrolling = unroll_options_for_level(option[2] - '0');
+    } else if (option.compare(0, 9, "--passes=") == 0) {
+      pipeline = option.substr(9);
+    } else if (option.compare(0, 16, "--unroll-factor=") == 0 && option.size() > 16 &&
+               std::all_of(option.begin() + 16, option.end(), ::isdigit)) {
+      unroll_factor = std::stoul(option.substr(16));
+    } else if (option.compare(0, 19, "--profile-generate=") == 0 && option.size() > 19) {
+      profiling.generate = option.substr(19);
+    } else if (option.compare(0, 14, "--profile-use=") == 0 && option.size() > 14) {
+      profiling.use = option.substr(14);
+    } else {
+      return false;
+    }
+  }
+  if (unroll_factor != 0) {
+    unrolling.factor = unroll_factor;
+  }
+  return true;
+}
+
+execution_profile load_profile(const std::string& file_name) {
+  std::ifstream in(file_name);
+  if (!in) {
+    throw profile_error("can not read profile " + file_name);
+  }
+  return read_profile(in);
 }
 
 #define YADFA_ENABLE_TESTS 1
@@ -30,9 +84,10 @@ int main(int argc, char* argv[]) {
   builtin_function builtin_print_def{(void *)builtin_print,
                                      {type_int32, type_int32, type_int32,
                                       type_int32, type_int32, type_int32,
-                                      type_int32, type_int32}};
-  builtin_function builtin_writeln_def{(void *)builtin_writeln, {type_int32}};
-  builtin_function builtin_write_def{(void *)builtin_write, {type_int32}};
+                                      type_int32, type_int32},
+                                     effect_io};
+  builtin_function builtin_writeln_def{(void *)builtin_writeln, {type_int32}, effect_io};
+  builtin_function builtin_write_def{(void *)builtin_write, {type_int32}, effect_io};
   builtin_functions.insert({"print", builtin_print_def});
   builtin_functions.insert({"write", builtin_write_def});
   builtin_functions.insert({"writeln", builtin_writeln_def});
@@ -45,6 +100,31 @@ int main(int argc, char* argv[]) {
   test_build_instruction_vec_by_hand();
   test_sequential_code();
   test_jmp_code();
+  test_parallel_liveness();
+  test_live_intervals();
+  test_coalesce_copies();
+  test_ssa();
+  test_sccp();
+  test_gvn();
+  test_lazy_code_motion();
+  test_value_ranges();
+  test_escape_analysis();
+  test_stack_operations();
+  test_function_summaries();
+  test_dead_code_elimination();
+  test_pass_manager();
+  test_analysis_manager();
+  test_instruction_edits();
+  test_strength_reduction();
+  test_loop_invariant_code_motion();
+  test_inliner();
+  test_instruction_combining();
+  test_control_flow_simplification();
+  test_tail_call_elimination();
+  test_loop_unrolling();
+  test_scalar_evolution();
+  test_induction_variable_simplification();
+  test_profile_guided_optimization();
 #endif
   label_table table;
 
@@ -57,62 +137,125 @@ int main(int argc, char* argv[]) {
     }
 
     auto program = parse(argv[2], table);
-    auto cfg = build_cfg(program, table);
-    dump_raw_cfg(program, cfg, std::cout);
+    analysis_manager analyses(program, table);
+    dump_raw_cfg(program, analyses.cfg(), std::cout);
   } else if (command == "--dot-cfg") {
     if (argc < 3) {
       usage();
       return -1;
     }
     auto program = parse(argv[2], table);
-    auto cfg = build_cfg(program, table);
-    gen_set output_gen_set;
-    kill_set output_kill_set;
-    build_use_def_sets(program, output_gen_set, output_kill_set);
-    auto liveness_sets = liveness_analysis(program, cfg);
-    dump_cfg_to_dot(program, cfg, output_gen_set, output_kill_set, liveness_sets, std::cout);
+    analysis_manager analyses(program, table);
+    dump_cfg_to_dot(program, analyses.cfg(), analyses.uses(), analyses.defs(),
+                    analyses.instruction_liveness(), std::cout);
   } else if (command == "--analysis") {
     if (argc < 4) {
       usage();
       return -1;
     }
-    auto type_of_analysis = argv[2];
+    std::string type_of_analysis = argv[2];
     auto program = parse(argv[3], table);
-    auto cfg = build_cfg(program, table);
-    auto liveness_sets = liveness_analysis(program, cfg);
-    dump_raw_liveness(liveness_sets, std::cout);
-    auto variable_intervals = compute_variables_live_ranges(liveness_sets);
-    dump_variable_intervals(variable_intervals, std::cout);
-    generate_gnuplot_interval(variable_intervals);
+    liveness_options options;
+    if (type_of_analysis == "parallel-liveness") {
+      options.partition_bits = 512;
+      options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    analysis_manager analyses(program, table, options);
+    dump_raw_liveness(analyses.instruction_liveness(), std::cout);
+    dump_live_intervals(analyses.intervals(), std::cout);
+    generate_gnuplot_interval(analyses.live_ranges());
   } else if (command == "--use-def") {
     if (argc < 3) {
       usage();
       return -1;
     }
     auto program = parse(argv[2], table);
-    gen_set output_gen_set;
-    kill_set output_kill_set;
-    build_use_def_sets(program, output_gen_set, output_kill_set);
-
-    dump_raw_gen_set(output_gen_set, std::cout);
-    dump_raw_kill_set(output_kill_set, std::cout);
-  } else if (command == "--optimize") {
+    analysis_manager analyses(program, table);
+    dump_raw_gen_set(analyses.uses(), std::cout);
+    dump_raw_kill_set(analyses.defs(), std::cout);
+  } else if (command == "--optimize" || command == "--stats") {
+    std::string pipeline = optimization_pipeline(2);
+    auto unrolling = unroll_options_for_level(2);
+    profile_files profiling;
+    if (argc < 3 || !parse_pipeline_options(argc, argv, pipeline, unrolling, profiling) ||
+        !profiling.generate.empty()) {
+      usage();
+      return -1;
+    }
+    auto program = parse(argv[argc - 1], table);
+    optimization_stats stats;
+    try {
+      if (!profiling.use.empty()) {
+        annotate_program(program, table, load_profile(profiling.use));
+      }
+      auto reports = run_passes(program, table, builtin_functions, pipeline, stats, unrolling);
+      if (command == "--optimize") {
+        dump_program(program, std::cout);
+      } else {
+        dump_optimization_stats(stats, std::cout);
+        dump_pass_reports(reports, std::cout);
+      }
+    } catch (const std::runtime_error& error) {
+      std::cerr << error.what() << std::endl;
+      return -1;
+    }
+  } else if (command == "--ssa" || command == "--ssa-roundtrip") {
     if (argc < 3) {
       usage();
       return -1;
     }
     auto program = parse(argv[2], table);
-    auto cfg = build_cfg(program, table);
-    auto liveness_sets = liveness_analysis(program, cfg);
-    auto variable_intervals = compute_variables_live_ranges(liveness_sets);
-    auto optimized_program = optimize(program, variable_intervals);
-    dump_program(optimized_program, std::cout);
-  } else if (command == "--exec") {
-    auto program = parse(argv[2], table);
-    exec(program, table, builtin_functions);
-  } else if (command == "--dump-x86") {
-    auto program = parse(argv[2], table);
-    dump_x86_64(program, table, builtin_functions);
+    auto to_ssa = [&](instruction_vec& i_vec, const parameter_vec& parameters) {
+      construct_ssa(i_vec, table, parameters);
+      if (command == "--ssa-roundtrip") {
+        destruct_ssa(i_vec, table);
+      }
+    };
+    for (auto& instr : program) {
+      if (instr->type == op_function) {
+        auto function = static_cast<function_instruction*>(instr.get());
+        to_ssa(function->body, parameter_types(function->args));
+      }
+    }
+    to_ssa(program, {});
+    dump_program(program, std::cout);
+  } else if (command == "--exec" || command == "--dump-x86") {
+    std::string pipeline = optimization_pipeline(0);
+    auto unrolling = unroll_options_for_level(0);
+    profile_files profiling;
+    if (argc < 3 || !parse_pipeline_options(argc, argv, pipeline, unrolling, profiling) ||
+        (command != "--exec" && !profiling.generate.empty())) {
+      usage();
+      return -1;
+    }
+    auto program = parse(argv[argc - 1], table);
+    optimization_stats stats;
+    try {
+      if (!profiling.use.empty()) {
+        annotate_program(program, table, load_profile(profiling.use));
+      }
+      // counting calls are made before passes so counts belong to blocks of source
+      if (!profiling.generate.empty()) {
+        instrument_program(program, table, builtin_functions);
+      }
+      run_passes(program, table, builtin_functions, pipeline, stats, unrolling);
+    } catch (const std::runtime_error& error) {
+      std::cerr << error.what() << std::endl;
+      return -1;
+    }
+    if (command == "--exec") {
+      exec(program, table, builtin_functions);
+      if (!profiling.generate.empty()) {
+        std::ofstream out(profiling.generate);
+        write_profile(collected_profile(), out);
+        if (!out) {
+          std::cerr << "can not write profile " << profiling.generate << std::endl;
+          return -1;
+        }
+      }
+    } else {
+      dump_x86_64(program, table, builtin_functions);
+    }
   } else {
     usage();
     return -1;
@@ -0,0 +1,162 @@
+#include "yadfa.h"
+
+namespace {
+// variables which may hold the same object, joined by copies
+struct alias_classes {
+  explicit alias_classes(size_t variables) : parent(variables) {
+    for (size_t var_index = 0; var_index != variables; ++var_index) {
+      parent[var_index] = var_index;
+    }
+  }
+  int find(int var_index) {
+    while (parent[var_index] != var_index) {
+      parent[var_index] = parent[parent[var_index]];
+      var_index = parent[var_index];
+    }
+    return var_index;
+  }
+  void join(int a, int b) {
+    parent[find(a)] = find(b);
+  }
+  std::vector<int> parent;
+};
+}  // namespace
+
+void promote_allocations(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  promote_allocations(i_vec, table, analyses, stats);
+}
+
+void promote_allocations(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                         optimization_stats& stats) {
+  const auto& universe = analyses.universe();
+  const int variables = universe.size();
+  alias_classes classes(variables);
+  for (const auto& instr : i_vec) {
+    if (instr->type == op_mov) {
+      auto mov = static_cast<const binary_instruction*>(instr.get());
+      if (!is_constant(mov->arg_2)) {
+        classes.join(universe.find(mov->arg_1), universe.find(mov->arg_2));
+      }
+    } else if (instr->type == op_phi) {
+      auto phi = static_cast<const phi_instruction*>(instr.get());
+      for (const auto& arg : phi->args) {
+        if (!is_constant(arg)) {
+          classes.join(universe.find(phi->dest), universe.find(arg));
+        }
+      }
+    }
+  }
+
+  // class is promoted when it holds only objects of its own new instructions
+  // and the address is only copied, compared and deleted, so it never leaves function
+  std::vector<bool> allocated(variables, false);
+  std::vector<bool> escaped(variables, false);
+  std::vector<std::string> args;
+  for (const auto& instr : i_vec) {
+    switch (instr->type) {
+      case op_new:
+        allocated[classes.find(universe.find(static_cast<unary_instruction&>(*instr).arg_1))] =
+            true;
+        break;
+      case op_mov:
+        if (is_constant(static_cast<binary_instruction&>(*instr).arg_2)) {
+          escaped[classes.find(universe.find(static_cast<binary_instruction&>(*instr).arg_1))] =
+              true;
+        }
+        break;
+      case op_phi:
+        for (const auto& arg : static_cast<phi_instruction&>(*instr).args) {
+          if (is_constant(arg)) {
+            escaped[classes.find(universe.find(static_cast<phi_instruction&>(*instr).dest))] =
+                true;
+          }
+        }
+        break;
+      case op_delete:
+      case op_cmp_eq:
+      case op_cmp_neq:
+        break;
+      default:
+        // passed to call, pushed, used in arithmetic or defined by anything else
+        args.clear();
+        instruction_uses(*instr, args);
+        instruction_defs(*instr, args);
+        for (const auto& arg : args) {
+          escaped[classes.find(universe.find(arg))] = true;
+        }
+        break;
+    }
+  }
+  auto is_promoted = [&](int var_index) {
+    auto root = classes.find(var_index);
+    return allocated[root] && !escaped[root];
+  };
+
+  std::vector<std::vector<int>> members(variables);
+  for (int var_index = 0; var_index != variables; ++var_index) {
+    if (is_promoted(var_index)) {
+      members[classes.find(var_index)].push_back(var_index);
+    }
+  }
+
+  // the same frame slot is reused by every execution of new, so no variable
+  // of its class may still hold previous object there
+  const auto& graph = analyses.blocks();
+  const auto& liveness = analyses.liveness();
+  std::vector<bool> erased(i_vec.size(), false);
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    bool has_allocation = false;
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      has_allocation = has_allocation || i_vec[i_index]->type == op_new;
+    }
+    if (!has_allocation) {
+      continue;
+    }
+    auto live = liveness.live_out[b_index];
+    for (int i_index = block.last; i_index >= block.first; --i_index) {
+      auto& instr = i_vec[i_index];
+      args.clear();
+      instruction_defs(*instr, args);
+      for (const auto& def : args) {
+        clear_bit(live, universe.find(def));
+      }
+      args.clear();
+      instruction_uses(*instr, args);
+      for (const auto& use : args) {
+        set_bit(live, universe.find(use));
+      }
+      if (instr->type != op_new) {
+        continue;
+      }
+      auto dest = universe.find(static_cast<unary_instruction&>(*instr).arg_1);
+      if (!is_promoted(dest)) {
+        continue;
+      }
+      const auto& class_members = members[classes.find(dest)];
+      if (std::any_of(class_members.begin(), class_members.end(),
+                      [&live](int var_index) { return test_bit(live, var_index); })) {
+        escaped[classes.find(dest)] = true;
+      }
+    }
+  }
+
+  for (size_t i_index = 0; i_index != i_vec.size(); ++i_index) {
+    auto& instr = i_vec[i_index];
+    if (instr->type != op_new && instr->type != op_delete) {
+      continue;
+    }
+    auto& arg = static_cast<unary_instruction&>(*instr).arg_1;
+    if (!is_promoted(universe.find(arg))) {
+      continue;
+    }
+    if (instr->type == op_new) {
+      instr = std::make_unique<unary_instruction>(op_alloca, arg);
+      ++stats.promoted_allocations;
+    } else {
+      erased[i_index] = true;
+    }
+  }
+  erase_instructions(i_vec, table, erased);
+}
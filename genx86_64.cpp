@@ -10,6 +10,9 @@ struct function_definition
   function_instruction function;
 };
 
+// objects have no fields yet, each one takes single slot
+constexpr int object_size = 8;
+
 struct variable_info {
   size_t index = std::numeric_limits<size_t>::max();
   std::string type;
@@ -26,6 +29,10 @@ void dump_x86_64(const asmjit::CodeHolder &code) {
   std::cout << '\n';
 }
 
+std::string object_slot_name(size_t i_index) {
+  return "alloca " + std::to_string(i_index);
+}
+
 std::map<std::string, variable_info>
 populate_variable_indexes(const instruction_vec &i_vec) {
   std::map<std::string, variable_info> variables_indexes;
@@ -41,6 +48,11 @@ populate_variable_indexes(const instruction_vec &i_vec) {
 
       variables_indexes[var_name] = variable_info{num_variables, var_type};
     }
+    if (instr->type == op_alloca) {
+      // object gets its own slot, key is not valid variable name
+      ++num_variables;
+      variables_indexes[object_slot_name(i_index)] = variable_info{num_variables, "object"};
+    }
   }
   return variables_indexes;
 }
@@ -62,7 +74,8 @@ gen_allocation(const std::map<std::string, variable_info> &variables_indexes,
   using namespace asmjit;
   // TODO hardcoded for now, only 32 bit values
   constexpr size_t variable_size = 8;
-  const size_t allocated_mem = variables_indexes.size() * variable_size;
+  // rsp stays aligned to 16 bytes for calls of allocator and builtins
+  const size_t allocated_mem = (variables_indexes.size() * variable_size + 15) & ~size_t(15);
   a.sub(x86::rsp, allocated_mem);
   return allocated_mem;
 }
@@ -111,6 +124,151 @@ asmjit::x86::Gp get_register_by_index(int index) {
   return reg;
 }
 
+// loads variable or immediate operand into 32 bit register
+void load_operand(asmjit::x86::Assembler &a,
+                  std::map<std::string, variable_info> &variables_info,
+                  const asmjit::x86::Gp &reg, const std::string &arg) {
+  using namespace asmjit;
+  if (is_constant(arg)) {
+    a.mov(reg, static_cast<int32_t>(std::stoll(arg)));
+  } else {
+    std::uint8_t variable_size = 8;
+    auto offset = variables_info[arg].index * (-variable_size);
+    a.mov(reg, x86::dword_ptr(x86::rbp, offset));
+  }
+}
+
+// eax = eax * factor without imul where at most two shifts,
+// lea or add do the same
+void gen_mul_by_constant(asmjit::x86::Assembler &a, int32_t factor) {
+  using namespace asmjit;
+  auto magnitude = factor < 0 ? 0u - static_cast<uint32_t>(factor)
+                              : static_cast<uint32_t>(factor);
+  // lea scales 2, 4 and 8 give factors 3, 5 and 9, optionally shifted
+  auto lea_shift = [](uint32_t value) {
+    return value == 3 ? 1 : value == 5 ? 2 : value == 9 ? 3 : 0;
+  };
+  int low_zeros = 0;
+  while (magnitude != 0 && (magnitude & (uint32_t(1) << low_zeros)) == 0) {
+    ++low_zeros;
+  }
+  auto odd = magnitude >> low_zeros;
+  auto exponent = power_of_two_exponent(magnitude);
+  if (factor == 0) {
+    a.xor_(x86::eax, x86::eax);
+    return;
+  }
+  if (exponent >= 0) {
+    if (exponent != 0) {
+      a.shl(x86::eax, exponent);
+    }
+  } else if (lea_shift(odd) != 0) {
+    a.lea(x86::eax, x86::ptr(x86::rax, x86::rax, lea_shift(odd)));
+    if (low_zeros != 0) {
+      a.shl(x86::eax, low_zeros);
+    }
+  } else if (power_of_two_exponent(magnitude - (uint32_t(1) << low_zeros)) > 0) {
+    // two bits set
+    a.mov(x86::ecx, x86::eax);
+    a.shl(x86::eax, power_of_two_exponent(magnitude - (uint32_t(1) << low_zeros)));
+    if (low_zeros != 0) {
+      a.shl(x86::ecx, low_zeros);
+    }
+    a.add(x86::eax, x86::ecx);
+  } else if (power_of_two_exponent(magnitude + 1) > 0) {
+    // 2^k - 1
+    a.mov(x86::ecx, x86::eax);
+    a.shl(x86::eax, power_of_two_exponent(magnitude + 1));
+    a.sub(x86::eax, x86::ecx);
+  } else {
+    a.imul(x86::eax, x86::eax, factor);
+    return;
+  }
+  if (factor < 0) {
+    a.neg(x86::eax);
+  }
+}
+
+// eax = eax / divisor rounded toward zero, false when only idiv
+// gives the same result including its traps
+bool gen_div_by_constant(asmjit::x86::Assembler &a, int32_t divisor) {
+  using namespace asmjit;
+  if (divisor == 0 || divisor == -1) {
+    return false;
+  }
+  if (divisor == 1) {
+    return true;
+  }
+  auto magnitude = divisor < 0 ? 0u - static_cast<uint32_t>(divisor)
+                               : static_cast<uint32_t>(divisor);
+  auto exponent = power_of_two_exponent(magnitude);
+  if (exponent > 0) {
+    // negative dividends are biased by 2^k - 1 to round toward zero
+    a.mov(x86::ecx, x86::eax);
+    a.sar(x86::ecx, 31);
+    a.shr(x86::ecx, 32 - exponent);
+    a.add(x86::eax, x86::ecx);
+    a.sar(x86::eax, exponent);
+  } else {
+    auto magic = signed_division_magic(divisor);
+    a.mov(x86::ecx, x86::eax);
+    a.mov(x86::edx, magic.multiplier);
+    a.imul(x86::edx);
+    if (divisor > 0 && magic.multiplier < 0) {
+      a.add(x86::edx, x86::ecx);
+    } else if (divisor < 0 && magic.multiplier > 0) {
+      a.sub(x86::edx, x86::ecx);
+    }
+    if (magic.shift != 0) {
+      a.sar(x86::edx, magic.shift);
+    }
+    // quotient below zero is one too small
+    a.mov(x86::eax, x86::edx);
+    a.shr(x86::eax, 31);
+    a.add(x86::eax, x86::edx);
+    return true;
+  }
+  if (divisor < 0) {
+    a.neg(x86::eax);
+  }
+  return true;
+}
+
+// eax = eax / divisor of unsigned values, false for division by zero
+bool gen_udiv_by_constant(asmjit::x86::Assembler &a, uint32_t divisor) {
+  using namespace asmjit;
+  if (divisor == 0) {
+    return false;
+  }
+  auto exponent = power_of_two_exponent(divisor);
+  if (exponent >= 0) {
+    if (exponent != 0) {
+      a.shr(x86::eax, exponent);
+    }
+    return true;
+  }
+  auto magic = unsigned_division_magic(divisor);
+  a.mov(x86::ecx, x86::eax);
+  a.mov(x86::edx, magic.multiplier);
+  a.mul(x86::edx);
+  if (magic.add) {
+    // (dividend - high) / 2 + high avoids overflow of 33 bit multiplier
+    a.sub(x86::ecx, x86::edx);
+    a.shr(x86::ecx, 1);
+    a.add(x86::ecx, x86::edx);
+    a.mov(x86::eax, x86::ecx);
+    if (magic.shift > 1) {
+      a.shr(x86::eax, magic.shift - 1);
+    }
+  } else {
+    a.mov(x86::eax, x86::edx);
+    if (magic.shift != 0) {
+      a.shr(x86::eax, magic.shift);
+    }
+  }
+  return true;
+}
+
 void push_arguments_for_builtin_fun(
     asmjit::x86::Assembler &a,
     const std::map<std::string, variable_info> &variables_info,
@@ -122,7 +280,7 @@ void push_arguments_for_builtin_fun(
   int args_on_stack = args_number - max_number_args_via_register;
   if (args_number <= max_number_args_via_register) {
     for (int arg_index = 1; arg_index != args.size(); ++arg_index) {
-      if (!isdigit(args[arg_index].front())) {
+      if (!is_constant(args[arg_index])) {
         auto var_info_it = variables_info.find(args[arg_index]);
         if (var_info_it != variables_info.end()) {
           auto var_offset = var_info_it->second.index * (-variable_size);
@@ -137,7 +295,7 @@ void push_arguments_for_builtin_fun(
     if (args_on_stack > 0) {
       for (int arg_index = 1; arg_index != max_number_args_via_register + 1;
            ++arg_index) {
-        if (!isdigit(args[arg_index].front())) {
+        if (!is_constant(args[arg_index])) {
 
         } else {
           a.mov(get_register_by_index(arg_index), std::stoi(args[arg_index]));
@@ -148,8 +306,8 @@ void push_arguments_for_builtin_fun(
       // as first 6 arguments are passed via registers
       for (int arg_on_stack_index = args_on_stack; arg_on_stack_index != 0;
            --arg_on_stack_index) {
-        if (!isdigit(args[max_number_args_via_register + arg_on_stack_index]
-                         .front())) {
+        if (!is_constant(
+                args[max_number_args_via_register + arg_on_stack_index])) {
 
         } else {
           a.push(std::stoi(
@@ -171,7 +329,7 @@ void push_arguments_for_def_fun(
   int args_on_stack = args_number - max_number_args_via_register;
   if (args_number <= max_number_args_via_register) {
     for (int arg_index = 1; arg_index != args.size(); ++arg_index) {
-      if (!isdigit(args[arg_index].front())) {
+      if (!is_constant(args[arg_index])) {
         auto var_info_it = variables_info.find(args[arg_index]);
         if (var_info_it != variables_info.end()) {
           auto var_offset = var_info_it->second.index * (-variable_size);
@@ -186,7 +344,7 @@ void push_arguments_for_def_fun(
     if (args_on_stack > 0) {
       for (int arg_index = 1; arg_index != max_number_args_via_register + 1;
            ++arg_index) {
-        if (!isdigit(args[arg_index].front())) {
+        if (!is_constant(args[arg_index])) {
 
         } else {
           a.mov(get_register_by_index(arg_index), std::stoi(args[arg_index]));
@@ -197,8 +355,8 @@ void push_arguments_for_def_fun(
       // as first 6 arguments are passed via registers
       for (int arg_on_stack_index = args_on_stack; arg_on_stack_index != 0;
            --arg_on_stack_index) {
-        if (!isdigit(args[max_number_args_via_register + arg_on_stack_index]
-                         .front())) {
+        if (!is_constant(
+                args[max_number_args_via_register + arg_on_stack_index])) {
 
         } else {
           a.push(std::stoi(
@@ -228,7 +386,7 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     auto var_info = variables_info[var_name];
     std::uint8_t variable_size = 8;
     auto var_offset = var_info.index * (-variable_size);
-    if (!isdigit(var_value[0])) {
+    if (!is_constant(var_value)) {
       auto rhs_info = variables_info[var_value];
       auto rhs_offset = rhs_info.index * (-variable_size);
       a.mov(x86::rax, x86::qword_ptr(x86::rbp, rhs_offset));
@@ -244,13 +402,10 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     // TODO assuming args are lvalues
     std::uint8_t variable_size = 8;
     auto arg_1_info = variables_info[arg_1];
-    auto arg_2_info = variables_info[arg_2];
-    auto arg_3_info = variables_info[arg_3];
     auto arg_1_offset = arg_1_info.index * (-variable_size);
-    auto arg_2_offset = arg_2_info.index * (-variable_size);
-    auto arg_3_offset = arg_3_info.index * (-variable_size);
-    a.mov(x86::rax, x86::dword_ptr(x86::rbp, arg_2_offset));
-    a.add(x86::rax, x86::dword_ptr(x86::rbp, arg_3_offset));
+    load_operand(a, variables_info, x86::eax, arg_2);
+    load_operand(a, variables_info, x86::ecx, arg_3);
+    a.add(x86::eax, x86::ecx);
     a.mov(x86::dword_ptr(x86::rbp, arg_1_offset), x86::eax);
   }
   if (instr->type == op_sub) {
@@ -260,13 +415,10 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     // TODO assuming args are lvalues
     std::uint8_t variable_size = 8;
     auto arg_1_info = variables_info[arg_1];
-    auto arg_2_info = variables_info[arg_2];
-    auto arg_3_info = variables_info[arg_3];
     auto arg_1_offset = arg_1_info.index * (-variable_size);
-    auto arg_2_offset = arg_2_info.index * (-variable_size);
-    auto arg_3_offset = arg_3_info.index * (-variable_size);
-    a.mov(x86::rax, x86::dword_ptr(x86::rbp, arg_2_offset));
-    a.sub(x86::rax, x86::dword_ptr(x86::rbp, arg_3_offset));
+    load_operand(a, variables_info, x86::eax, arg_2);
+    load_operand(a, variables_info, x86::ecx, arg_3);
+    a.sub(x86::eax, x86::ecx);
     a.mov(x86::dword_ptr(x86::rbp, arg_1_offset), x86::eax);
   }
   if (instr->type == op_mul) {
@@ -276,14 +428,17 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     // TODO assuming args are lvalues
     std::uint8_t variable_size = 8;
     auto arg_1_info = variables_info[arg_1];
-    auto arg_2_info = variables_info[arg_2];
-    auto arg_3_info = variables_info[arg_3];
     auto arg_1_offset = arg_1_info.index * (-variable_size);
-    auto arg_2_offset = arg_2_info.index * (-variable_size);
-    auto arg_3_offset = arg_3_info.index * (-variable_size);
-    a.mov(x86::rax, x86::dword_ptr(x86::rbp, arg_2_offset));
-    a.mov(x86::rcx, x86::dword_ptr(x86::rbp, arg_3_offset));
-    a.mul(x86::rcx);
+    if (is_constant(arg_2) && !is_constant(arg_3)) {
+      std::swap(arg_2, arg_3);
+    }
+    load_operand(a, variables_info, x86::eax, arg_2);
+    if (is_constant(arg_3)) {
+      gen_mul_by_constant(a, static_cast<int32_t>(std::stoll(arg_3)));
+    } else {
+      load_operand(a, variables_info, x86::ecx, arg_3);
+      a.imul(x86::eax, x86::ecx);
+    }
     a.mov(x86::dword_ptr(x86::rbp, arg_1_offset), x86::eax);
   }
 
@@ -294,14 +449,55 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     // TODO assuming args are lvalues
     std::uint8_t variable_size = 8;
     auto arg_1_info = variables_info[arg_1];
-    auto arg_2_info = variables_info[arg_2];
-    auto arg_3_info = variables_info[arg_3];
     auto arg_1_offset = arg_1_info.index * (-variable_size);
-    auto arg_2_offset = arg_2_info.index * (-variable_size);
-    auto arg_3_offset = arg_3_info.index * (-variable_size);
-    a.mov(x86::rax, x86::dword_ptr(x86::rbp, arg_2_offset));
-    a.cdq();
-    a.idiv(x86::dword_ptr(x86::rbp, arg_3_offset));
+    load_operand(a, variables_info, x86::eax, arg_2);
+    if (!is_constant(arg_3) || !gen_div_by_constant(a, static_cast<int32_t>(std::stoll(arg_3)))) {
+      load_operand(a, variables_info, x86::ecx, arg_3);
+      a.cdq();
+      a.idiv(x86::ecx);
+    }
+    a.mov(x86::dword_ptr(x86::rbp, arg_1_offset), x86::eax);
+  }
+  if (instr->type == op_udiv) {
+    auto arg_1 = static_cast<three_addr_instruction *>(instr.get())->arg_1;
+    auto arg_2 = static_cast<three_addr_instruction *>(instr.get())->arg_2;
+    auto arg_3 = static_cast<three_addr_instruction *>(instr.get())->arg_3;
+    std::uint8_t variable_size = 8;
+    auto arg_1_info = variables_info[arg_1];
+    auto arg_1_offset = arg_1_info.index * (-variable_size);
+    load_operand(a, variables_info, x86::eax, arg_2);
+    if (!is_constant(arg_3) ||
+        !gen_udiv_by_constant(a, static_cast<uint32_t>(std::stoll(arg_3)))) {
+      load_operand(a, variables_info, x86::ecx, arg_3);
+      a.xor_(x86::edx, x86::edx);
+      a.div(x86::ecx);
+    }
+    a.mov(x86::dword_ptr(x86::rbp, arg_1_offset), x86::eax);
+  }
+  if (instr->type == op_shl || instr->type == op_sar) {
+    auto arg_1 = static_cast<three_addr_instruction *>(instr.get())->arg_1;
+    auto arg_2 = static_cast<three_addr_instruction *>(instr.get())->arg_2;
+    auto arg_3 = static_cast<three_addr_instruction *>(instr.get())->arg_3;
+    std::uint8_t variable_size = 8;
+    auto arg_1_info = variables_info[arg_1];
+    auto arg_1_offset = arg_1_info.index * (-variable_size);
+    load_operand(a, variables_info, x86::eax, arg_2);
+    // constant count is encoded in instruction, variable one has to be in cl
+    if (is_constant(arg_3)) {
+      auto count = std::stoi(arg_3) & 31;
+      if (instr->type == op_shl) {
+        a.shl(x86::eax, count);
+      } else {
+        a.sar(x86::eax, count);
+      }
+    } else {
+      load_operand(a, variables_info, x86::ecx, arg_3);
+      if (instr->type == op_shl) {
+        a.shl(x86::eax, x86::cl);
+      } else {
+        a.sar(x86::eax, x86::cl);
+      }
+    }
     a.mov(x86::dword_ptr(x86::rbp, arg_1_offset), x86::eax);
   }
   if (instr->type == op_push) {
@@ -310,7 +506,7 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     auto arg = static_cast<unary_instruction *>(instr.get())->arg_1;
     auto arg_info = variables_info[arg];
     auto arg_offset = arg_info.index * (-variable_size);
-    a.push(x86::dword_ptr(x86::rbp, arg_offset));
+    a.push(x86::qword_ptr(x86::rbp, arg_offset));
   }
   if (instr->type == op_pop) {
     // TODO assuming args are lvalues
@@ -318,19 +514,15 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     auto arg = static_cast<unary_instruction *>(instr.get())->arg_1;
     auto arg_info = variables_info[arg];
     auto arg_offset = arg_info.index * (-variable_size);
-    a.pop(x86::dword_ptr(x86::rbp, arg_offset));
+    a.pop(x86::qword_ptr(x86::rbp, arg_offset));
   }
   if (instr->type == op_jmp) {
     // TODO handle lvalues
-    // only jmp backward for now
     int next_instruction_index = 0;
     auto arg = static_cast<unary_instruction *>(instr.get())->arg_1;
-    // only if digit for now
-    if (isdigit(arg[0])) {
+    // offset is relative to jmp itself, as in control flow graph
+    if (is_constant(arg)) {
       auto jmp_offset = std::stoi(arg);
-      if (jmp_offset > 0) {
-        jmp_offset += 1;
-      }
       next_instruction_index = index + jmp_offset;
     } else {
       auto label_it = ltable.instance.find(arg);
@@ -343,7 +535,7 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     }
     auto label_it = label_per_instruction.find(next_instruction_index);
     if (label_it == label_per_instruction.end()) {
-      code_generation_error("instruction is out of range");
+      throw code_generation_error("instruction is out of range");
     }
     a.jmp(label_it->second);
   }
@@ -360,13 +552,10 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     // TODO assuming args are lvalues
     std::uint8_t variable_size = 8;
     auto arg_1_info = variables_info[arg_1];
-    auto arg_2_info = variables_info[arg_2];
-    auto arg_3_info = variables_info[arg_3];
     auto arg_1_offset = arg_1_info.index * (-variable_size);
-    auto arg_2_offset = arg_2_info.index * (-variable_size);
-    auto arg_3_offset = arg_3_info.index * (-variable_size);
-    a.mov(x86::eax, x86::dword_ptr(x86::rbp, arg_2_offset));
-    a.cmp(x86::eax, x86::dword_ptr(x86::rbp, arg_3_offset));
+    load_operand(a, variables_info, x86::eax, arg_2);
+    load_operand(a, variables_info, x86::ecx, arg_3);
+    a.cmp(x86::eax, x86::ecx);
     auto false_label = a.newLabel();
     auto end_label = a.newLabel();
     if (instr->type == op_cmp_eq) {
@@ -395,16 +584,13 @@ void gen_x64_instruction(const instruction_vec &i_vec,
   if (instr->type == op_if) {
     auto false_label = a.newLabel();
     auto arg = static_cast<binary_instruction *>(instr.get())->arg_1;
-    auto arg_info = variables_info[arg];
-    std::uint8_t variable_size = 8;
-    auto arg_offset = arg_info.index * (-variable_size);
     auto offset = static_cast<binary_instruction *>(instr.get())->arg_2;
-    a.mov(x86::ebx, x86::dword_ptr(x86::rbp, arg_offset));
-    a.cmp(x86::ebx, 0);
+    load_operand(a, variables_info, x86::eax, arg);
+    a.cmp(x86::eax, 0);
     a.jng(false_label);
     // only if digit for now
     int next_instruction_index = 0;
-    if (isdigit(offset[0])) {
+    if (is_constant(offset)) {
       auto jmp_offset = std::stoi(offset);
       next_instruction_index = index + jmp_offset;
     } else {
@@ -418,11 +604,34 @@ void gen_x64_instruction(const instruction_vec &i_vec,
     }
     auto label_it = label_per_instruction.find(next_instruction_index);
     if (label_it == label_per_instruction.end()) {
-      code_generation_error("instruction is out of range");
+      throw code_generation_error("instruction is out of range");
     }
     a.jmp(label_it->second);
     a.bind(false_label);
   }
+  if (instr->type == op_new) {
+    std::uint8_t variable_size = 8;
+    auto arg = static_cast<unary_instruction *>(instr.get())->arg_1;
+    auto arg_offset = variables_info[arg].index * (-variable_size);
+    a.mov(x86::edi, object_size);
+    a.call(asmjit::imm(reinterpret_cast<void *>(&std::malloc)));
+    a.mov(x86::qword_ptr(x86::rbp, arg_offset), x86::rax);
+  }
+  if (instr->type == op_delete) {
+    std::uint8_t variable_size = 8;
+    auto arg = static_cast<unary_instruction *>(instr.get())->arg_1;
+    auto arg_offset = variables_info[arg].index * (-variable_size);
+    a.mov(x86::rdi, x86::qword_ptr(x86::rbp, arg_offset));
+    a.call(asmjit::imm(reinterpret_cast<void *>(&std::free)));
+  }
+  if (instr->type == op_alloca) {
+    std::uint8_t variable_size = 8;
+    auto arg = static_cast<unary_instruction *>(instr.get())->arg_1;
+    auto arg_offset = variables_info[arg].index * (-variable_size);
+    auto object_offset = variables_info[object_slot_name(index)].index * (-variable_size);
+    a.lea(x86::rax, x86::ptr(x86::rbp, object_offset));
+    a.mov(x86::qword_ptr(x86::rbp, arg_offset), x86::rax);
+  }
   if (instr->type == op_nop) {
     a.nop();
   }
@@ -464,6 +673,13 @@ void gen_x64_instruction(const instruction_vec &i_vec,
           a.add(x86::rsp, deallocateArgMem);
         }
       }
+    } else if (args.size() <= number_of_args_passed_via_regs + fun_name_arg &&
+               is_tail_call(i_vec, ltable, index)) {
+      // callee returns straight to our caller, frame is released before jump
+      push_arguments_for_def_fun(a, variables_info, args);
+      a.mov(x86::rsp, x86::rbp);
+      gen_epilog(a);
+      a.jmp(label_it->second);
     } else {
       // TODO only rvalue arguments for now
       push_arguments_for_def_fun(a, variables_info, args);
@@ -476,6 +692,9 @@ void gen_x64_instruction(const instruction_vec &i_vec,
   // op_ret is no-op for now
   if (instr->type == op_ret) {
   }
+  if (instr->type == op_phi) {
+    throw code_generation_error("phi has to be removed before code generation");
+  }
   if (instr->type == op_pop_args) {
     auto args = static_cast<pop_args_instruction *>(instr.get())->args;
     // TODO for now it's taking only first six arguments via registers
@@ -555,6 +774,9 @@ void gen_x64(const instruction_vec &i_vec, const asmjit::JitRuntime &rt,
 
     auto variables_indexes_function_body =
         populate_variable_indexes(function_body);
+    // arguments inserted above moved labels of body
+    auto function_ltable = ltable;
+    update_label_table(function_body, function_ltable);
     a.bind(function_label);
     gen_prolog(a);
     // allocate memory
@@ -563,11 +785,14 @@ void gen_x64(const instruction_vec &i_vec, const asmjit::JitRuntime &rt,
     for (int body_index = 0; body_index != function_body.size(); ++body_index) {
       populate_label(function_body, a, label_per_instruction, body_index);
     }
+    // jump right past the last instruction leaves function
+    label_per_instruction[function_body.size()] = a.newLabel();
     for (int body_index = 0; body_index != function_body.size(); ++body_index) {
       gen_x64_instruction(function_body, variables_indexes_function_body,
                           label_per_instruction, function_labels, function_vec,
-                          a, ltable, body_index, builtin_functions);
+                          a, function_ltable, body_index, builtin_functions);
     }
+    a.bind(label_per_instruction[function_body.size()]);
     // deallocate
     deallocate_and_return(allocated_mem_fun, a);
   }
@@ -580,11 +805,13 @@ void gen_x64(const instruction_vec &i_vec, const asmjit::JitRuntime &rt,
   for (int index = 0; index != i_vec.size(); ++index) {
     populate_label(i_vec, a, label_per_instruction, index);
   }
+  label_per_instruction[i_vec.size()] = a.newLabel();
   for (int index = 0; index != i_vec.size(); ++index) {
     gen_x64_instruction(i_vec, variables_indexes, label_per_instruction,
                         function_labels, function_vec, a, ltable, index,
                         builtin_functions);
   }
+  a.bind(label_per_instruction[i_vec.size()]);
   // deallocate
   deallocate_and_return(allocated_mem, a);
 }
@@ -0,0 +1,185 @@
+#include "yadfa.h"
+
+namespace {
+struct expression_key {
+  instruction_type type;
+  int lhs;
+  int rhs;
+  bool operator==(const expression_key& other) const {
+    return type == other.type && lhs == other.lhs && rhs == other.rhs;
+  }
+};
+
+struct expression_hash {
+  size_t operator()(const expression_key& key) const {
+    uint64_t hash = key.type;
+    hash = hash * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(key.lhs);
+    hash = hash * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(key.rhs);
+    return hash ^ (hash >> 29);
+  }
+};
+
+bool is_commutative(instruction_type type) {
+  return type == op_add || type == op_mul || type == op_cmp_eq || type == op_cmp_neq;
+}
+
+bool is_numbered_expression(instruction_type type) {
+  switch (type) {
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_div:
+    case op_shl:
+    case op_sar:
+    case op_udiv:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+      return true;
+    default:
+      return false;
+  }
+}
+}  // namespace
+
+void number_values(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  number_values(i_vec, table, analyses, stats);
+}
+
+void number_values(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                   optimization_stats& stats) {
+  const auto& graph = analyses.blocks();
+  if (graph.blocks.empty()) {
+    return;
+  }
+  const auto& tree = analyses.dominators();
+  const auto& universe = analyses.universe();
+  const int variables = universe.size();
+
+  // only names with at most one definition which dominates all their uses
+  // hold one value everywhere they are visible, parameters are never defined in function body
+  std::vector<int> def_positions;
+  const auto numbered = find_strict_variables(i_vec, graph, tree, universe, def_positions);
+
+  // value number of variable is index of its leader variable, which is
+  // defined in dominator of every definition with the same number
+  // constants are numbered after all variables
+  std::vector<int> value_numbers(variables);
+  for (int var_index = 0; var_index != variables; ++var_index) {
+    value_numbers[var_index] = var_index;
+  }
+  std::unordered_map<std::string, int> constant_numbers;
+  auto operand_number = [&](const std::string& arg) {
+    if (is_constant(arg)) {
+      auto value = std::to_string(static_cast<int32_t>(std::stoll(arg)));
+      return constant_numbers.insert({value, variables + constant_numbers.size()}).first->second;
+    }
+    return value_numbers[universe.find(arg)];
+  };
+  auto is_stable = [&](const std::string& arg) {
+    return is_constant(arg) || numbered[universe.find(arg)];
+  };
+
+  // scoped table, entries added in block are removed when its dominator subtree is done
+  std::unordered_map<expression_key, int, expression_hash> available;
+  std::vector<expression_key> scope_log;
+  std::vector<std::pair<int, size_t>> dom_stack;
+
+  auto visit_block = [&](int b_index) {
+    const auto& block = graph.blocks[b_index];
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      auto& instr = i_vec[i_index];
+      if (instr->type == op_mov) {
+        auto mov = static_cast<binary_instruction*>(instr.get());
+        auto dest = universe.find(mov->arg_1);
+        if (numbered[dest] && is_stable(mov->arg_2)) {
+          value_numbers[dest] = operand_number(mov->arg_2);
+        }
+        continue;
+      }
+      if (instr->type == op_phi) {
+        // phi which merges the same value is a copy of it
+        auto phi = static_cast<phi_instruction*>(instr.get());
+        auto dest = universe.find(phi->dest);
+        int common = -1;
+        bool meaningless = numbered[dest];
+        for (const auto& arg : phi->args) {
+          if (!meaningless || arg == phi->dest) {
+            continue;
+          }
+          auto number = is_stable(arg) ? operand_number(arg) : -1;
+          if (number < 0 || number >= variables || (common >= 0 && common != number) ||
+              (def_positions[number] >= 0 &&
+               graph.instruction_block[def_positions[number]] == b_index)) {
+            meaningless = false;
+          }
+          common = number;
+        }
+        if (meaningless && common >= 0) {
+          value_numbers[dest] = common;
+        }
+        continue;
+      }
+      if (!is_numbered_expression(instr->type)) {
+        continue;
+      }
+      auto op = static_cast<three_addr_instruction*>(instr.get());
+      auto dest = universe.find(op->arg_1);
+      if (!numbered[dest] || !is_stable(op->arg_2) || !is_stable(op->arg_3)) {
+        continue;
+      }
+      expression_key key{instr->type, operand_number(op->arg_2), operand_number(op->arg_3)};
+      if (is_commutative(key.type) && key.rhs < key.lhs) {
+        std::swap(key.lhs, key.rhs);
+      }
+      auto it = available.find(key);
+      if (it != available.end()) {
+        value_numbers[dest] = it->second;
+        instr = std::make_unique<binary_instruction>(op_mov, op->arg_1,
+                                                     universe.names[it->second]);
+        ++stats.redundant_expressions;
+        continue;
+      }
+      available.insert({key, dest});
+      scope_log.push_back(key);
+    }
+  };
+
+  // preorder walk of dominator tree, scope_log length marks scope of each block
+  std::vector<size_t> scope_starts;
+  dom_stack.push_back({0, 0});
+  scope_starts.push_back(scope_log.size());
+  visit_block(0);
+  while (!dom_stack.empty()) {
+    auto& top = dom_stack.back();
+    const auto& children = tree.children[top.first];
+    if (top.second < children.size()) {
+      auto child = children[top.second++];
+      dom_stack.push_back({child, 0});
+      scope_starts.push_back(scope_log.size());
+      visit_block(child);
+      continue;
+    }
+    while (scope_log.size() != scope_starts.back()) {
+      available.erase(scope_log.back());
+      scope_log.pop_back();
+    }
+    scope_starts.pop_back();
+    dom_stack.pop_back();
+  }
+
+  // every use reads its leader, copies left behind are dead or coalesced
+  for (auto& instr : i_vec) {
+    visit_use_operands(*instr, [&](std::string& arg) {
+      auto var_index = universe.find(arg);
+      if (numbered[var_index] && value_numbers[var_index] < variables &&
+          value_numbers[var_index] != var_index) {
+        arg = universe.names[value_numbers[var_index]];
+      }
+    });
+  }
+}
@@ -0,0 +1,371 @@
+#include "yadfa.h"
+
+namespace {
+// header phi of loop which changes by the same value in every iteration
+struct induction_variable {
+  std::string name;
+  std::vector<scev_linear> coefficients;
+};
+
+struct loop_shape {
+  int header = 0;
+  // position of argument from outside of loop in header phis
+  size_t entry_arg = 0;
+  // instructions computed before the loop are inserted in front of it
+  int preheader_position = 0;
+  int first_non_phi = 0;
+  // branch back to header, new variables are advanced in front of it
+  int latch_last = 0;
+};
+
+bool is_affine(const add_recurrence* recurrence, int loop) {
+  return recurrence != nullptr && recurrence->loop == loop &&
+         recurrence->coefficients.size() == 2 && !recurrence->coefficients[1].is_zero();
+}
+
+// header entered from single block outside of loop which only leads to it
+// and ends with jump or label of header
+bool match_loop_shape(const instruction_vec& i_vec, const block_graph& graph,
+                      const natural_loop& loop, loop_shape& shape) {
+  const auto& header = graph.blocks[loop.header];
+  if (header.predecessors.size() != 2) {
+    return false;
+  }
+  shape.header = loop.header;
+  shape.entry_arg = std::binary_search(loop.blocks.begin(), loop.blocks.end(),
+                                       header.predecessors[0])
+                        ? 1
+                        : 0;
+  const auto& entry = graph.blocks[header.predecessors[shape.entry_arg]];
+  if (std::binary_search(loop.blocks.begin(), loop.blocks.end(),
+                         header.predecessors[shape.entry_arg]) ||
+      entry.successors.size() != 1 ||
+      (i_vec[entry.last]->type != op_jmp && i_vec[entry.last]->type != op_label)) {
+    return false;
+  }
+  const auto& latch = graph.blocks[header.predecessors[1 - shape.entry_arg]];
+  if (i_vec[latch.last]->type != op_jmp && i_vec[latch.last]->type != op_if) {
+    return false;
+  }
+  shape.latch_last = latch.last;
+  shape.preheader_position = entry.last;
+  shape.first_non_phi = header.first;
+  while (shape.first_non_phi <= header.last && i_vec[shape.first_non_phi]->type == op_phi) {
+    ++shape.first_non_phi;
+  }
+  return shape.first_non_phi <= header.last;
+}
+
+// variables computed from header phi by copies, additions and subtractions in loop,
+// empty when any of them is read by anything else than those and exit test
+std::set<std::string> dead_family(const instruction_vec& i_vec, const block_graph& graph,
+                                  const std::vector<int>& blocks, const std::string& phi,
+                                  int compare_index) {
+  auto in_loop = [&](int i_index) {
+    return std::binary_search(blocks.begin(), blocks.end(), graph.instruction_block[i_index]);
+  };
+  auto is_step = [&](int i_index) {
+    auto type = i_vec[i_index]->type;
+    return in_loop(i_index) &&
+           (type == op_phi || type == op_mov || type == op_add || type == op_sub);
+  };
+  std::set<std::string> family{phi};
+  std::vector<std::string> args;
+  for (bool grown = true; grown;) {
+    grown = false;
+    for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+      args.clear();
+      instruction_uses(*i_vec[i_index], args);
+      if (!is_step(i_index) || std::none_of(args.begin(), args.end(), [&](const std::string& arg) {
+            return family.count(arg) != 0;
+          })) {
+        continue;
+      }
+      args.clear();
+      instruction_defs(*i_vec[i_index], args);
+      for (const auto& def : args) {
+        grown = family.insert(def).second || grown;
+      }
+    }
+  }
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    args.clear();
+    instruction_uses(*i_vec[i_index], args);
+    bool reads = std::any_of(args.begin(), args.end(),
+                             [&](const std::string& arg) { return family.count(arg) != 0; });
+    if (reads && i_index != compare_index && !is_step(i_index)) {
+      return {};
+    }
+  }
+  return family;
+}
+
+struct induction_simplifier {
+  induction_simplifier(instruction_vec& i_vec, const block_graph& graph,
+                       const scalar_evolution& evolution,
+                       const std::function<std::string()>& make_temp, instruction_edits& edits,
+                       optimization_stats& stats, int loop, const loop_shape& shape)
+      : i_vec(i_vec),
+        graph(graph),
+        evolution(evolution),
+        make_temp(make_temp),
+        edits(edits),
+        stats(stats),
+        loop(loop),
+        shape(shape) {}
+
+  instruction_vec& i_vec;
+  const block_graph& graph;
+  const scalar_evolution& evolution;
+  const std::function<std::string()>& make_temp;
+  instruction_edits& edits;
+  optimization_stats& stats;
+
+  const int loop;
+  const loop_shape shape;
+  std::vector<induction_variable> variables;
+  instruction_vec preheader;
+  // phis of new variables and their increments at the end of latch
+  instruction_vec phis;
+  instruction_vec increments;
+
+  void declare(const std::string& name) {
+    edits.insert_before(0, std::make_unique<binary_instruction>(op_var, name, "int32"));
+  }
+
+  // copies of the same recurrence read the first one, their increments become dead
+  void merge_duplicates() {
+    std::map<std::string, std::string> renames;
+    for (int i_index = graph.blocks[shape.header].first; i_index != shape.first_non_phi;
+         ++i_index) {
+      const auto& phi = static_cast<const phi_instruction&>(*i_vec[i_index]);
+      const auto* recurrence = evolution.recurrence(phi.dest);
+      if (!is_affine(recurrence, loop)) {
+        continue;
+      }
+      auto same = std::find_if(variables.begin(), variables.end(),
+                               [recurrence](const induction_variable& variable) {
+                                 return variable.coefficients == recurrence->coefficients;
+                               });
+      if (same == variables.end()) {
+        variables.push_back({phi.dest, recurrence->coefficients});
+        continue;
+      }
+      renames[phi.dest] = same->name;
+      edits.erase(i_index);
+      ++stats.merged_induction_variables;
+    }
+    if (renames.empty()) {
+      return;
+    }
+    for (auto& instr : i_vec) {
+      visit_use_operands(*instr, [&renames](std::string& arg) {
+        auto rename = renames.find(arg);
+        if (rename != renames.end()) {
+          arg = rename->second;
+        }
+      });
+    }
+  }
+
+  // new header phi for recurrence, started before loop and advanced at the end of
+  // each iteration, so that it needs no copy when program leaves SSA form
+  const std::string& variable_for(const std::vector<scev_linear>& coefficients) {
+    auto same = std::find_if(variables.begin(), variables.end(),
+                             [&coefficients](const induction_variable& variable) {
+                               return variable.coefficients == coefficients;
+                             });
+    if (same != variables.end()) {
+      return same->name;
+    }
+    auto name = make_temp();
+    auto next = make_temp();
+    declare(name);
+    declare(next);
+    auto start = expand_linear(coefficients[0], make_temp, preheader);
+    auto step = expand_linear(coefficients[1], make_temp, preheader);
+    std::vector<std::string> args(2, next);
+    args[shape.entry_arg] = start;
+    phis.push_back(std::make_unique<phi_instruction>(op_phi, name, args));
+    increments.push_back(std::make_unique<three_addr_instruction>(op_add, next, name, step));
+    variables.push_back({name, coefficients});
+    return variables.back().name;
+  }
+
+  // products of induction variable and invariant value become sums
+  void reduce_products() {
+    for (auto b_index : evolution.loops()[loop].blocks) {
+      for (int i_index = graph.blocks[b_index].first; i_index <= graph.blocks[b_index].last;
+           ++i_index) {
+        auto& instr = i_vec[i_index];
+        if (instr->type != op_mul && instr->type != op_shl) {
+          continue;
+        }
+        const auto& dest = static_cast<const three_addr_instruction&>(*instr).arg_1;
+        const auto* recurrence = evolution.recurrence(dest);
+        if (!is_affine(recurrence, loop)) {
+          continue;
+        }
+        const auto& variable = variable_for(recurrence->coefficients);
+        instr = std::make_unique<binary_instruction>(op_mov, dest, variable);
+        ++stats.reduced_induction_variables;
+      }
+    }
+  }
+
+  // exit test of variable used for nothing else compares other variable against
+  // its value in the last iteration, so the first one becomes dead
+  void replace_exit_test() {
+    const auto* count = evolution.backedges(loop);
+    if (count == nullptr) {
+      return;
+    }
+    const auto& blocks = evolution.loops()[loop].blocks;
+    auto branch_index = graph.blocks[count->exit_block].last;
+    const auto& condition = static_cast<const binary_instruction&>(*i_vec[branch_index]).arg_1;
+    int compare_index = -1;
+    std::vector<std::string> defs;
+    for (auto b_index : blocks) {
+      for (int i_index = graph.blocks[b_index].first; i_index <= graph.blocks[b_index].last;
+           ++i_index) {
+        defs.clear();
+        instruction_defs(*i_vec[i_index], defs);
+        if (std::find(defs.begin(), defs.end(), condition) != defs.end()) {
+          compare_index = i_index;
+        }
+      }
+    }
+    // condition is defined by comparison in loop when number of iterations is known,
+    // the new one gives the same value in every iteration, so other readers may stay
+    if (compare_index < 0) {
+      return;
+    }
+    const auto& compare = static_cast<const three_addr_instruction&>(*i_vec[compare_index]);
+    // variable compared is computed from header phi which is needed for nothing else
+    const induction_variable* tested = nullptr;
+    for (int i_index = graph.blocks[shape.header].first; i_index != shape.first_non_phi;
+         ++i_index) {
+      const auto& phi = static_cast<const phi_instruction&>(*i_vec[i_index]);
+      auto family = dead_family(i_vec, graph, blocks, phi.dest, compare_index);
+      if (family.count(compare.arg_2) || family.count(compare.arg_3)) {
+        auto variable = std::find_if(
+            variables.begin(), variables.end(),
+            [&phi](const induction_variable& variable) { return variable.name == phi.dest; });
+        tested = variable == variables.end() ? nullptr : &*variable;
+      }
+    }
+    if (tested == nullptr) {
+      return;
+    }
+    // other variable must not repeat its value before the last iteration
+    auto kept = std::find_if(variables.begin(), variables.end(),
+                             [&](const induction_variable& variable) {
+                               if (&variable == tested || !variable.coefficients[1].is_constant()) {
+                                 return false;
+                               }
+                               int64_t step = variable.coefficients[1].constant;
+                               if (step % 2 != 0) {
+                                 return true;
+                               }
+                               return count->is_constant() &&
+                                      static_cast<uint64_t>(static_cast<uint32_t>(
+                                          count->difference.constant)) *
+                                              static_cast<uint64_t>(std::abs(step)) <
+                                          (uint64_t(1) << 32);
+                             });
+    if (kept == variables.end()) {
+      return;
+    }
+    auto trips = expand_trip_count(*count, make_temp, preheader);
+    auto limit = make_temp();
+    declare(limit);
+    if (!expand_recurrence(add_recurrence{loop, kept->coefficients}, trips, limit, make_temp,
+                           preheader)) {
+      return;
+    }
+    auto next = branch_index + 1;
+    bool falls_inside = next < i_vec.size() &&
+                        std::binary_search(blocks.begin(), blocks.end(),
+                                           graph.instruction_block[next]);
+    // variable which does not wrap around may be compared by order, as loops
+    // counting up or down to bound are unrolled
+    auto stay = op_cmp_neq;
+    const auto& start = kept->coefficients[0];
+    int64_t step = kept->coefficients[1].constant;
+    if (start.is_constant() && count->is_constant()) {
+      auto last = start.constant + step * static_cast<uint32_t>(count->difference.constant);
+      if (last >= INT32_MIN && last <= INT32_MAX) {
+        stay = step > 0 ? op_cmp_lt : op_cmp_gt;
+      }
+    }
+    auto leave = stay == op_cmp_lt ? op_cmp_gte : stay == op_cmp_gt ? op_cmp_lte : op_cmp_eq;
+    i_vec[compare_index] = std::make_unique<three_addr_instruction>(
+        falls_inside ? leave : stay, condition, kept->name, limit);
+    ++stats.rewritten_exit_tests;
+  }
+
+  void run() {
+    merge_duplicates();
+    reduce_products();
+    // products are gone, so their factors may be left only to exit test
+    replace_exit_test();
+    for (auto& instr : preheader) {
+      edits.insert_before(shape.preheader_position, std::move(instr));
+    }
+    for (auto& instr : phis) {
+      edits.insert_before(graph.blocks[shape.header].first, std::move(instr));
+    }
+    for (auto& instr : increments) {
+      edits.insert_before(shape.latch_last, std::move(instr));
+    }
+  }
+};
+}  // namespace
+
+void simplify_induction_variables(instruction_vec& i_vec, label_table& table,
+                                  optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  simplify_induction_variables(i_vec, table, analyses, stats);
+}
+
+void simplify_induction_variables(instruction_vec& i_vec, label_table& table,
+                                  analysis_manager& analyses, optimization_stats& stats) {
+  const auto& graph = analyses.blocks();
+  if (graph.blocks.empty()) {
+    return;
+  }
+  const auto& evolution = analyses.evolution();
+  const auto& universe = analyses.universe();
+  size_t temp_counter = 0;
+  const std::function<std::string()> make_temp = [&]() {
+    std::string name;
+    do {
+      name = "lsr_tmp_" + std::to_string(temp_counter++);
+    } while (universe.find(name) >= 0);
+    return name;
+  };
+  instruction_edits edits;
+  bool changed = false;
+  const auto& loops = evolution.loops();
+  for (int loop = 0; loop != loops.size(); ++loop) {
+    // innermost loops only, their blocks do not overlap
+    bool innermost = true;
+    for (auto b_index : loops[loop].blocks) {
+      innermost = innermost && evolution.block_loops()[b_index] == loop;
+    }
+    loop_shape shape;
+    if (!innermost || !match_loop_shape(i_vec, graph, loops[loop], shape)) {
+      continue;
+    }
+    induction_simplifier simplifier(i_vec, graph, evolution, make_temp, edits, stats, loop, shape);
+    auto before = stats.merged_induction_variables + stats.reduced_induction_variables +
+                  stats.rewritten_exit_tests;
+    simplifier.run();
+    changed = changed || before != stats.merged_induction_variables +
+                                       stats.reduced_induction_variables +
+                                       stats.rewritten_exit_tests;
+  }
+  if (changed) {
+    apply_instruction_edits(i_vec, table, edits);
+  }
+}
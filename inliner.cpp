@@ -0,0 +1,269 @@
+#include "yadfa.h"
+
+namespace {
+using function_body_map = std::map<std::string, const function_instruction*>;
+
+// callee of at most this cost is inlined at call outside of loops,
+// every loop around call doubles it
+constexpr size_t inline_cost_budget = 12;
+
+// calls in deeper loops are not considered any hotter
+constexpr int inline_depth_limit = 3;
+
+// caller stops taking callees after it has grown by this cost
+constexpr size_t inline_growth_limit = 512;
+
+// with profile calls made this many times per entry of caller are as hot
+// as calls in deepest loops, calls never made are left alone
+constexpr int64_t hot_call_ratio = 16;
+
+// times body was entered in profiled run, -1 when unknown
+int64_t entry_count(const instruction_vec& body) {
+  for (const auto& instr : body) {
+    if (instr->profile_count >= 0) {
+      return instr->profile_count;
+    }
+  }
+  return -1;
+}
+
+// declarations, labels and nops make no code
+size_t inline_cost(const instruction_vec& body) {
+  return std::count_if(body.begin(), body.end(), [](const instruction_ptr& instr) {
+    return instr->type != op_var && instr->type != op_label && instr->type != op_nop &&
+           instr->type != op_ret;
+  });
+}
+
+std::vector<std::string> direct_callees(const function_instruction& function,
+                                        const function_body_map& functions) {
+  std::vector<std::string> callees;
+  for (const auto& instr : function.body) {
+    if (instr->type == op_call) {
+      const auto& callee = static_cast<const call_instruction&>(*instr).args.front();
+      if (functions.find(callee) != functions.end()) {
+        callees.push_back(callee);
+      }
+    }
+  }
+  return callees;
+}
+
+// functions which may call themselves through any chain of calls
+std::set<std::string> recursive_functions(const function_body_map& functions) {
+  std::set<std::string> recursive;
+  for (const auto& function : functions) {
+    std::set<std::string> visited;
+    auto work_list = direct_callees(*function.second, functions);
+    while (!work_list.empty()) {
+      auto name = work_list.back();
+      work_list.pop_back();
+      if (name == function.first) {
+        recursive.insert(name);
+        break;
+      }
+      if (!visited.insert(name).second) {
+        continue;
+      }
+      for (const auto& callee : direct_callees(*functions.at(name), functions)) {
+        work_list.push_back(callee);
+      }
+    }
+  }
+  return recursive;
+}
+
+// declared variables and operands of instructions, parameters of function included
+void collect_variables(const instruction_vec& i_vec, std::set<std::string>& names) {
+  std::vector<std::string> args;
+  for (const auto& instr : i_vec) {
+    args.clear();
+    if (instr->type == op_var) {
+      args.push_back(static_cast<const binary_instruction&>(*instr).arg_1);
+    }
+    instruction_uses(*instr, args);
+    instruction_defs(*instr, args);
+    names.insert(args.begin(), args.end());
+  }
+}
+
+// copy of callee body for single call, variables and labels get prefix, parameters
+// which callee only reads are replaced by variables passed to them, others are
+// copies of arguments, ret becomes nop when relative jumps leave body through it
+instruction_vec inline_body(const function_instruction& callee, const call_instruction& call,
+                            label_table& table, const std::string& prefix) {
+  const auto& body = callee.body;
+  std::set<std::string> written;
+  std::vector<std::string> defs;
+  for (const auto& instr : body) {
+    defs.clear();
+    instruction_defs(*instr, defs);
+    written.insert(defs.begin(), defs.end());
+  }
+  instruction_vec group;
+  std::map<std::string, std::string> names;
+  const auto parameters = parameter_types(callee.args);
+  for (size_t arg_index = 0; arg_index != parameters.size(); ++arg_index) {
+    const auto& parameter = parameters[arg_index].first;
+    const auto& arg = call.args[arg_index + 1];
+    if (!is_constant(arg) && written.find(parameter) == written.end()) {
+      names[parameter] = arg;
+      continue;
+    }
+    names[parameter] = prefix + parameter;
+    group.push_back(std::make_unique<binary_instruction>(op_var, prefix + parameter,
+                                                         parameters[arg_index].second));
+    group.push_back(std::make_unique<binary_instruction>(op_mov, prefix + parameter, arg));
+  }
+  auto rename = [&](std::string& arg) {
+    auto name = names.find(arg);
+    arg = name == names.end() ? prefix + arg : name->second;
+  };
+  std::map<std::string, std::string> labels;
+  for (const auto& instr : body) {
+    if (instr->type == op_label) {
+      const auto& label = static_cast<const unary_instruction&>(*instr).arg_1;
+      labels[label] = fresh_label(table, prefix + label + "_");
+    }
+  }
+  bool jumps_to_ret = false;
+  for (int i_index = 0; i_index != body.size(); ++i_index) {
+    const auto& instr = *body[i_index];
+    if (instr.type != op_jmp && instr.type != op_if) {
+      continue;
+    }
+    const auto& target = instr.type == op_jmp
+                             ? static_cast<const unary_instruction&>(instr).arg_1
+                             : static_cast<const binary_instruction&>(instr).arg_2;
+    if (is_constant(target) && i_index + std::stoi(target) >= static_cast<int>(body.size()) - 1) {
+      jumps_to_ret = true;
+    }
+  }
+  auto rename_label = [&](std::string& target) {
+    auto label = labels.find(target);
+    if (label != labels.end()) {
+      target = label->second;
+    }
+  };
+  for (const auto& instr : body) {
+    if (instr->type == op_ret) {
+      if (jumps_to_ret) {
+        group.push_back(std::make_unique<noarg_instruction>(op_nop));
+      }
+      continue;
+    }
+    instruction_ptr copy(instr->clone());
+    switch (copy->type) {
+      case op_var:
+        rename(static_cast<binary_instruction&>(*copy).arg_1);
+        break;
+      case op_label:
+      case op_jmp:
+        rename_label(static_cast<unary_instruction&>(*copy).arg_1);
+        break;
+      case op_if:
+        rename_label(static_cast<binary_instruction&>(*copy).arg_2);
+        break;
+      default:
+        break;
+    }
+    visit_use_operands(*copy, rename);
+    visit_def_operands(*copy, rename);
+    group.push_back(std::move(copy));
+  }
+  return group;
+}
+}  // namespace
+
+void inline_calls(instruction_vec& i_vec, label_table& table, const instruction_vec& program,
+                  optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  inline_calls(i_vec, table, program, analyses, stats);
+}
+
+void inline_calls(instruction_vec& i_vec, label_table& table, const instruction_vec& program,
+                  analysis_manager& analyses, optimization_stats& stats) {
+  function_body_map functions;
+  for (const auto& instr : program) {
+    if (instr->type == op_function) {
+      auto function = static_cast<const function_instruction*>(instr.get());
+      functions[function->args.front()] = function;
+    }
+  }
+  if (functions.empty()) {
+    return;
+  }
+  const auto recursive = recursive_functions(functions);
+  std::set<std::string> names;
+  collect_variables(i_vec, names);
+  const auto entries = entry_count(i_vec);
+  size_t growth = 0;
+  size_t site = 0;
+  // calls in inlined bodies are considered in next round
+  bool inlined = true;
+  while (inlined) {
+    inlined = false;
+    const auto& graph = analyses.blocks();
+    const auto depths = loop_depths(graph, find_natural_loops(graph, analyses.dominators()));
+    instruction_edits edits;
+    for (size_t i_index = 0; i_index != i_vec.size(); ++i_index) {
+      if (i_vec[i_index]->type != op_call) {
+        continue;
+      }
+      const auto& call = static_cast<const call_instruction&>(*i_vec[i_index]);
+      auto callee = functions.find(call.args.front());
+      if (callee == functions.end() || recursive.count(callee->first) ||
+          callee->second->args.size() != 2 * call.args.size() - 1) {
+        continue;
+      }
+      auto depth = std::min(depths[graph.instruction_block[i_index]], inline_depth_limit);
+      if (call.profile_count >= 0 && entries > 0) {
+        if (call.profile_count == 0) {
+          continue;
+        }
+        depth = call.profile_count >= hot_call_ratio * entries ? inline_depth_limit
+                : call.profile_count < entries                 ? 0
+                                                               : depth;
+      }
+      auto cost = inline_cost(callee->second->body);
+      if (cost > (inline_cost_budget << depth) || growth + cost > inline_growth_limit) {
+        continue;
+      }
+      std::set<std::string> callee_names;
+      collect_variables(callee->second->body, callee_names);
+      for (size_t arg_index = 1; arg_index < callee->second->args.size(); arg_index += 2) {
+        callee_names.insert(callee->second->args[arg_index]);
+      }
+      std::string prefix;
+      bool collides = true;
+      while (collides) {
+        prefix = callee->first + "_" + std::to_string(++site) + "_";
+        collides = false;
+        for (const auto& name : callee_names) {
+          collides = collides || names.count(prefix + name) != 0;
+        }
+      }
+      for (const auto& name : callee_names) {
+        names.insert(prefix + name);
+      }
+      // counts of callee are shared by all its calls
+      auto callee_entries = entry_count(callee->second->body);
+      for (auto& instr : inline_body(*callee->second, call, table, prefix)) {
+        if (call.profile_count >= 0 && callee_entries > 0) {
+          for (auto count : {&instr->profile_count, &instr->profile_taken}) {
+            *count = *count < 0 ? *count : *count * call.profile_count / callee_entries;
+          }
+        }
+        edits.insert_before(i_index, std::move(instr));
+      }
+      edits.erase(i_index);
+      growth += cost;
+      ++stats.inlined_calls;
+      inlined = true;
+    }
+    if (inlined) {
+      apply_instruction_edits(i_vec, table, edits);
+      analyses.invalidate();
+    }
+  }
+}
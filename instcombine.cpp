@@ -0,0 +1,371 @@
+#include "yadfa.h"
+
+namespace {
+// what rules may know about operands besides their names
+struct combine_context {
+  const variable_universe& universe;
+  const std::vector<bool>& strict;
+  const std::vector<int>& def_positions;
+  const instruction_vec& i_vec;
+
+  // operand which is constant or holds one value everywhere it is visible,
+  // only such may be read by instruction it was not read by before
+  bool is_stable(const std::string& arg) const {
+    return is_constant(arg) || strict[universe.find(arg)];
+  }
+
+  // the only definition of operand when it has given type, otherwise null
+  const three_addr_instruction* definition(const std::string& arg, instruction_type type) const {
+    if (is_constant(arg)) {
+      return nullptr;
+    }
+    auto var_index = universe.find(arg);
+    if (var_index < 0 || !strict[var_index] || def_positions[var_index] == -1) {
+      return nullptr;
+    }
+    const auto& instr = *i_vec[def_positions[var_index]];
+    return instr.type == type ? static_cast<const three_addr_instruction*>(&instr) : nullptr;
+  }
+};
+
+// rule gives instruction which replaces matched one, or null when it does not apply
+using combine_rule_function = instruction_ptr (*)(const three_addr_instruction& op,
+                                                  const combine_context& context);
+
+struct combine_rule {
+  instruction_type type;
+  combine_rule_function apply;
+};
+
+// constants wrap around at 32 bits as in generated code
+int32_t constant_value(const std::string& arg) {
+  return static_cast<int32_t>(std::stoll(arg));
+}
+
+std::string wrapped_constant(int64_t value) {
+  return std::to_string(static_cast<int32_t>(static_cast<uint32_t>(value)));
+}
+
+bool is_constant_value(const std::string& arg, int32_t value) {
+  return is_constant(arg) && constant_value(arg) == value;
+}
+
+instruction_ptr make_mov(const std::string& dest, const std::string& source) {
+  return std::make_unique<binary_instruction>(op_mov, dest, source);
+}
+
+instruction_ptr make_op(instruction_type type, const std::string& dest, const std::string& lhs,
+                        const std::string& rhs) {
+  return std::make_unique<three_addr_instruction>(type, dest, lhs, rhs);
+}
+
+instruction_ptr fold_constants(const three_addr_instruction& op, const combine_context&) {
+  if (!is_constant(op.arg_2) || !is_constant(op.arg_3)) {
+    return nullptr;
+  }
+  int64_t a = constant_value(op.arg_2);
+  int64_t b = constant_value(op.arg_3);
+  switch (op.type) {
+    case op_add:
+      return make_mov(op.arg_1, wrapped_constant(a + b));
+    case op_sub:
+      return make_mov(op.arg_1, wrapped_constant(a - b));
+    case op_mul:
+      return make_mov(op.arg_1, wrapped_constant(a * b));
+    case op_shl:
+      return make_mov(op.arg_1, wrapped_constant(static_cast<uint32_t>(a) << (b & 31)));
+    case op_sar:
+      return make_mov(op.arg_1, wrapped_constant(a >> (b & 31)));
+    case op_cmp_eq:
+      return make_mov(op.arg_1, std::to_string(a == b));
+    case op_cmp_neq:
+      return make_mov(op.arg_1, std::to_string(a != b));
+    case op_cmp_gt:
+      return make_mov(op.arg_1, std::to_string(a > b));
+    case op_cmp_lt:
+      return make_mov(op.arg_1, std::to_string(a < b));
+    case op_cmp_lte:
+      return make_mov(op.arg_1, std::to_string(a <= b));
+    case op_cmp_gte:
+      return make_mov(op.arg_1, std::to_string(a >= b));
+    default:
+      return nullptr;
+  }
+}
+
+// constants go right and variables are sorted, so equal expressions look the same
+instruction_ptr commute_operands(const three_addr_instruction& op, const combine_context&) {
+  bool lhs_constant = is_constant(op.arg_2);
+  bool rhs_constant = is_constant(op.arg_3);
+  if ((lhs_constant && !rhs_constant) ||
+      (!lhs_constant && !rhs_constant && op.arg_3 < op.arg_2)) {
+    return make_op(op.type, op.arg_1, op.arg_3, op.arg_2);
+  }
+  return nullptr;
+}
+
+instruction_ptr mirror_comparison(const three_addr_instruction& op, const combine_context&) {
+  if (!is_constant(op.arg_2) || is_constant(op.arg_3)) {
+    return nullptr;
+  }
+  instruction_type mirrored = op.type == op_cmp_lt    ? op_cmp_gt
+                              : op.type == op_cmp_gt  ? op_cmp_lt
+                              : op.type == op_cmp_lte ? op_cmp_gte
+                                                      : op_cmp_lte;
+  return make_op(mirrored, op.arg_1, op.arg_3, op.arg_2);
+}
+
+// x op 0, x * 1, x / 1
+instruction_ptr identity_operand(const three_addr_instruction& op, const combine_context&) {
+  int32_t identity = op.type == op_mul || op.type == op_div || op.type == op_udiv ? 1 : 0;
+  if (is_constant_value(op.arg_3, identity)) {
+    return make_mov(op.arg_1, op.arg_2);
+  }
+  return nullptr;
+}
+
+// x * 0, 0 << x, 0 >> x
+instruction_ptr absorbing_operand(const three_addr_instruction& op, const combine_context&) {
+  const auto& absorbing = op.type == op_mul ? op.arg_3 : op.arg_2;
+  if (is_constant_value(absorbing, 0)) {
+    return make_mov(op.arg_1, "0");
+  }
+  return nullptr;
+}
+
+instruction_ptr same_operands(const three_addr_instruction& op, const combine_context&) {
+  if (op.arg_2 != op.arg_3 || is_constant(op.arg_2)) {
+    return nullptr;
+  }
+  switch (op.type) {
+    case op_sub:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+      return make_mov(op.arg_1, "0");
+    case op_cmp_eq:
+    case op_cmp_lte:
+    case op_cmp_gte:
+      return make_mov(op.arg_1, "1");
+    default:
+      return nullptr;
+  }
+}
+
+// x - c is x + -c, so constants of sums meet in one instruction
+instruction_ptr subtract_constant(const three_addr_instruction& op, const combine_context&) {
+  if (is_constant(op.arg_2) || !is_constant(op.arg_3) || constant_value(op.arg_3) == INT32_MIN ||
+      constant_value(op.arg_3) == 0) {
+    return nullptr;
+  }
+  return make_op(op_add, op.arg_1, op.arg_2, std::to_string(-constant_value(op.arg_3)));
+}
+
+// (a + c1) + c2 is a + (c1 + c2), the same for products
+instruction_ptr reassociate_constants(const three_addr_instruction& op,
+                                      const combine_context& context) {
+  if (!is_constant(op.arg_3)) {
+    return nullptr;
+  }
+  auto inner = context.definition(op.arg_2, op.type);
+  if (inner == nullptr || !is_constant(inner->arg_3) || !context.is_stable(inner->arg_2)) {
+    return nullptr;
+  }
+  int64_t a = constant_value(inner->arg_3);
+  int64_t b = constant_value(op.arg_3);
+  return make_op(op.type, op.arg_1, inner->arg_2,
+                 wrapped_constant(op.type == op_add ? a + b : a * b));
+}
+
+// (a << c1) << c2 is a << (c1 + c2) while counts stay below 32
+instruction_ptr combine_shifts(const three_addr_instruction& op, const combine_context& context) {
+  if (!is_constant(op.arg_3)) {
+    return nullptr;
+  }
+  auto inner = context.definition(op.arg_2, op.type);
+  if (inner == nullptr || !is_constant(inner->arg_3) || !context.is_stable(inner->arg_2)) {
+    return nullptr;
+  }
+  auto a = constant_value(inner->arg_3);
+  auto b = constant_value(op.arg_3);
+  if (a < 0 || b < 0 || a > 31 || b > 31) {
+    return nullptr;
+  }
+  if (a + b > 31) {
+    // all bits shifted out, sign is all that stays of arithmetic shift
+    return op.type == op_shl ? make_mov(op.arg_1, "0")
+                             : make_op(op_sar, op.arg_1, inner->arg_2, "31");
+  }
+  return make_op(op.type, op.arg_1, inner->arg_2, std::to_string(a + b));
+}
+
+// (a - b) + b and b + (a - b) are a
+instruction_ptr add_of_difference(const three_addr_instruction& op,
+                                  const combine_context& context) {
+  for (int side = 0; side != 2; ++side) {
+    const auto& difference = side == 0 ? op.arg_2 : op.arg_3;
+    const auto& other = side == 0 ? op.arg_3 : op.arg_2;
+    auto inner = context.definition(difference, op_sub);
+    if (inner != nullptr && inner->arg_3 == other && context.is_stable(other) &&
+        context.is_stable(inner->arg_2)) {
+      return make_mov(op.arg_1, inner->arg_2);
+    }
+  }
+  return nullptr;
+}
+
+// (a + b) - b and (b + a) - b are a
+instruction_ptr difference_of_sum(const three_addr_instruction& op,
+                                  const combine_context& context) {
+  auto inner = context.definition(op.arg_2, op_add);
+  if (inner == nullptr) {
+    return nullptr;
+  }
+  // b cancels only when it holds the same value in both instructions
+  if (inner->arg_3 == op.arg_3 && context.is_stable(op.arg_3) && context.is_stable(inner->arg_2)) {
+    return make_mov(op.arg_1, inner->arg_2);
+  }
+  if (inner->arg_2 == op.arg_3 && context.is_stable(op.arg_3) && context.is_stable(inner->arg_3)) {
+    return make_mov(op.arg_1, inner->arg_3);
+  }
+  return nullptr;
+}
+
+// 0 - (0 - a) is a
+instruction_ptr double_negation(const three_addr_instruction& op, const combine_context& context) {
+  if (!is_constant_value(op.arg_2, 0)) {
+    return nullptr;
+  }
+  auto inner = context.definition(op.arg_3, op_sub);
+  if (inner == nullptr || !is_constant_value(inner->arg_2, 0) ||
+      !context.is_stable(inner->arg_3)) {
+    return nullptr;
+  }
+  return make_mov(op.arg_1, inner->arg_3);
+}
+
+// rules are tried in order, first one which applies wins
+const combine_rule combine_rules[] = {
+    {op_add, fold_constants},
+    {op_sub, fold_constants},
+    {op_mul, fold_constants},
+    {op_shl, fold_constants},
+    {op_sar, fold_constants},
+    {op_cmp_eq, fold_constants},
+    {op_cmp_neq, fold_constants},
+    {op_cmp_gt, fold_constants},
+    {op_cmp_lt, fold_constants},
+    {op_cmp_lte, fold_constants},
+    {op_cmp_gte, fold_constants},
+    {op_add, commute_operands},
+    {op_mul, commute_operands},
+    {op_cmp_eq, commute_operands},
+    {op_cmp_neq, commute_operands},
+    {op_cmp_gt, mirror_comparison},
+    {op_cmp_lt, mirror_comparison},
+    {op_cmp_lte, mirror_comparison},
+    {op_cmp_gte, mirror_comparison},
+    {op_add, identity_operand},
+    {op_sub, identity_operand},
+    {op_mul, identity_operand},
+    {op_div, identity_operand},
+    {op_udiv, identity_operand},
+    {op_shl, identity_operand},
+    {op_sar, identity_operand},
+    {op_mul, absorbing_operand},
+    {op_shl, absorbing_operand},
+    {op_sar, absorbing_operand},
+    {op_sub, same_operands},
+    {op_cmp_eq, same_operands},
+    {op_cmp_neq, same_operands},
+    {op_cmp_gt, same_operands},
+    {op_cmp_lt, same_operands},
+    {op_cmp_lte, same_operands},
+    {op_cmp_gte, same_operands},
+    {op_sub, double_negation},
+    {op_sub, difference_of_sum},
+    {op_sub, subtract_constant},
+    {op_add, add_of_difference},
+    {op_add, reassociate_constants},
+    {op_mul, reassociate_constants},
+    {op_shl, combine_shifts},
+    {op_sar, combine_shifts},
+};
+
+bool is_combined_type(instruction_type type) {
+  return std::any_of(std::begin(combine_rules), std::end(combine_rules),
+                     [type](const combine_rule& rule) { return rule.type == type; });
+}
+}  // namespace
+
+void combine_instructions(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  combine_instructions(i_vec, table, analyses, stats);
+}
+
+void combine_instructions(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                          optimization_stats& stats) {
+  const auto& graph = analyses.blocks();
+  if (graph.blocks.empty()) {
+    return;
+  }
+  const auto& universe = analyses.universe();
+  std::vector<int> def_positions;
+  const auto strict =
+      find_strict_variables(i_vec, graph, analyses.dominators(), universe, def_positions);
+  const combine_context context{universe, strict, def_positions, i_vec};
+
+  std::vector<std::vector<int>> users(universe.size());
+  std::vector<std::string> args;
+  auto add_uses = [&](int i_index) {
+    args.clear();
+    instruction_uses(*i_vec[i_index], args);
+    for (const auto& arg : args) {
+      users[universe.find(arg)].push_back(i_index);
+    }
+  };
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    add_uses(i_index);
+  }
+
+  // every instruction is visited once, and again only after definition
+  // of its operand changed, so work stays linear in number of rewrites
+  std::vector<int> work_list;
+  std::vector<bool> queued(i_vec.size(), true);
+  for (int i_index = static_cast<int>(i_vec.size()) - 1; i_index >= 0; --i_index) {
+    work_list.push_back(i_index);
+  }
+  auto enqueue = [&](int i_index) {
+    if (!queued[i_index]) {
+      queued[i_index] = true;
+      work_list.push_back(i_index);
+    }
+  };
+  while (!work_list.empty()) {
+    auto i_index = work_list.back();
+    work_list.pop_back();
+    queued[i_index] = false;
+    if (!is_combined_type(i_vec[i_index]->type)) {
+      continue;
+    }
+    const auto& op = static_cast<const three_addr_instruction&>(*i_vec[i_index]);
+    for (const auto& rule : combine_rules) {
+      if (rule.type != op.type) {
+        continue;
+      }
+      auto replacement = rule.apply(op, context);
+      if (replacement == nullptr) {
+        continue;
+      }
+      auto dest = universe.find(op.arg_1);
+      i_vec[i_index] = std::move(replacement);
+      ++stats.combined_instructions;
+      add_uses(i_index);
+      enqueue(i_index);
+      for (auto user : users[dest]) {
+        enqueue(user);
+      }
+      break;
+    }
+  }
+}
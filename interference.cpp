@@ -0,0 +1,283 @@
+#include "yadfa.h"
+
+interference_graph::interference_graph(size_t nodes)
+    : use_matrix(nodes <= interference_matrix_limit), degrees(nodes, 0) {
+  if (use_matrix) {
+    matrix.assign(bit_vector_words(nodes * (nodes - 1) / 2 + 1), 0);
+  } else {
+    adjacency.resize(nodes);
+  }
+}
+
+size_t interference_graph::matrix_index(int a, int b) const {
+  if (a < b) {
+    std::swap(a, b);
+  }
+  // lower triangle without diagonal
+  return static_cast<size_t>(a) * (a - 1) / 2 + b;
+}
+
+void interference_graph::add_edge(int a, int b) {
+  if (a == b || interfere(a, b)) {
+    return;
+  }
+  if (use_matrix) {
+    set_bit(matrix, matrix_index(a, b));
+  } else {
+    adjacency[a].insert(std::lower_bound(adjacency[a].begin(), adjacency[a].end(), b), b);
+    adjacency[b].insert(std::lower_bound(adjacency[b].begin(), adjacency[b].end(), a), a);
+  }
+  ++degrees[a];
+  ++degrees[b];
+}
+
+void interference_graph::remove_edge(int a, int b) {
+  if (a == b || !interfere(a, b)) {
+    return;
+  }
+  if (use_matrix) {
+    clear_bit(matrix, matrix_index(a, b));
+  } else {
+    adjacency[a].erase(std::lower_bound(adjacency[a].begin(), adjacency[a].end(), b));
+    adjacency[b].erase(std::lower_bound(adjacency[b].begin(), adjacency[b].end(), a));
+  }
+  --degrees[a];
+  --degrees[b];
+}
+
+bool interference_graph::interfere(int a, int b) const {
+  if (a == b) {
+    return false;
+  }
+  if (use_matrix) {
+    return test_bit(matrix, matrix_index(a, b));
+  }
+  return std::binary_search(adjacency[a].begin(), adjacency[a].end(), b);
+}
+
+std::vector<int> interference_graph::neighbours(int node) const {
+  if (!use_matrix) {
+    return adjacency[node];
+  }
+  std::vector<int> result;
+  for (int other = 0; other != degrees.size(); ++other) {
+    if (interfere(node, other)) {
+      result.push_back(other);
+    }
+  }
+  return result;
+}
+
+int interference_graph::merge(int a, int b) {
+  // edges of node with fewer neighbours move, so a chain of merges into one
+  // growing node moves each edge only a few times
+  auto into = degrees[a] >= degrees[b] ? a : b;
+  auto from = into == a ? b : a;
+  if (use_matrix) {
+    for (auto neighbour : neighbours(from)) {
+      remove_edge(from, neighbour);
+      add_edge(into, neighbour);
+    }
+    return into;
+  }
+  for (auto neighbour : adjacency[from]) {
+    auto& edges = adjacency[neighbour];
+    edges.erase(std::lower_bound(edges.begin(), edges.end(), from));
+    auto position = std::lower_bound(edges.begin(), edges.end(), into);
+    if (position != edges.end() && *position == into) {
+      // neighbour of both loses one edge
+      --degrees[neighbour];
+    } else {
+      edges.insert(position, into);
+    }
+  }
+  std::vector<int> merged;
+  merged.reserve(adjacency[into].size() + adjacency[from].size());
+  std::set_union(adjacency[into].begin(), adjacency[into].end(), adjacency[from].begin(),
+                 adjacency[from].end(), std::back_inserter(merged));
+  adjacency[into] = std::move(merged);
+  adjacency[from].clear();
+  degrees[into] = adjacency[into].size();
+  degrees[from] = 0;
+  return into;
+}
+
+interference_graph build_interference_graph(const instruction_vec& i_vec,
+                                            const block_graph& graph,
+                                            const variable_universe& universe,
+                                            const block_liveness& liveness) {
+  interference_graph interference(universe.size());
+  std::vector<std::string> uses;
+  std::vector<std::string> defs;
+  for (size_t b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    auto live = liveness.live_out[b_index];
+    for (int i_index = block.last; i_index >= block.first; --i_index) {
+      const auto& instr = i_vec[i_index];
+      uses.clear();
+      defs.clear();
+      instruction_uses(*instr, uses);
+      instruction_defs(*instr, defs);
+      // destination of copy holds the same value as its source
+      // so they don't interfere at this point
+      int copy_source = -1;
+      if (instr->type == op_mov && !uses.empty()) {
+        copy_source = universe.find(uses.front());
+      }
+      for (const auto& def : defs) {
+        auto def_index = universe.find(def);
+        for (size_t word = 0; word != live.size(); ++word) {
+          for (auto bits = live[word]; bits != 0; bits &= bits - 1) {
+            int var_index = word * bits_per_word + __builtin_ctzll(bits);
+            if (var_index != copy_source) {
+              interference.add_edge(def_index, var_index);
+            }
+          }
+        }
+        // all values defined together are alive at the same time
+        for (const auto& other_def : defs) {
+          interference.add_edge(def_index, universe.find(other_def));
+        }
+      }
+      for (const auto& def : defs) {
+        clear_bit(live, universe.find(def));
+      }
+      for (const auto& use : uses) {
+        set_bit(live, universe.find(use));
+      }
+    }
+  }
+  return interference;
+}
+
+namespace {
+int find_alias(std::vector<int>& aliases, int var_index) {
+  while (aliases[var_index] != var_index) {
+    aliases[var_index] = aliases[aliases[var_index]];
+    var_index = aliases[var_index];
+  }
+  return var_index;
+}
+
+// Briggs: merged node has fewer than K neighbours of significant degree
+bool briggs_test(const interference_graph& interference, int a, int b) {
+  size_t significant = 0;
+  const auto a_neighbours = interference.neighbours(a);
+  const auto b_neighbours = interference.neighbours(b);
+  std::vector<int> neighbours;
+  neighbours.reserve(a_neighbours.size() + b_neighbours.size());
+  std::set_union(a_neighbours.begin(), a_neighbours.end(), b_neighbours.begin(),
+                 b_neighbours.end(), std::back_inserter(neighbours));
+  for (auto neighbour : neighbours) {
+    auto degree = interference.degree(neighbour);
+    // neighbour of both loses one edge after merge
+    if (interference.interfere(neighbour, a) && interference.interfere(neighbour, b)) {
+      --degree;
+    }
+    if (degree >= coalescing_register_count && ++significant == coalescing_register_count) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// George: every neighbour of b already interferes with a or is insignificant
+bool george_test(const interference_graph& interference, int a, int b) {
+  for (auto neighbour : interference.neighbours(b)) {
+    if (!interference.interfere(neighbour, a) &&
+        interference.degree(neighbour) >= coalescing_register_count) {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+size_t coalesce_copies(instruction_vec& i_vec, label_table& table) {
+  analysis_manager analyses(i_vec, table);
+  return coalesce_copies(i_vec, table, analyses);
+}
+
+size_t coalesce_copies(instruction_vec& i_vec, label_table& table, analysis_manager& analyses) {
+  const auto& graph = analyses.blocks();
+  const auto& universe = analyses.universe();
+  const auto& liveness = analyses.liveness();
+  auto interference = build_interference_graph(i_vec, graph, universe, liveness);
+
+  // only variables declared here with the same type may share location
+  // function parameters and undeclared names are left alone
+  std::vector<std::string> declared_types(universe.size());
+  for (const auto& instr : i_vec) {
+    if (instr->type == op_var) {
+      auto decl = static_cast<binary_instruction*>(instr.get());
+      auto var_index = universe.find(decl->arg_1);
+      declared_types[var_index] = decl->arg_2;
+    }
+  }
+
+  std::vector<int> aliases(universe.size());
+  for (size_t var_index = 0; var_index != aliases.size(); ++var_index) {
+    aliases[var_index] = var_index;
+  }
+  // copies run most often in profiled run are coalesced first, so they are
+  // not blocked by merges of colder ones
+  std::vector<size_t> copies;
+  for (size_t i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type == op_mov &&
+        !is_constant(static_cast<binary_instruction*>(i_vec[i_index].get())->arg_2)) {
+      copies.push_back(i_index);
+    }
+  }
+  std::stable_sort(copies.begin(), copies.end(), [&](size_t a, size_t b) {
+    return i_vec[a]->profile_count > i_vec[b]->profile_count;
+  });
+  std::vector<bool> erased(i_vec.size(), false);
+  size_t removed_copies = 0;
+  for (auto i_index : copies) {
+    auto copy = static_cast<binary_instruction*>(i_vec[i_index].get());
+    auto a = find_alias(aliases, universe.find(copy->arg_1));
+    auto b = find_alias(aliases, universe.find(copy->arg_2));
+    if (a != b) {
+      if (declared_types[a].empty() || declared_types[a] != declared_types[b] ||
+          interference.interfere(a, b)) {
+        continue;
+      }
+      // George test looks only at neighbours of its second node, so the node with
+      // fewer neighbours is tried first and a growing node is not scanned for every copy
+      auto fewer = interference.degree(a) <= interference.degree(b) ? a : b;
+      auto more = fewer == a ? b : a;
+      if (!george_test(interference, more, fewer) && !briggs_test(interference, a, b) &&
+          !george_test(interference, fewer, more)) {
+        continue;
+      }
+      auto kept = interference.merge(a, b);
+      aliases[a] = kept;
+      aliases[b] = kept;
+    }
+    erased[i_index] = true;
+    ++removed_copies;
+  }
+  if (removed_copies == 0) {
+    return 0;
+  }
+
+  auto rename = [&](std::string& arg) {
+    auto var_index = universe.find(arg);
+    if (var_index >= 0) {
+      arg = universe.names[find_alias(aliases, var_index)];
+    }
+  };
+  for (size_t i_index = 0; i_index != i_vec.size(); ++i_index) {
+    auto& instr = i_vec[i_index];
+    if (instr->type == op_var) {
+      // merged variable doesn't need its own location anymore
+      auto var_index = universe.find(static_cast<binary_instruction*>(instr.get())->arg_1);
+      erased[i_index] = find_alias(aliases, var_index) != var_index;
+      continue;
+    }
+    visit_use_operands(*instr, rename);
+    visit_def_operands(*instr, rename);
+  }
+  erase_instructions(i_vec, table, erased);
+  return removed_copies;
+}
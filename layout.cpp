@@ -0,0 +1,331 @@
+#include "yadfa.h"
+
+namespace {
+// successor of block which falls off the end or jumps past it
+constexpr int end_block = -1;
+
+instruction_type negated(instruction_type type) {
+  switch (type) {
+    case op_cmp_lt:
+      return op_cmp_gte;
+    case op_cmp_gte:
+      return op_cmp_lt;
+    case op_cmp_gt:
+      return op_cmp_lte;
+    case op_cmp_lte:
+      return op_cmp_gt;
+    case op_cmp_eq:
+      return op_cmp_neq;
+    default:
+      return op_cmp_eq;
+  }
+}
+
+bool is_comparison(instruction_type type) {
+  return type == op_cmp_eq || type == op_cmp_neq || type == op_cmp_gt || type == op_cmp_lt ||
+         type == op_cmp_lte || type == op_cmp_gte;
+}
+
+struct edge {
+  int64_t weight = 0;
+  int from = 0;
+  int to = 0;
+};
+
+// labels in front of block are jump targets of it and move with it, so blocks
+// made only of labels are empty and stand for block after them
+class block_layout {
+ public:
+  block_layout(const instruction_vec& i_vec, const label_table& table, const block_graph& graph);
+
+  // false when program has no profile
+  bool estimate_counts();
+  std::vector<edge> edges() const;
+  // block reached when block falls through and when its jmp or if jumps
+  int falls_to(int b_index) const;
+  int jumps_to(int b_index) const;
+  bool empty(int b_index) const { return begins[b_index] == begins[b_index + 1]; }
+
+  std::vector<int64_t> counts;
+  // first instruction of each block with its labels, the last one starts
+  // labels which end program
+  std::vector<int> begins;
+
+ private:
+  // non empty block at or after b_index
+  int resolve(int b_index) const;
+
+  const instruction_vec& i_vec;
+  const label_table& table;
+  const block_graph& graph;
+};
+
+block_layout::block_layout(const instruction_vec& i_vec, const label_table& table,
+                           const block_graph& graph)
+    : counts(graph.blocks.size(), -1),
+      begins(graph.blocks.size() + 1, 0),
+      i_vec(i_vec),
+      table(table),
+      graph(graph) {
+  for (size_t b_index = 1; b_index <= graph.blocks.size(); ++b_index) {
+    begins[b_index] =
+        b_index == graph.blocks.size() ? i_vec.size() : graph.blocks[b_index].first;
+    while (begins[b_index] > 0 && i_vec[begins[b_index] - 1]->type == op_label) {
+      --begins[b_index];
+    }
+  }
+}
+
+bool block_layout::estimate_counts() {
+  bool profiled = false;
+  for (size_t b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      counts[b_index] = std::max(counts[b_index], i_vec[i_index]->profile_count);
+    }
+    profiled = profiled || counts[b_index] >= 0;
+  }
+  if (!profiled) {
+    return false;
+  }
+  // blocks made by passes, such as those of copies on edges, are entered
+  // as often as their hottest predecessor leads to them
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    if (counts[b_index] >= 0 || empty(b_index)) {
+      continue;
+    }
+    counts[b_index] = 0;
+    for (const auto& e : edges()) {
+      if (e.to == b_index) {
+        counts[b_index] = std::max(counts[b_index], e.weight);
+      }
+    }
+  }
+  return true;
+}
+
+int block_layout::resolve(int b_index) const {
+  while (b_index < graph.blocks.size() && empty(b_index)) {
+    ++b_index;
+  }
+  return b_index < graph.blocks.size() ? b_index : end_block;
+}
+
+int block_layout::falls_to(int b_index) const { return resolve(b_index + 1); }
+
+int block_layout::jumps_to(int b_index) const {
+  const auto& instr = *i_vec[graph.blocks[b_index].last];
+  const auto& label = instr.type == op_jmp ? static_cast<const unary_instruction&>(instr).arg_1
+                                           : static_cast<const binary_instruction&>(instr).arg_2;
+  auto target = table.instance.at(label);
+  return target < i_vec.size() ? resolve(graph.instruction_block[target]) : end_block;
+}
+
+// edges of blocks with unknown count weigh nothing
+std::vector<edge> block_layout::edges() const {
+  std::vector<edge> result;
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    if (empty(b_index)) {
+      continue;
+    }
+    auto count = std::max<int64_t>(counts[b_index], 0);
+    const auto& last = *i_vec[graph.blocks[b_index].last];
+    if (last.type == op_jmp) {
+      result.push_back({count, b_index, jumps_to(b_index)});
+    } else if (last.type == op_if) {
+      // copies of ifs made by passes may run less often than the one profiled
+      auto taken = last.profile_taken >= 0 ? std::min(last.profile_taken, count) : count / 2;
+      result.push_back({taken, b_index, jumps_to(b_index)});
+      result.push_back({count - taken, b_index, falls_to(b_index)});
+    } else {
+      result.push_back({count, b_index, falls_to(b_index)});
+    }
+  }
+  return result;
+}
+
+// condition of if ending block is comparison made in it for nothing else,
+// returns its index or -1
+int invertible_condition(const instruction_vec& i_vec, const basic_block& block) {
+  const auto& condition = static_cast<const binary_instruction&>(*i_vec[block.last]).arg_1;
+  int def = -1;
+  std::vector<std::string> args;
+  for (int i_index = block.last - 1; def < 0 && i_index >= block.first; --i_index) {
+    args.clear();
+    instruction_defs(*i_vec[i_index], args);
+    if (std::find(args.begin(), args.end(), condition) != args.end()) {
+      def = i_index;
+    }
+  }
+  if (def < 0 || !is_comparison(i_vec[def]->type)) {
+    return -1;
+  }
+  size_t uses = 0;
+  for (const auto& instr : i_vec) {
+    args.clear();
+    instruction_uses(*instr, args);
+    uses += std::count(args.begin(), args.end(), condition);
+  }
+  return uses == 1 ? def : -1;
+}
+}  // namespace
+
+void layout_blocks(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  layout_blocks(i_vec, table, analyses, stats);
+}
+
+void layout_blocks(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                   optimization_stats& stats) {
+  const auto& graph = analyses.blocks();
+  const int size = graph.blocks.size();
+  if (size < 2) {
+    return;
+  }
+  // relative jumps would need new offsets
+  for (const auto& instr : i_vec) {
+    if (instr->type != op_jmp && instr->type != op_if) {
+      continue;
+    }
+    const auto& target = instr->type == op_jmp ? static_cast<unary_instruction&>(*instr).arg_1
+                                               : static_cast<binary_instruction&>(*instr).arg_2;
+    if (table.instance.find(target) == table.instance.end()) {
+      return;
+    }
+  }
+  block_layout layout(i_vec, table, graph);
+  if (!layout.estimate_counts()) {
+    return;
+  }
+  const int entry = layout.falls_to(-1);
+  // ret ends function only as its last instruction, so its block stays last
+  const int last_block = i_vec.back()->type == op_ret ? size - 1 : end_block;
+
+  // chains grow along edges from the heaviest one, original fall throughs win ties
+  auto edges = layout.edges();
+  auto falls_through = [&](const edge& e) { return e.to == layout.falls_to(e.from); };
+  std::stable_sort(edges.begin(), edges.end(), [&](const edge& a, const edge& b) {
+    return a.weight > b.weight || (a.weight == b.weight && falls_through(a) && !falls_through(b));
+  });
+  std::vector<std::vector<int>> chains(size);
+  std::vector<int> chain_of(size);
+  for (int b_index = 0; b_index != size; ++b_index) {
+    if (!layout.empty(b_index)) {
+      chains[b_index].push_back(b_index);
+    }
+    chain_of[b_index] = b_index;
+  }
+  for (const auto& e : edges) {
+    if (e.to == entry || e.to == end_block || e.from == last_block || e.to == last_block) {
+      continue;
+    }
+    auto& from = chains[chain_of[e.from]];
+    auto& to = chains[chain_of[e.to]];
+    if (&from == &to || from.back() != e.from || to.front() != e.to) {
+      continue;
+    }
+    for (auto b_index : to) {
+      chain_of[b_index] = chain_of[e.from];
+    }
+    from.insert(from.end(), to.begin(), to.end());
+    to.clear();
+  }
+  // entry goes first, then chains which ran in order of program, then cold ones
+  std::vector<int> heads;
+  for (int b_index = 0; b_index != size; ++b_index) {
+    if (!chains[b_index].empty() && b_index != entry && b_index != last_block) {
+      heads.push_back(b_index);
+    }
+  }
+  auto hot = [&](int head) {
+    return std::any_of(chains[head].begin(), chains[head].end(),
+                       [&](int b_index) { return layout.counts[b_index] > 0; });
+  };
+  std::stable_partition(heads.begin(), heads.end(), hot);
+  heads.insert(heads.begin(), entry);
+  if (last_block != end_block) {
+    heads.push_back(last_block);
+  }
+  std::vector<int> order;
+  for (auto head : heads) {
+    order.insert(order.end(), chains[head].begin(), chains[head].end());
+  }
+  if (std::is_sorted(order.begin(), order.end())) {
+    return;
+  }
+
+  const auto& begins = layout.begins;
+  std::vector<std::string> new_labels(size);
+  std::string end_label;
+  // label of first instruction of block, made when block has none
+  auto label_of = [&](int b_index) -> std::string {
+    auto begin = b_index == end_block ? begins[size] : begins[b_index];
+    int first = b_index == end_block ? i_vec.size() : graph.blocks[b_index].first;
+    if (first > begin) {
+      return static_cast<const unary_instruction&>(*i_vec[first - 1]).arg_1;
+    }
+    auto& label = b_index == end_block ? end_label : new_labels[b_index];
+    if (label.empty()) {
+      label = fresh_label(table, "layout_");
+    }
+    return label;
+  };
+  std::vector<bool> erased(i_vec.size(), false);
+  std::vector<std::string> fixups(size);
+  for (size_t position = 0; position != order.size(); ++position) {
+    auto b_index = order[position];
+    auto next = position + 1 < order.size() ? order[position + 1] : end_block;
+    const auto& block = graph.blocks[b_index];
+    auto& last = *i_vec[block.last];
+    if (last.type == op_jmp) {
+      erased[block.last] = layout.jumps_to(b_index) == next;
+      continue;
+    }
+    auto falls_to = layout.falls_to(b_index);
+    if (falls_to == next) {
+      continue;
+    }
+    int condition = -1;
+    if (last.type == op_if && layout.jumps_to(b_index) == next &&
+        (condition = invertible_condition(i_vec, block)) >= 0) {
+      // hot successor is reached by falling through
+      i_vec[condition]->type = negated(i_vec[condition]->type);
+      static_cast<binary_instruction&>(last).arg_2 = label_of(falls_to);
+      if (last.profile_taken >= 0 && last.profile_count >= last.profile_taken) {
+        last.profile_taken = last.profile_count - last.profile_taken;
+      }
+      continue;
+    }
+    fixups[b_index] = label_of(falls_to);
+  }
+
+  instruction_vec result;
+  auto move_range = [&](int from, int to) {
+    for (int i_index = from; i_index != to; ++i_index) {
+      if (!erased[i_index]) {
+        result.push_back(std::move(i_vec[i_index]));
+      }
+    }
+  };
+  for (auto b_index : order) {
+    if (!new_labels[b_index].empty()) {
+      result.push_back(std::make_unique<unary_instruction>(op_label, new_labels[b_index]));
+    }
+    move_range(begins[b_index], begins[b_index + 1]);
+    if (!fixups[b_index].empty()) {
+      result.push_back(std::make_unique<unary_instruction>(op_jmp, fixups[b_index]));
+    }
+  }
+  if (!end_label.empty()) {
+    result.push_back(std::make_unique<unary_instruction>(op_label, end_label));
+  }
+  move_range(begins[size], i_vec.size());
+  auto sorted = order;
+  std::sort(sorted.begin(), sorted.end());
+  for (size_t position = 0; position != order.size(); ++position) {
+    stats.moved_blocks += order[position] != sorted[position];
+  }
+  i_vec = std::move(result);
+  update_label_table(i_vec, table);
+  analyses.invalidate();
+}
@@ -0,0 +1,173 @@
+#include "yadfa.h"
+
+namespace {
+bool is_hoistable(const instruction& instr) {
+  switch (instr.type) {
+    case op_mov:
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_shl:
+    case op_sar:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+      return true;
+    case op_div:
+    case op_udiv:
+      // quotient may only be computed early when it can not trap
+      return !may_trap(instr);
+    default:
+      return false;
+  }
+}
+
+// instructions of loop which compute the same value in every iteration
+// and may run once before it, in order they have to be executed
+std::vector<int> find_invariants(const instruction_vec& i_vec, const block_graph& graph,
+                                 const dominator_tree& tree, const variable_universe& universe,
+                                 const block_liveness& liveness, const natural_loop& loop) {
+  std::vector<bool> in_loop(graph.blocks.size(), false);
+  for (auto b_index : loop.blocks) {
+    in_loop[b_index] = true;
+  }
+  std::vector<int> loop_defs(universe.size(), 0);
+  std::vector<std::string> args;
+  for (auto b_index : loop.blocks) {
+    const auto& block = graph.blocks[b_index];
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      args.clear();
+      instruction_defs(*i_vec[i_index], args);
+      for (const auto& def : args) {
+        ++loop_defs[universe.find(def)];
+      }
+    }
+  }
+  // variable read after loop has to get its value from definition
+  // which runs on every path to exit
+  std::vector<int> exits;
+  std::vector<int> exit_targets;
+  for (auto b_index : loop.blocks) {
+    for (auto succ : graph.blocks[b_index].successors) {
+      if (!in_loop[succ]) {
+        exits.push_back(b_index);
+        exit_targets.push_back(succ);
+      }
+    }
+  }
+
+  std::vector<bool> hoisted_defs(universe.size(), false);
+  auto is_invariant_use = [&](const std::string& arg) {
+    auto var_index = universe.find(arg);
+    return loop_defs[var_index] == 0 || hoisted_defs[var_index];
+  };
+  std::vector<int> invariants;
+  std::vector<bool> taken(i_vec.size(), false);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto b_index : tree.reverse_postorder) {
+      if (!in_loop[b_index]) {
+        continue;
+      }
+      const auto& block = graph.blocks[b_index];
+      for (int i_index = block.first; i_index <= block.last; ++i_index) {
+        const auto& instr = *i_vec[i_index];
+        if (taken[i_index] || !is_hoistable(instr)) {
+          continue;
+        }
+        args.clear();
+        instruction_defs(instr, args);
+        auto dest = universe.find(args.front());
+        if (loop_defs[dest] != 1 || test_bit(liveness.live_in[loop.header], dest)) {
+          continue;
+        }
+        args.clear();
+        instruction_uses(instr, args);
+        if (!std::all_of(args.begin(), args.end(), is_invariant_use)) {
+          continue;
+        }
+        bool reaches_exits = true;
+        for (size_t exit_index = 0; exit_index != exits.size(); ++exit_index) {
+          if (test_bit(liveness.live_in[exit_targets[exit_index]], dest) &&
+              !tree.dominates(b_index, exits[exit_index])) {
+            reaches_exits = false;
+          }
+        }
+        if (!reaches_exits) {
+          continue;
+        }
+        taken[i_index] = true;
+        hoisted_defs[dest] = true;
+        invariants.push_back(i_index);
+        changed = true;
+      }
+    }
+  }
+  return invariants;
+}
+}  // namespace
+
+void hoist_loop_invariants(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  hoist_loop_invariants(i_vec, table, analyses, stats);
+}
+
+void hoist_loop_invariants(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                           optimization_stats& stats) {
+  // every round moves invariants of one loop, new preheader changes blocks of the others
+  for (size_t round = 0; round != i_vec.size(); ++round) {
+    const auto& graph = analyses.blocks();
+    const auto& tree = analyses.dominators();
+    const auto& universe = analyses.universe();
+    const auto& liveness = analyses.liveness();
+    bool hoisted = false;
+    for (const auto& loop : find_natural_loops(graph, tree)) {
+      const auto& header = graph.blocks[loop.header];
+      // back edge falling into header would run preheader again
+      bool has_fallthrough_latch = false;
+      for (auto latch : loop.latches) {
+        auto last_type = i_vec[graph.blocks[latch].last]->type;
+        has_fallthrough_latch = has_fallthrough_latch ||
+                                (last_type != op_jmp && last_type != op_if) ||
+                                (last_type == op_if && graph.blocks[latch].last + 1 == header.first);
+      }
+      if (has_fallthrough_latch) {
+        continue;
+      }
+      auto invariants = find_invariants(i_vec, graph, tree, universe, liveness, loop);
+      if (invariants.empty()) {
+        continue;
+      }
+
+      // preheader is placed right before header, entries jump or fall into it
+      // and back edges go to new label past it
+      instruction_edits edits;
+      for (auto i_index : invariants) {
+        edits.insert_before(header.first, std::move(i_vec[i_index]));
+        edits.erase(i_index);
+      }
+      auto body_label = fresh_label(table, "loop_body_");
+      edits.insert_before(header.first, std::make_unique<unary_instruction>(op_label, body_label));
+      for (auto latch : loop.latches) {
+        auto& instr = *i_vec[graph.blocks[latch].last];
+        if (instr.type == op_jmp) {
+          static_cast<unary_instruction&>(instr).arg_1 = body_label;
+        } else {
+          static_cast<binary_instruction&>(instr).arg_2 = body_label;
+        }
+      }
+      stats.hoisted_instructions += invariants.size();
+      apply_instruction_edits(i_vec, table, edits);
+      analyses.invalidate();
+      hoisted = true;
+      break;
+    }
+    if (!hoisted) {
+      return;
+    }
+  }
+}
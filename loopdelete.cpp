@@ -0,0 +1,160 @@
+#include "yadfa.h"
+
+namespace {
+// instructions whose only effect is value of their variable
+bool is_pure(const instruction& instr) {
+  switch (instr.type) {
+    case op_var:
+    case op_mov:
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_shl:
+    case op_sar:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+    case op_phi:
+    case op_jmp:
+    case op_if:
+    case op_label:
+    case op_nop:
+      return true;
+    case op_div:
+    case op_udiv:
+      return !may_trap(instr);
+    default:
+      return false;
+  }
+}
+
+bool contains(const std::vector<int>& blocks, int b_index) {
+  return std::binary_search(blocks.begin(), blocks.end(), b_index);
+}
+
+// code which computes final values of variables used after loop, then leaves it,
+// false when loop can not be replaced
+bool replace_loop(const instruction_vec& i_vec, label_table& table, const block_graph& graph,
+                  const dominator_tree& tree, const scalar_evolution& evolution,
+                  const variable_universe& universe, const block_liveness& liveness, int loop,
+                  const std::function<std::string()>& make_temp, instruction_edits& edits) {
+  const auto& blocks = evolution.loops()[loop].blocks;
+  const auto* count = evolution.backedges(loop);
+  if (count == nullptr) {
+    return false;
+  }
+  std::map<std::string, int> def_blocks;
+  std::vector<std::string> args;
+  for (auto b_index : blocks) {
+    for (int i_index = graph.blocks[b_index].first; i_index <= graph.blocks[b_index].last;
+         ++i_index) {
+      if (!is_pure(*i_vec[i_index])) {
+        return false;
+      }
+      args.clear();
+      instruction_defs(*i_vec[i_index], args);
+      for (const auto& def : args) {
+        def_blocks[def] = b_index;
+      }
+    }
+  }
+  int exit = -1;
+  for (auto succ : graph.blocks[count->exit_block].successors) {
+    exit = contains(blocks, succ) ? exit : succ;
+  }
+  auto exit_first = graph.blocks[exit].first;
+  if (i_vec[exit_first]->type == op_phi) {
+    return false;
+  }
+  // values in last iteration, which stops at exit block, loop has no other exit
+  // so definitions used after it are live into exit block
+  std::set<std::string> live_out;
+  const auto& exit_live = liveness.live_in[exit];
+  for (const auto& def : def_blocks) {
+    if (!test_bit(exit_live, universe.find(def.first))) {
+      continue;
+    }
+    const auto* recurrence = evolution.recurrence(def.first);
+    if (recurrence == nullptr || recurrence->loop != loop ||
+        !tree.dominates(def.second, count->exit_block)) {
+      return false;
+    }
+    live_out.insert(def.first);
+  }
+  instruction_vec code;
+  auto trips = expand_trip_count(*count, make_temp, code);
+  for (const auto& name : live_out) {
+    if (!expand_recurrence(*evolution.recurrence(name), trips, name, make_temp, code)) {
+      return false;
+    }
+  }
+  std::string exit_label;
+  if (exit_first > 0 && i_vec[exit_first - 1]->type == op_label) {
+    exit_label = static_cast<const unary_instruction&>(*i_vec[exit_first - 1]).arg_1;
+  } else {
+    exit_label = fresh_label(table, "loop_exit_");
+    edits.insert_before(exit_first, std::make_unique<unary_instruction>(op_label, exit_label));
+  }
+  code.push_back(std::make_unique<unary_instruction>(op_jmp, exit_label));
+  const auto header_first = graph.blocks[evolution.loops()[loop].header].first;
+  for (auto& instr : code) {
+    edits.insert_before(header_first, std::move(instr));
+  }
+  // labels stay as jumps may still refer to them, declarations give slots
+  for (auto b_index : blocks) {
+    for (int i_index = graph.blocks[b_index].first; i_index <= graph.blocks[b_index].last;
+         ++i_index) {
+      if (i_vec[i_index]->type != op_label && i_vec[i_index]->type != op_var) {
+        edits.erase(i_index);
+      }
+    }
+  }
+  return true;
+}
+}  // namespace
+
+void delete_loops(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  delete_loops(i_vec, table, analyses, stats);
+}
+
+void delete_loops(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                  optimization_stats& stats) {
+  const auto& graph = analyses.blocks();
+  if (graph.blocks.empty()) {
+    return;
+  }
+  const auto& tree = analyses.dominators();
+  const auto& evolution = analyses.evolution();
+  const auto& universe = analyses.universe();
+  const auto& liveness = analyses.liveness();
+  size_t temp_counter = 0;
+  auto make_temp = [&]() {
+    std::string name;
+    do {
+      name = "scev_tmp_" + std::to_string(temp_counter++);
+    } while (universe.find(name) >= 0);
+    return name;
+  };
+  instruction_edits edits;
+  bool deleted = false;
+  const auto& loops = evolution.loops();
+  for (int loop = 0; loop != loops.size(); ++loop) {
+    // innermost loops only, so deleted loops do not overlap
+    bool innermost = true;
+    for (auto b_index : loops[loop].blocks) {
+      innermost = innermost && evolution.block_loops()[b_index] == loop;
+    }
+    if (innermost && replace_loop(i_vec, table, graph, tree, evolution, universe, liveness, loop,
+                                  make_temp, edits)) {
+      ++stats.deleted_loops;
+      deleted = true;
+    }
+  }
+  if (deleted) {
+    apply_instruction_edits(i_vec, table, edits);
+  }
+}
@@ -0,0 +1,335 @@
+#include "yadfa.h"
+
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+// form of program pass needs or leaves behind,
+// phis are introduced and removed by the manager as passes need
+enum class ir_form { any, ssa, normal };
+
+struct pass_context {
+  // whole program, function bodies included
+  const instruction_vec& program;
+  label_table& table;
+  const function_summary_map& summaries;
+  optimization_stats& stats;
+  const unroll_options& unrolling;
+  // analyses of program pass runs on
+  analysis_manager* analyses = nullptr;
+  // function whose body pass runs on, null for main program
+  const function_instruction* function = nullptr;
+};
+
+// passes which rewrite instructions in place without touching branches or labels
+constexpr unsigned preserves_control_flow = analysis_cfg | analysis_blocks | analysis_dominators;
+
+struct registered_pass {
+  const char* name;
+  ir_form needs;
+  ir_form leaves;
+  // analyses still valid after pass changed program
+  unsigned preserves;
+  std::function<void(instruction_vec&, pass_context&)> run;
+};
+
+const std::vector<registered_pass>& registered_passes() {
+  static const std::vector<registered_pass> passes = {
+      {"calls", ir_form::any, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         simplify_calls(i_vec, context.table, context.summaries, context.stats);
+       }},
+      {"tailcalls", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         if (context.function != nullptr) {
+           eliminate_tail_recursion(i_vec, context.table, context.function->args, context.stats);
+         }
+       }},
+      {"inline", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         inline_calls(i_vec, context.table, context.program, *context.analyses, context.stats);
+       }},
+      {"heap2stack", ir_form::any, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         promote_allocations(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"stack", ir_form::any, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         replace_stack_operations(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"ssa", ir_form::normal, ir_form::ssa, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         construct_ssa(i_vec, context.table,
+                       context.function != nullptr ? parameter_types(context.function->args)
+                                                   : parameter_vec());
+       }},
+      {"out-of-ssa", ir_form::ssa, ir_form::normal, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) { destruct_ssa(i_vec, context.table); }},
+      {"ranges", ir_form::ssa, ir_form::any, preserves_control_flow,
+       [](instruction_vec& i_vec, pass_context& context) {
+         simplify_by_value_ranges(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"sccp", ir_form::ssa, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         propagate_constants(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"instcombine", ir_form::ssa, ir_form::any, preserves_control_flow,
+       [](instruction_vec& i_vec, pass_context& context) {
+         combine_instructions(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"strength", ir_form::any, ir_form::any, preserves_control_flow,
+       [](instruction_vec& i_vec, pass_context& context) {
+         reduce_strength(i_vec, context.table, context.stats);
+       }},
+      {"gvn", ir_form::ssa, ir_form::any, preserves_control_flow,
+       [](instruction_vec& i_vec, pass_context& context) {
+         number_values(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"dce", ir_form::any, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         eliminate_dead_code(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"pre", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         eliminate_partial_redundancies(i_vec, context.table, context.stats);
+       }},
+      {"licm", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         hoist_loop_invariants(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"loopdelete", ir_form::ssa, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         delete_loops(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"indvars", ir_form::ssa, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         simplify_induction_variables(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"unroll", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         unroll_loops(i_vec, context.table, *context.analyses, context.unrolling, context.stats);
+       }},
+      {"simplifycfg", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         simplify_control_flow(i_vec, context.table, *context.analyses, context.stats);
+       }},
+      {"coalesce", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         context.stats.removed_copies += coalesce_copies(i_vec, context.table, *context.analyses);
+       }},
+      {"layout", ir_form::normal, ir_form::any, analysis_none,
+       [](instruction_vec& i_vec, pass_context& context) {
+         layout_blocks(i_vec, context.table, *context.analyses, context.stats);
+       }},
+  };
+  return passes;
+}
+
+const registered_pass* find_pass(const std::string& name) {
+  for (const auto& pass : registered_passes()) {
+    if (name == pass.name) {
+      return &pass;
+    }
+  }
+  return nullptr;
+}
+
+// pipeline element is single pass or group repeated until program stops changing
+struct pipeline_element {
+  const registered_pass* pass = nullptr;
+  std::vector<pipeline_element> group;
+};
+
+constexpr const char* fixpoint_prefix = "fixpoint(";
+
+// groups which do not settle are cut after that many rounds
+constexpr int fixpoint_round_limit = 8;
+
+std::vector<pipeline_element> parse_pipeline(const std::string& pipeline, size_t& position,
+                                             bool nested) {
+  std::vector<pipeline_element> elements;
+  while (position < pipeline.size()) {
+    if (pipeline[position] == ',') {
+      ++position;
+      continue;
+    }
+    if (pipeline[position] == ')') {
+      if (!nested) {
+        throw pass_pipeline_error("unexpected ) in pipeline : " + pipeline);
+      }
+      ++position;
+      return elements;
+    }
+    pipeline_element element;
+    if (pipeline.compare(position, std::strlen(fixpoint_prefix), fixpoint_prefix) == 0) {
+      position += std::strlen(fixpoint_prefix);
+      element.group = parse_pipeline(pipeline, position, true);
+    } else {
+      auto end = pipeline.find_first_of(",()", position);
+      auto name = pipeline.substr(position, end == std::string::npos ? end : end - position);
+      position = end == std::string::npos ? pipeline.size() : end;
+      element.pass = find_pass(name);
+      if (element.pass == nullptr) {
+        throw pass_pipeline_error("unknown pass : " + name);
+      }
+    }
+    elements.push_back(std::move(element));
+  }
+  if (nested) {
+    throw pass_pipeline_error("missing ) in pipeline : " + pipeline);
+  }
+  return elements;
+}
+
+// resident memory of process, 0 where /proc is not available
+long resident_kib() {
+  std::ifstream statm("/proc/self/statm");
+  long pages = 0;
+  long resident = 0;
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+size_t program_hash(const instruction_vec& i_vec) {
+  std::ostringstream out;
+  dump_program(i_vec, out);
+  return std::hash<std::string>()(out.str());
+}
+
+struct pipeline_runner {
+  pipeline_runner(pass_context& context, std::vector<pass_report>& reports)
+      : context(context), reports(reports) {}
+
+  void run_pass(const registered_pass& pass, instruction_vec& i_vec) {
+    auto report = std::find_if(reports.begin(), reports.end(),
+                               [&pass](const pass_report& r) { return r.name == pass.name; });
+    if (report == reports.end()) {
+      reports.push_back(pass_report{pass.name});
+      report = reports.end() - 1;
+    }
+    auto instructions_before = static_cast<long>(i_vec.size());
+    auto memory_before = resident_kib();
+    auto start = std::chrono::steady_clock::now();
+    auto computations_before = analysis_computations();
+    pass.run(i_vec, context);
+    context.analyses->invalidate(pass.preserves);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    ++report->runs;
+    report->analysis_computations += analysis_computations() - computations_before;
+    report->milliseconds += elapsed.count();
+    report->instruction_delta += static_cast<long>(i_vec.size()) - instructions_before;
+    report->memory_delta_kib += resident_kib() - memory_before;
+  }
+
+  // brings program to form pass works on
+  void convert(ir_form form, instruction_vec& i_vec) {
+    if (form == ir_form::ssa && !in_ssa) {
+      run_and_track(*find_pass("ssa"), i_vec);
+    } else if (form == ir_form::normal && in_ssa) {
+      run_and_track(*find_pass("out-of-ssa"), i_vec);
+    }
+  }
+
+  void run_and_track(const registered_pass& pass, instruction_vec& i_vec) {
+    run_pass(pass, i_vec);
+    if (pass.leaves != ir_form::any) {
+      in_ssa = pass.leaves == ir_form::ssa;
+    }
+  }
+
+  void run(const std::vector<pipeline_element>& elements, instruction_vec& i_vec) {
+    for (const auto& element : elements) {
+      if (element.pass != nullptr) {
+        convert(element.pass->needs, i_vec);
+        run_and_track(*element.pass, i_vec);
+        continue;
+      }
+      for (int round = 0; round != fixpoint_round_limit; ++round) {
+        auto before = program_hash(i_vec);
+        run(element.group, i_vec);
+        if (program_hash(i_vec) == before) {
+          break;
+        }
+      }
+    }
+  }
+
+  size_t analysis_computations() const {
+    size_t total = 0;
+    for (unsigned kind = 1; kind < analysis_all; kind <<= 1) {
+      total += context.analyses->computations(static_cast<analysis_kind>(kind));
+    }
+    return total;
+  }
+
+  void run_all(const std::vector<pipeline_element>& elements, instruction_vec& i_vec) {
+    analysis_manager analyses(i_vec, context.table);
+    context.analyses = &analyses;
+    in_ssa = false;
+    run(elements, i_vec);
+    // generated code has no phis
+    convert(ir_form::normal, i_vec);
+    context.analyses = nullptr;
+  }
+
+  pass_context& context;
+  std::vector<pass_report>& reports;
+  bool in_ssa = false;
+};
+}  // namespace
+
+std::string optimization_pipeline(int level) {
+  switch (level) {
+    case 0:
+      return "";
+    case 1:
+      return "calls,tailcalls,heap2stack,stack,sccp,instcombine,strength,dce,coalesce,"
+             "simplifycfg";
+    case 2:
+      return "calls,tailcalls,inline,heap2stack,stack,ranges,sccp,instcombine,strength,gvn,dce,"
+             "loopdelete,pre,licm,indvars,coalesce,dce,simplifycfg,unroll,sccp,instcombine,dce,"
+             "coalesce,simplifycfg,layout";
+    default:
+      return "calls,tailcalls,inline,heap2stack,stack,"
+             "fixpoint(ranges,sccp,instcombine,strength,gvn,dce,loopdelete),pre,licm,indvars,"
+             "coalesce,dce,simplifycfg,unroll,fixpoint(sccp,instcombine,gvn,dce),coalesce,"
+             "simplifycfg,layout";
+  }
+}
+
+std::vector<pass_report> run_passes(instruction_vec& program, label_table& table,
+                                    const builtin_functions_map& builtin_functions,
+                                    const std::string& pipeline, optimization_stats& stats,
+                                    const unroll_options& unrolling) {
+  size_t position = 0;
+  const auto elements = parse_pipeline(pipeline, position, false);
+  std::vector<pass_report> reports;
+  if (elements.empty()) {
+    return reports;
+  }
+  const auto summaries = summarize_functions(program, builtin_functions);
+  pass_context context{program, table, summaries, stats, unrolling};
+  pipeline_runner runner(context, reports);
+  for (auto& instr : program) {
+    if (instr->type == op_function) {
+      auto& function = static_cast<function_instruction&>(*instr);
+      context.function = &function;
+      runner.run_all(elements, function.body);
+    }
+  }
+  context.function = nullptr;
+  runner.run_all(elements, program);
+  return reports;
+}
+
+void dump_pass_reports(const std::vector<pass_report>& reports, std::ostream& out) {
+  for (const auto& report : reports) {
+    out << "pass " << report.name << " : runs " << report.runs << ", time " << report.milliseconds
+        << " ms, instructions " << std::showpos << report.instruction_delta << ", memory "
+        << report.memory_delta_kib << std::noshowpos << " KiB, analyses "
+        << report.analysis_computations << "\n";
+  }
+}
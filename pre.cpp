@@ -0,0 +1,343 @@
+#include "yadfa.h"
+
+namespace {
+bool is_movable_expression(const instruction& instr) {
+  switch (instr.type) {
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_shl:
+    case op_sar:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+      return true;
+    case op_div:
+    case op_udiv:
+      // insertion may run quotient earlier than any original, before effects it trapped after
+      return !may_trap(instr);
+    default:
+      return false;
+  }
+}
+
+using expression = std::tuple<instruction_type, std::string, std::string>;
+
+expression lexical_expression(const three_addr_instruction& instr) {
+  auto lhs = instr.arg_2;
+  auto rhs = instr.arg_3;
+  bool commutative = instr.type == op_add || instr.type == op_mul || instr.type == op_cmp_eq ||
+                     instr.type == op_cmp_neq;
+  if (commutative && rhs < lhs) {
+    std::swap(lhs, rhs);
+  }
+  return expression{instr.type, lhs, rhs};
+}
+
+void and_into(bit_vector& into, const bit_vector& from) {
+  for (size_t word = 0; word != into.size(); ++word) {
+    into[word] &= from[word];
+  }
+}
+}  // namespace
+
+void eliminate_partial_redundancies(instruction_vec& i_vec, label_table& table,
+                                    optimization_stats& stats) {
+  auto graph = build_basic_blocks(i_vec, build_cfg(i_vec, table));
+  if (graph.blocks.empty()) {
+    return;
+  }
+  if (!graph.blocks[0].predecessors.empty()) {
+    // computations inserted on entry must not run again on back edges
+    i_vec.insert(i_vec.begin(), std::make_unique<noarg_instruction>(op_nop));
+    update_label_table(i_vec, table);
+    graph = build_basic_blocks(i_vec, build_cfg(i_vec, table));
+  }
+  const int blocks = graph.blocks.size();
+
+  // lexically equal computations are one expression, killed by definition of any operand
+  std::map<expression, int> expression_indexes;
+  std::vector<int> instruction_expression(i_vec.size(), -1);
+  std::map<std::string, std::vector<int>> operand_expressions;
+  for (int i_index = 0; i_index < i_vec.size(); ++i_index) {
+    if (!is_movable_expression(*i_vec[i_index])) {
+      continue;
+    }
+    auto key = lexical_expression(static_cast<three_addr_instruction&>(*i_vec[i_index]));
+    auto inserted = expression_indexes.insert({key, expression_indexes.size()});
+    instruction_expression[i_index] = inserted.first->second;
+    if (inserted.second) {
+      for (const auto& arg : {std::get<1>(key), std::get<2>(key)}) {
+        if (!is_constant(arg)) {
+          operand_expressions[arg].push_back(inserted.first->second);
+        }
+      }
+    }
+  }
+  const size_t expressions = expression_indexes.size();
+  size_t edges = 1;
+  for (const auto& block : graph.blocks) {
+    edges += block.successors.size();
+  }
+  if (expressions == 0 || expressions * (blocks * 8 + edges) > lazy_code_motion_bits_limit) {
+    return;
+  }
+
+  // local properties
+  const size_t words = bit_vector_words(expressions);
+  const bit_vector empty(words, 0);
+  bit_vector full(words, ~uint64_t(0));
+  if (expressions % bits_per_word) {
+    full.back() = (uint64_t(1) << (expressions % bits_per_word)) - 1;
+  }
+  std::vector<bit_vector> antloc(blocks, empty);
+  std::vector<bit_vector> comp(blocks, empty);
+  std::vector<bit_vector> kill(blocks, empty);
+  std::vector<std::string> defs;
+  for (int b_index = 0; b_index != blocks; ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      auto expr = instruction_expression[i_index];
+      if (expr >= 0) {
+        if (!test_bit(kill[b_index], expr)) {
+          set_bit(antloc[b_index], expr);
+        }
+        set_bit(comp[b_index], expr);
+      }
+      defs.clear();
+      instruction_defs(*i_vec[i_index], defs);
+      for (const auto& def : defs) {
+        auto it = operand_expressions.find(def);
+        if (it == operand_expressions.end()) {
+          continue;
+        }
+        for (auto killed : it->second) {
+          set_bit(kill[b_index], killed);
+          clear_bit(comp[b_index], killed);
+        }
+      }
+    }
+  }
+
+  const auto tree = build_dominator_tree(graph);
+  const auto& order = tree.reverse_postorder;
+  bool changed = true;
+
+  // anticipated expressions, backward
+  std::vector<bit_vector> antin(blocks, full);
+  std::vector<bit_vector> antout(blocks, full);
+  while (changed) {
+    changed = false;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      auto b_index = *it;
+      const auto& block = graph.blocks[b_index];
+      bit_vector out = block.successors.empty() ? empty : full;
+      for (auto succ : block.successors) {
+        and_into(out, antin[succ]);
+      }
+      bit_vector in(words);
+      for (size_t word = 0; word != words; ++word) {
+        in[word] = antloc[b_index][word] | (~kill[b_index][word] & out[word]);
+      }
+      if (in != antin[b_index] || out != antout[b_index]) {
+        antin[b_index] = std::move(in);
+        antout[b_index] = std::move(out);
+        changed = true;
+      }
+    }
+  }
+
+  // available expressions, forward, nothing is available on entry
+  std::vector<bit_vector> avout(blocks, full);
+  changed = true;
+  while (changed) {
+    changed = false;
+    for (auto b_index : order) {
+      bit_vector in = b_index == 0 ? empty : full;
+      for (auto pred : graph.blocks[b_index].predecessors) {
+        and_into(in, avout[pred]);
+      }
+      bit_vector out(words);
+      for (size_t word = 0; word != words; ++word) {
+        out[word] = comp[b_index][word] | (~kill[b_index][word] & in[word]);
+      }
+      if (out != avout[b_index]) {
+        avout[b_index] = std::move(out);
+        changed = true;
+      }
+    }
+  }
+
+  // edges are numbered by position in successors of their source, entry edge is last
+  std::vector<size_t> first_edge(blocks + 1, 0);
+  for (int b_index = 0; b_index != blocks; ++b_index) {
+    first_edge[b_index + 1] = first_edge[b_index] + graph.blocks[b_index].successors.size();
+  }
+  const size_t entry_edge = first_edge[blocks];
+  std::vector<bit_vector> earliest(edges, empty);
+  earliest[entry_edge] = antin[0];
+  for (int b_index = 0; b_index != blocks; ++b_index) {
+    const auto& successors = graph.blocks[b_index].successors;
+    for (size_t succ_index = 0; succ_index != successors.size(); ++succ_index) {
+      auto& edge = earliest[first_edge[b_index] + succ_index];
+      for (size_t word = 0; word != words; ++word) {
+        edge[word] = antin[successors[succ_index]][word] & ~avout[b_index][word] &
+                     (kill[b_index][word] | ~antout[b_index][word]);
+      }
+    }
+  }
+
+  // Knoop, Ruething, Steffen "Lazy Code Motion", computation is delayed
+  // along edges as long as it is not used on the way
+  std::vector<bit_vector> later = earliest;
+  std::vector<bit_vector> laterin(blocks, full);
+  auto incoming_edges = [&](int b_index, const std::function<void(size_t)>& visitor) {
+    if (b_index == 0) {
+      visitor(entry_edge);
+    }
+    for (auto pred : graph.blocks[b_index].predecessors) {
+      // unreachable code neither delays nor receives computations
+      if (tree.dfs_in[pred] == -1) {
+        continue;
+      }
+      const auto& successors = graph.blocks[pred].successors;
+      auto succ_index = std::find(successors.begin(), successors.end(), b_index) - successors.begin();
+      visitor(first_edge[pred] + succ_index);
+    }
+  };
+  changed = true;
+  while (changed) {
+    changed = false;
+    for (auto b_index : order) {
+      bit_vector in = full;
+      incoming_edges(b_index, [&](size_t edge) { and_into(in, later[edge]); });
+      if (in != laterin[b_index]) {
+        laterin[b_index] = std::move(in);
+        changed = true;
+      }
+      const auto& successors = graph.blocks[b_index].successors;
+      for (size_t succ_index = 0; succ_index != successors.size(); ++succ_index) {
+        auto edge = first_edge[b_index] + succ_index;
+        for (size_t word = 0; word != words; ++word) {
+          later[edge][word] =
+              earliest[edge][word] | (laterin[b_index][word] & ~antloc[b_index][word]);
+        }
+      }
+    }
+  }
+
+  std::vector<bit_vector> deletes(blocks, empty);
+  bit_vector moved(words, 0);
+  for (auto b_index : order) {
+    for (size_t word = 0; word != words; ++word) {
+      deletes[b_index][word] = antloc[b_index][word] & ~laterin[b_index][word];
+      moved[word] |= deletes[b_index][word];
+    }
+  }
+  if (moved == empty) {
+    return;
+  }
+
+  // every computation of moved expression saves its value to temporary,
+  // upward exposed computation in block with delete only reads it
+  std::map<std::string, std::string> types;
+  std::map<std::string, size_t> declarations;
+  for (size_t i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type == op_var) {
+      auto decl = static_cast<binary_instruction*>(i_vec[i_index].get());
+      types.insert({decl->arg_1, decl->arg_2});
+      declarations.insert({decl->arg_1, i_index});
+    }
+  }
+  const auto universe = build_variable_universe(i_vec);
+  instruction_edits edits;
+  std::vector<std::string> temps(expressions);
+  size_t temp_counter = 0;
+  auto temp_for = [&](int expr, const std::string& like) {
+    auto& temp = temps[expr];
+    if (temp.empty()) {
+      do {
+        temp = "pre_tmp_" + std::to_string(temp_counter++);
+      } while (universe.find(temp) >= 0);
+      auto type_it = types.find(like);
+      auto decl = std::make_unique<binary_instruction>(
+          op_var, temp, type_it == types.end() ? "int32" : type_it->second);
+      auto decl_it = declarations.find(like);
+      edits.insert_before(decl_it == declarations.end() ? 0 : decl_it->second, std::move(decl));
+    }
+    return temp;
+  };
+  for (auto b_index : order) {
+    const auto& block = graph.blocks[b_index];
+    bit_vector seen(words, 0);
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      auto expr = instruction_expression[i_index];
+      if (expr < 0 || !test_bit(moved, expr)) {
+        continue;
+      }
+      auto& instr = static_cast<three_addr_instruction&>(*i_vec[i_index]);
+      auto temp = temp_for(expr, instr.arg_1);
+      if (test_bit(deletes[b_index], expr) && !test_bit(seen, expr)) {
+        set_bit(seen, expr);
+        i_vec[i_index] = std::make_unique<binary_instruction>(op_mov, instr.arg_1, temp);
+        ++stats.partially_redundant_expressions;
+        continue;
+      }
+      set_bit(seen, expr);
+      edits.insert_after(i_index, std::make_unique<binary_instruction>(op_mov, instr.arg_1, temp));
+      instr.arg_1 = temp;
+    }
+  }
+
+  // computations on edges, as late as possible
+  std::vector<const expression*> expression_keys(expressions);
+  for (const auto& entry : expression_indexes) {
+    expression_keys[entry.second] = &entry.first;
+  }
+  auto edge_computations = [&](size_t edge, int to) {
+    instruction_vec computations;
+    for (size_t expr = 0; expr != expressions; ++expr) {
+      if (test_bit(moved, expr) && test_bit(later[edge], expr) && !test_bit(laterin[to], expr)) {
+        const auto& key = *expression_keys[expr];
+        computations.push_back(std::make_unique<three_addr_instruction>(
+            std::get<0>(key), temps[expr], std::get<1>(key), std::get<2>(key)));
+      }
+    }
+    return computations;
+  };
+  auto append = [](instruction_vec& group, instruction_vec computations) {
+    for (auto& instr : computations) {
+      group.push_back(std::move(instr));
+    }
+  };
+  append(edits.before[0], edge_computations(entry_edge, 0));
+  for (auto b_index : order) {
+    const auto& block = graph.blocks[b_index];
+    for (size_t succ_index = 0; succ_index != block.successors.size(); ++succ_index) {
+      auto succ = block.successors[succ_index];
+      auto computations = edge_computations(first_edge[b_index] + succ_index, succ);
+      if (computations.empty()) {
+        continue;
+      }
+      const auto last_type = i_vec[block.last]->type;
+      if (block.successors.size() == 1) {
+        if (last_type == op_jmp || last_type == op_if || last_type == op_label) {
+          append(edits.before[block.last], std::move(computations));
+        } else {
+          append(edits.after[block.last], std::move(computations));
+        }
+      } else if (graph.blocks[succ].predecessors.size() == 1) {
+        append(edits.before[graph.blocks[succ].first], std::move(computations));
+      } else if (graph.blocks[succ].first == block.last + 1) {
+        // fall through edge of if
+        append(edits.after[block.last], std::move(computations));
+      } else {
+        insert_on_taken_edge(i_vec, table, edits, block.last, std::move(computations), "pre_");
+      }
+    }
+  }
+  apply_instruction_edits(i_vec, table, edits);
+}
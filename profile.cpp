@@ -0,0 +1,205 @@
+#include "yadfa.h"
+
+namespace {
+const std::string block_counter = "profile_block";
+const std::string branch_counter = "profile_branch";
+
+// counters of all instrumented bodies, those of one body are consecutive
+std::vector<block_counts> counters;
+std::vector<std::pair<std::string, size_t>> instrumented_bodies;
+
+enum class edge_kind { entered, taken, not_taken };
+
+struct counter_edge {
+  size_t counter = 0;
+  edge_kind kind = edge_kind::entered;
+};
+
+// blocks which only pass control on get no counting call, so calls before them
+// stay in tail position, they are entered as often as edges to them are taken
+std::map<size_t, std::vector<counter_edge>> derived_counters;
+
+bool passes_control(const instruction_vec& i_vec, const basic_block& block) {
+  return std::all_of(i_vec.begin() + block.first, i_vec.begin() + block.last + 1,
+                     [](const instruction_ptr& instr) {
+                       return instr->type == op_label || instr->type == op_nop ||
+                              instr->type == op_jmp || instr->type == op_ret;
+                     });
+}
+
+uint64_t entries(size_t counter, std::set<size_t>& visiting) {
+  auto derived = derived_counters.find(counter);
+  if (derived == derived_counters.end()) {
+    return counters[counter].entries;
+  }
+  // blocks jumping to each other forever are never entered
+  if (!visiting.insert(counter).second) {
+    return 0;
+  }
+  uint64_t sum = 0;
+  for (const auto& edge : derived->second) {
+    auto from = entries(edge.counter, visiting);
+    const auto& taken = counters[edge.counter].taken;
+    sum += edge.kind == edge_kind::taken       ? taken
+           : edge.kind == edge_kind::not_taken ? from - taken
+                                               : from;
+  }
+  visiting.erase(counter);
+  return sum;
+}
+
+extern "C" {
+void builtin_profile_block(int32_t counter) { ++counters[counter].entries; }
+
+// if jumps only for positive condition
+void builtin_profile_branch(int32_t counter, int32_t condition) {
+  counters[counter].taken += condition > 0;
+}
+}
+
+void instrument_body(instruction_vec& i_vec, label_table& table, const std::string& name) {
+  analysis_manager analyses(i_vec, table);
+  const auto& graph = analyses.blocks();
+  instrumented_bodies.push_back({name, graph.blocks.size()});
+  const auto base = counters.size();
+  counters.resize(base + graph.blocks.size());
+  instruction_edits edits;
+  for (size_t b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    if (b_index != 0 && passes_control(i_vec, block)) {
+      auto& edges = derived_counters[base + b_index];
+      for (auto pred : block.predecessors) {
+        auto last = graph.blocks[pred].last;
+        if (i_vec[last]->type != op_if) {
+          edges.push_back({base + pred, edge_kind::entered});
+          continue;
+        }
+        if (graph.instruction_block[branch_target(i_vec, table, last)] == b_index) {
+          edges.push_back({base + pred, edge_kind::taken});
+        }
+        if (pred + 1 == b_index) {
+          edges.push_back({base + pred, edge_kind::not_taken});
+        }
+      }
+      continue;
+    }
+    auto counter = std::to_string(base + b_index);
+    std::vector<std::string> args = {block_counter, counter};
+    edits.insert_before(block.first, std::make_unique<call_instruction>(op_call, args));
+    if (i_vec[block.last]->type == op_if) {
+      args = {branch_counter, counter,
+              static_cast<const binary_instruction&>(*i_vec[block.last]).arg_1};
+      edits.insert_before(block.last, std::make_unique<call_instruction>(op_call, args));
+    }
+  }
+  if (!edits.empty()) {
+    apply_instruction_edits(i_vec, table, edits);
+  }
+}
+
+void annotate_body(instruction_vec& i_vec, const label_table& table, const std::string& name,
+                   const execution_profile& profile) {
+  auto counts = profile.find(name);
+  analysis_manager analyses(i_vec, table);
+  const auto& graph = analyses.blocks();
+  if (counts == profile.end() || counts->second.size() != graph.blocks.size()) {
+    throw profile_error("profile does not match " +
+                        (name.empty() ? std::string("program") : "function " + name));
+  }
+  for (size_t b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    const auto& count = counts->second[b_index];
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      i_vec[i_index]->profile_count = count.entries;
+    }
+    if (i_vec[block.last]->type == op_if) {
+      i_vec[block.last]->profile_taken = count.taken;
+    }
+  }
+}
+}  // namespace
+
+void instrument_program(instruction_vec& program, label_table& table,
+                        builtin_functions_map& builtin_functions) {
+  counters.clear();
+  instrumented_bodies.clear();
+  derived_counters.clear();
+  for (auto& instr : program) {
+    if (instr->type == op_function) {
+      auto function = static_cast<function_instruction*>(instr.get());
+      const auto& name = function->args.front();
+      if (name == block_counter || name == branch_counter) {
+        throw profile_error("function " + name + " is reserved for profiling");
+      }
+      instrument_body(function->body, table, name);
+    }
+  }
+  instrument_body(program, table, "");
+  builtin_functions[block_counter] =
+      builtin_function{(void*)builtin_profile_block, {type_int32}, effect_io};
+  builtin_functions[branch_counter] =
+      builtin_function{(void*)builtin_profile_branch, {type_int32, type_int32}, effect_io};
+}
+
+execution_profile collected_profile() {
+  execution_profile profile;
+  size_t counter = 0;
+  for (const auto& body : instrumented_bodies) {
+    auto& blocks = profile[body.first];
+    for (size_t b_index = 0; b_index != body.second; ++b_index, ++counter) {
+      std::set<size_t> visiting;
+      blocks.push_back({entries(counter, visiting), counters[counter].taken});
+    }
+  }
+  return profile;
+}
+
+void write_profile(const execution_profile& profile, std::ostream& out) {
+  for (const auto& body : profile) {
+    if (body.first.empty()) {
+      out << "program";
+    } else {
+      out << "function " << body.first;
+    }
+    out << ' ' << body.second.size() << '\n';
+    for (const auto& counts : body.second) {
+      out << counts.entries << ' ' << counts.taken << '\n';
+    }
+  }
+}
+
+execution_profile read_profile(std::istream& in) {
+  execution_profile profile;
+  std::string kind;
+  while (in >> kind) {
+    std::string name;
+    if (kind == "function" && !(in >> name)) {
+      throw profile_error("profile misses name of function");
+    } else if (kind != "function" && kind != "program") {
+      throw profile_error("unknown profile entry " + kind);
+    }
+    size_t size = 0;
+    if (!(in >> size)) {
+      throw profile_error("profile misses number of blocks");
+    }
+    auto& blocks = profile[name];
+    blocks.resize(size);
+    for (auto& counts : blocks) {
+      if (!(in >> counts.entries >> counts.taken) || counts.taken > counts.entries) {
+        throw profile_error("malformed profile counts");
+      }
+    }
+  }
+  return profile;
+}
+
+void annotate_program(instruction_vec& program, const label_table& table,
+                      const execution_profile& profile) {
+  for (auto& instr : program) {
+    if (instr->type == op_function) {
+      auto function = static_cast<function_instruction*>(instr.get());
+      annotate_body(function->body, table, function->args.front(), profile);
+    }
+  }
+  annotate_body(program, table, "", profile);
+}
@@ -0,0 +1,499 @@
+#include "yadfa.h"
+
+namespace {
+const value_range full_range{INT32_MIN, INT32_MAX};
+
+// generated code wraps around, bounds out of 32 bits may be anything
+value_range bounded(int64_t lo, int64_t hi) {
+  if (lo < INT32_MIN || hi > INT32_MAX) {
+    return full_range;
+  }
+  return {lo, hi};
+}
+
+value_range join(const value_range& a, const value_range& b) {
+  if (a.is_empty()) {
+    return b;
+  }
+  if (b.is_empty()) {
+    return a;
+  }
+  return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+value_range intersect(const value_range& a, const value_range& b) {
+  return {std::max(a.lo, b.lo), std::min(a.hi, b.hi)};
+}
+
+value_range corners(const value_range& a, const value_range& b,
+                    const std::function<int64_t(int64_t, int64_t)>& op) {
+  int64_t values[] = {op(a.lo, b.lo), op(a.lo, b.hi), op(a.hi, b.lo), op(a.hi, b.hi)};
+  return bounded(*std::min_element(values, values + 4), *std::max_element(values, values + 4));
+}
+
+// quotient is monotone in both operands while divisor keeps its sign,
+// division by zero traps so zero is excluded from divisor
+value_range divide(const value_range& a, const value_range& b) {
+  auto quotient = [](int64_t x, int64_t y) { return x / y; };
+  value_range result;
+  auto negative = intersect(b, {INT32_MIN, -1});
+  if (!negative.is_empty()) {
+    result = join(result, corners(a, negative, quotient));
+  }
+  auto positive = intersect(b, {1, INT32_MAX});
+  if (!positive.is_empty()) {
+    result = join(result, corners(a, positive, quotient));
+  }
+  return result;
+}
+
+value_range compare(instruction_type type, const value_range& a, const value_range& b) {
+  const value_range always{1, 1};
+  const value_range never{0, 0};
+  switch (type) {
+    case op_cmp_eq:
+      if (a.lo == a.hi && b.lo == b.hi && a.lo == b.lo) {
+        return always;
+      }
+      return intersect(a, b).is_empty() ? never : value_range{0, 1};
+    case op_cmp_neq:
+      if (a.lo == a.hi && b.lo == b.hi && a.lo == b.lo) {
+        return never;
+      }
+      return intersect(a, b).is_empty() ? always : value_range{0, 1};
+    case op_cmp_lt:
+      return a.hi < b.lo ? always : a.lo >= b.hi ? never : value_range{0, 1};
+    case op_cmp_lte:
+      return a.hi <= b.lo ? always : a.lo > b.hi ? never : value_range{0, 1};
+    case op_cmp_gt:
+      return compare(op_cmp_lt, b, a);
+    case op_cmp_gte:
+      return compare(op_cmp_lte, b, a);
+    default:
+      return {0, 1};
+  }
+}
+
+value_range evaluate(instruction_type type, const value_range& a, const value_range& b) {
+  if (a.is_empty() || b.is_empty()) {
+    return {};
+  }
+  switch (type) {
+    case op_add:
+      return bounded(a.lo + b.lo, a.hi + b.hi);
+    case op_sub:
+      return bounded(a.lo - b.hi, a.hi - b.lo);
+    case op_mul:
+      return corners(a, b, [](int64_t x, int64_t y) { return x * y; });
+    case op_div:
+      return divide(a, b);
+    case op_udiv:
+      // both operands below 2^31 divide the same way signed and unsigned
+      if (a.lo >= 0 && b.lo >= 0) {
+        return divide(a, b);
+      }
+      return full_range;
+    case op_shl:
+      if (b.lo == b.hi && b.lo >= 0 && b.lo < 32) {
+        return corners(a, b, [](int64_t x, int64_t k) { return x * (int64_t(1) << k); });
+      }
+      return full_range;
+    case op_sar:
+      if (b.lo == b.hi && b.lo >= 0 && b.lo < 32) {
+        return {a.lo >> b.lo, a.hi >> b.lo};
+      }
+      return full_range;
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+      return compare(type, a, b);
+    default:
+      return full_range;
+  }
+}
+
+instruction_type negate(instruction_type type) {
+  switch (type) {
+    case op_cmp_eq:
+      return op_cmp_neq;
+    case op_cmp_neq:
+      return op_cmp_eq;
+    case op_cmp_lt:
+      return op_cmp_gte;
+    case op_cmp_gte:
+      return op_cmp_lt;
+    case op_cmp_gt:
+      return op_cmp_lte;
+    default:
+      return op_cmp_gt;
+  }
+}
+
+// a op b is the same as b swap(op) a
+instruction_type swap_operands(instruction_type type) {
+  switch (type) {
+    case op_cmp_lt:
+      return op_cmp_gt;
+    case op_cmp_gt:
+      return op_cmp_lt;
+    case op_cmp_lte:
+      return op_cmp_gte;
+    case op_cmp_gte:
+      return op_cmp_lte;
+    default:
+      return type;
+  }
+}
+
+bool is_comparison(instruction_type type) {
+  return type >= op_cmp_eq && type <= op_cmp_gte;
+}
+
+// values of x for which x op y may hold
+value_range restrict(instruction_type type, const value_range& x, const value_range& y) {
+  if (y.is_empty()) {
+    return x;
+  }
+  switch (type) {
+    case op_cmp_eq:
+      return intersect(x, y);
+    case op_cmp_neq:
+      if (y.lo == y.hi && x.lo == y.lo) {
+        return {x.lo + 1, x.hi};
+      }
+      if (y.lo == y.hi && x.hi == y.lo) {
+        return {x.lo, x.hi - 1};
+      }
+      return x;
+    case op_cmp_lt:
+      return intersect(x, {INT32_MIN, y.hi - 1});
+    case op_cmp_lte:
+      return intersect(x, {INT32_MIN, y.hi});
+    case op_cmp_gt:
+      return intersect(x, {y.lo + 1, INT32_MAX});
+    case op_cmp_gte:
+      return intersect(x, {y.lo, INT32_MAX});
+    default:
+      return x;
+  }
+}
+
+// walking up dominator tree for branch conditions stops after that many blocks
+constexpr int constraint_depth_limit = 32;
+
+// phis of loop header widen after that many changes, other definitions
+// are widened only in irreducible cycles, much later
+constexpr int header_widening_delay = 2;
+constexpr int widening_delay = 16;
+
+struct range_analysis {
+  range_analysis(const instruction_vec& i_vec, const label_table& table,
+                 const variable_universe& universe, const block_graph& graph,
+                 const dominator_tree& tree)
+      : i_vec(i_vec), table(table), universe(universe), graph(graph), tree(tree) {
+    if (graph.blocks.empty()) {
+      return;
+    }
+    strict = find_strict_variables(i_vec, graph, tree, universe, def_positions);
+    values.assign(universe.size(), full_range);
+    changes.assign(universe.size(), 0);
+    for (int var_index = 0; var_index != universe.size(); ++var_index) {
+      if (strict[var_index] && def_positions[var_index] != -1) {
+        values[var_index] = value_range();
+      }
+    }
+    loop_headers.assign(graph.blocks.size(), false);
+    for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+      for (auto pred : graph.blocks[b_index].predecessors) {
+        if (tree.dominates(b_index, pred)) {
+          loop_headers[b_index] = true;
+        }
+      }
+    }
+  }
+
+  value_range global_range(const std::string& arg) const {
+    if (is_constant(arg)) {
+      int64_t value = static_cast<int32_t>(std::stoll(arg));
+      return {value, value};
+    }
+    return values[universe.find(arg)];
+  }
+
+  bool is_stable(const std::string& arg) const {
+    return is_constant(arg) || strict[universe.find(arg)];
+  }
+
+  // narrows range of var by condition of if ending pred, known on edge to succ
+  value_range restrict_on_edge(int var_index, value_range range, int pred, int succ) const {
+    const auto& last = graph.blocks[pred].last;
+    if (i_vec[last]->type != op_if) {
+      return range;
+    }
+    auto target = branch_target(i_vec, table, last);
+    if (target < 0 || target >= i_vec.size() || last + 1 >= i_vec.size()) {
+      return range;
+    }
+    bool taken = graph.instruction_block[target] == succ;
+    bool falls_through = graph.instruction_block[last + 1] == succ;
+    if (taken == falls_through) {
+      return range;
+    }
+    auto condition = universe.find(static_cast<const binary_instruction&>(*i_vec[last]).arg_1);
+    if (condition < 0 || !strict[condition]) {
+      return range;
+    }
+    // if jumps when condition is greater than zero
+    if (condition == var_index) {
+      return restrict(taken ? op_cmp_gt : op_cmp_lte, range, {0, 0});
+    }
+    auto def_position = def_positions[condition];
+    if (def_position == -1 || !is_comparison(i_vec[def_position]->type)) {
+      return range;
+    }
+    const auto& cmp = static_cast<const three_addr_instruction&>(*i_vec[def_position]);
+    if (!is_stable(cmp.arg_2) || !is_stable(cmp.arg_3)) {
+      return range;
+    }
+    auto relation = taken ? cmp.type : negate(cmp.type);
+    if (!is_constant(cmp.arg_2) && universe.find(cmp.arg_2) == var_index) {
+      range = restrict(relation, range, global_range(cmp.arg_3));
+    }
+    if (!is_constant(cmp.arg_3) && universe.find(cmp.arg_3) == var_index) {
+      range = restrict(swap_operands(relation), range, global_range(cmp.arg_2));
+    }
+    return range;
+  }
+
+  // range of operand read in block, blocks entered only by edge of if
+  // know its condition, so do blocks they dominate
+  value_range operand_range(const std::string& arg, int b_index) const {
+    if (is_constant(arg)) {
+      return global_range(arg);
+    }
+    auto var_index = universe.find(arg);
+    auto range = values[var_index];
+    if (!strict[var_index] || range.is_empty()) {
+      return range;
+    }
+    for (int depth = 0; depth != constraint_depth_limit && b_index > 0; ++depth) {
+      const auto& preds = graph.blocks[b_index].predecessors;
+      auto idom = tree.idom[b_index];
+      if (idom < 0) {
+        break;
+      }
+      // unreachable predecessors, as of label after jmp, never enter block
+      bool entered_from_idom_only = std::all_of(preds.begin(), preds.end(), [&](int pred) {
+        return pred == idom || tree.dfs_in[pred] == -1;
+      });
+      if (entered_from_idom_only) {
+        range = restrict_on_edge(var_index, range, idom, b_index);
+      }
+      b_index = idom;
+    }
+    return range;
+  }
+
+  value_range compute(int i_index, int b_index) const {
+    const auto& instr = *i_vec[i_index];
+    switch (instr.type) {
+      case op_mov:
+        return operand_range(static_cast<const binary_instruction&>(instr).arg_2, b_index);
+      case op_phi: {
+        // argument comes from the end of predecessor along the edge
+        const auto& args = static_cast<const phi_instruction&>(instr).args;
+        const auto& preds = graph.blocks[b_index].predecessors;
+        value_range result;
+        for (size_t pred_index = 0; pred_index != args.size(); ++pred_index) {
+          auto pred = preds[pred_index];
+          if (tree.dfs_in[pred] == -1) {
+            continue;
+          }
+          auto arg_range = operand_range(args[pred_index], pred);
+          if (!is_constant(args[pred_index]) && strict[universe.find(args[pred_index])]) {
+            arg_range = restrict_on_edge(universe.find(args[pred_index]), arg_range, pred, b_index);
+          }
+          result = join(result, arg_range);
+        }
+        return result;
+      }
+      case op_add:
+      case op_sub:
+      case op_mul:
+      case op_div:
+      case op_shl:
+      case op_sar:
+      case op_udiv:
+      case op_cmp_eq:
+      case op_cmp_neq:
+      case op_cmp_gt:
+      case op_cmp_lt:
+      case op_cmp_lte:
+      case op_cmp_gte: {
+        const auto& op = static_cast<const three_addr_instruction&>(instr);
+        return evaluate(instr.type, operand_range(op.arg_2, b_index),
+                        operand_range(op.arg_3, b_index));
+      }
+      default:
+        return full_range;
+    }
+  }
+
+  // one pass over reachable blocks in reverse postorder, ranges grow with widening
+  // or shrink during narrowing, returns whether anything changed
+  bool visit_blocks(bool narrowing) {
+    bool changed = false;
+    std::vector<std::string> defs;
+    for (auto b_index : tree.reverse_postorder) {
+      const auto& block = graph.blocks[b_index];
+      for (int i_index = block.first; i_index <= block.last; ++i_index) {
+        defs.clear();
+        instruction_defs(*i_vec[i_index], defs);
+        if (defs.size() != 1 || !strict[universe.find(defs.front())]) {
+          continue;
+        }
+        auto var_index = universe.find(defs.front());
+        auto& current = values[var_index];
+        auto computed = compute(i_index, b_index);
+        value_range next;
+        if (narrowing) {
+          next = current.is_empty() ? current : intersect(current, computed);
+        } else {
+          next = join(current, computed);
+          auto delay = i_vec[i_index]->type == op_phi && loop_headers[b_index]
+                           ? header_widening_delay
+                           : widening_delay;
+          if (!current.is_empty() && !(next == current) && ++changes[var_index] > delay) {
+            next.lo = next.lo < current.lo ? INT32_MIN : next.lo;
+            next.hi = next.hi > current.hi ? INT32_MAX : next.hi;
+          }
+        }
+        if (!(next == current)) {
+          current = next;
+          changed = true;
+        }
+      }
+    }
+    return changed;
+  }
+
+  void solve() {
+    if (graph.blocks.empty()) {
+      return;
+    }
+    while (visit_blocks(false)) {
+    }
+    // two decreasing passes recover bounds of loop exit tests lost by widening
+    visit_blocks(true);
+    visit_blocks(true);
+  }
+
+  const instruction_vec& i_vec;
+  const label_table& table;
+  const variable_universe& universe;
+  const block_graph& graph;
+  const dominator_tree& tree;
+  std::vector<bool> strict;
+  std::vector<int> def_positions;
+  std::vector<bool> loop_headers;
+  std::vector<value_range> values;
+  std::vector<int> changes;
+};
+
+// exponent of power of two constant or -1
+int power_of_two(const std::string& arg) {
+  if (!is_constant(arg)) {
+    return -1;
+  }
+  auto value = std::stoll(arg);
+  if (value <= 0 || value > INT32_MAX || (value & (value - 1)) != 0) {
+    return -1;
+  }
+  int exponent = 0;
+  while ((int64_t(1) << exponent) != value) {
+    ++exponent;
+  }
+  return exponent;
+}
+}  // namespace
+
+std::vector<value_range> analyze_value_ranges(const instruction_vec& i_vec,
+                                              const label_table& table,
+                                              const variable_universe& universe) {
+  analysis_manager analyses(i_vec, table);
+  range_analysis analysis(i_vec, table, universe, analyses.blocks(), analyses.dominators());
+  analysis.solve();
+  if (analysis.values.empty()) {
+    return std::vector<value_range>(universe.size(), full_range);
+  }
+  return analysis.values;
+}
+
+void simplify_by_value_ranges(instruction_vec& i_vec, label_table& table,
+                              optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  simplify_by_value_ranges(i_vec, table, analyses, stats);
+}
+
+void simplify_by_value_ranges(instruction_vec& i_vec, label_table& table,
+                              analysis_manager& analyses, optimization_stats& stats) {
+  range_analysis analysis(i_vec, table, analyses.universe(), analyses.blocks(),
+                          analyses.dominators());
+  if (analysis.graph.blocks.empty()) {
+    return;
+  }
+  analysis.solve();
+
+  for (auto b_index : analysis.tree.reverse_postorder) {
+    const auto& block = analysis.graph.blocks[b_index];
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      auto& instr = i_vec[i_index];
+      if (instr->type == op_if) {
+        // condition with known sign makes branch unconditional for constant propagation
+        auto& condition = static_cast<binary_instruction&>(*instr).arg_1;
+        auto range = analysis.operand_range(condition, b_index);
+        if (!is_constant(condition) && !range.is_empty() && (range.lo > 0 || range.hi <= 0)) {
+          condition = range.lo > 0 ? "1" : "0";
+          ++stats.known_comparisons;
+        }
+        continue;
+      }
+      if (instr->type != op_div && !is_comparison(instr->type)) {
+        continue;
+      }
+      auto op = static_cast<three_addr_instruction*>(instr.get());
+      auto lhs = analysis.operand_range(op->arg_2, b_index);
+      auto rhs = analysis.operand_range(op->arg_3, b_index);
+      if (lhs.is_empty() || rhs.is_empty()) {
+        continue;
+      }
+      if (is_comparison(instr->type)) {
+        auto result = compare(instr->type, lhs, rhs);
+        if (result.lo == result.hi) {
+          instr = std::make_unique<binary_instruction>(op_mov, op->arg_1,
+                                                       std::to_string(result.lo));
+          ++stats.known_comparisons;
+        }
+        continue;
+      }
+      if (instr->type != op_div || lhs.lo < 0 || rhs.lo < 0) {
+        continue;
+      }
+      // non negative values divide by shift or without sign extension
+      auto exponent = power_of_two(op->arg_3);
+      if (exponent == 0) {
+        instr = std::make_unique<binary_instruction>(op_mov, op->arg_1, op->arg_2);
+      } else if (exponent > 0) {
+        instr = std::make_unique<three_addr_instruction>(op_sar, op->arg_1, op->arg_2,
+                                                         std::to_string(exponent));
+      } else {
+        instr = std::make_unique<three_addr_instruction>(op_udiv, op->arg_1, op->arg_2,
+                                                         op->arg_3);
+      }
+      ++stats.narrowed_operations;
+    }
+  }
+}
@@ -0,0 +1,429 @@
+#include "yadfa.h"
+
+namespace {
+// values are folded with 32 bit wrap around, as they are computed by generated code
+struct lattice_value {
+  enum state { undefined, constant, overdefined };
+  state kind = undefined;
+  int32_t value = 0;
+  bool operator==(const lattice_value& rhs) const {
+    return kind == rhs.kind && (kind != constant || value == rhs.value);
+  }
+};
+
+lattice_value make_constant(int64_t value) {
+  return {lattice_value::constant, static_cast<int32_t>(static_cast<uint32_t>(value))};
+}
+
+const lattice_value overdefined_value{lattice_value::overdefined, 0};
+
+lattice_value meet(const lattice_value& a, const lattice_value& b) {
+  if (a.kind == lattice_value::undefined) {
+    return b;
+  }
+  if (b.kind == lattice_value::undefined) {
+    return a;
+  }
+  if (a.kind == lattice_value::constant && b.kind == lattice_value::constant &&
+      a.value == b.value) {
+    return a;
+  }
+  return overdefined_value;
+}
+
+lattice_value evaluate(instruction_type type, const lattice_value& lhs, const lattice_value& rhs) {
+  if (lhs.kind == lattice_value::overdefined || rhs.kind == lattice_value::overdefined) {
+    return overdefined_value;
+  }
+  if (lhs.kind == lattice_value::undefined || rhs.kind == lattice_value::undefined) {
+    return {};
+  }
+  int64_t a = lhs.value;
+  int64_t b = rhs.value;
+  switch (type) {
+    case op_add:
+      return make_constant(a + b);
+    case op_sub:
+      return make_constant(a - b);
+    case op_mul:
+      return make_constant(a * b);
+    case op_div:
+      // division by zero and overflow trap at run time
+      if (b == 0 || (a == INT32_MIN && b == -1)) {
+        return overdefined_value;
+      }
+      return make_constant(a / b);
+    case op_shl:
+      // count is masked as by shift instructions
+      return make_constant(static_cast<uint32_t>(a) << (b & 31));
+    case op_sar:
+      return make_constant(a >> (b & 31));
+    case op_udiv:
+      if (b == 0) {
+        return overdefined_value;
+      }
+      return make_constant(static_cast<uint32_t>(a) / static_cast<uint32_t>(b));
+    case op_cmp_eq:
+      return make_constant(a == b);
+    case op_cmp_neq:
+      return make_constant(a != b);
+    case op_cmp_gt:
+      return make_constant(a > b);
+    case op_cmp_lt:
+      return make_constant(a < b);
+    case op_cmp_lte:
+      return make_constant(a <= b);
+    case op_cmp_gte:
+      return make_constant(a >= b);
+    default:
+      return overdefined_value;
+  }
+}
+
+bool is_foldable(instruction_type type) {
+  switch (type) {
+    case op_mov:
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_div:
+    case op_shl:
+    case op_sar:
+    case op_udiv:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+    case op_phi:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// if jumps when its condition is greater than zero
+bool is_branch_taken(int32_t condition) {
+  return condition > 0;
+}
+
+struct constant_propagation {
+  constant_propagation(const instruction_vec& i_vec, const label_table& table,
+                       analysis_manager& analyses)
+      : i_vec(i_vec), table(table), graph(analyses.blocks()), universe(analyses.universe()) {
+    values.assign(universe.size(), overdefined_value);
+    users.resize(universe.size());
+    executable_blocks.assign(graph.blocks.size(), false);
+    std::vector<bool> declared(universe.size(), false);
+    for (const auto& instr : i_vec) {
+      auto var_index = instr->type == op_var
+                           ? universe.find(static_cast<const binary_instruction&>(*instr).arg_1)
+                           : -1;
+      if (var_index >= 0) {
+        declared[var_index] = true;
+      }
+    }
+    std::vector<std::string> args;
+    for (int i_index = 0; i_index < i_vec.size(); ++i_index) {
+      args.clear();
+      instruction_defs(*i_vec[i_index], args);
+      for (const auto& def : args) {
+        // variables without any definition keep unknown value of their location,
+        // parameters and other undeclared names keep value they have on entry
+        auto var_index = universe.find(def);
+        if (declared[var_index]) {
+          values[var_index] = lattice_value();
+        }
+      }
+      args.clear();
+      instruction_uses(*i_vec[i_index], args);
+      for (const auto& use : args) {
+        auto& var_users = users[universe.find(use)];
+        if (var_users.empty() || var_users.back() != i_index) {
+          var_users.push_back(i_index);
+        }
+      }
+    }
+  }
+
+  lattice_value operand_value(const std::string& arg) const {
+    if (is_constant(arg)) {
+      return make_constant(std::stoll(arg));
+    }
+    return values[universe.find(arg)];
+  }
+
+  bool is_executable(int from, int to) const {
+    return executable_edges.find({from, to}) != executable_edges.end();
+  }
+
+  void mark_edge(int from, int to) {
+    if (executable_edges.insert({from, to}).second) {
+      flow_work_list.push_back({from, to});
+    }
+  }
+
+  // definitions of non SSA names meet over all their definitions
+  void update(const std::string& var, const lattice_value& value) {
+    auto var_index = universe.find(var);
+    auto new_value = meet(values[var_index], value);
+    if (new_value == values[var_index]) {
+      return;
+    }
+    values[var_index] = new_value;
+    for (auto user : users[var_index]) {
+      ssa_work_list.push_back(user);
+    }
+  }
+
+  void visit_phi(int i_index) {
+    auto phi = static_cast<const phi_instruction*>(i_vec[i_index].get());
+    auto b_index = graph.instruction_block[i_index];
+    const auto& preds = graph.blocks[b_index].predecessors;
+    lattice_value value;
+    for (size_t pred_index = 0; pred_index != preds.size(); ++pred_index) {
+      if (is_executable(preds[pred_index], b_index)) {
+        value = meet(value, operand_value(phi->args[pred_index]));
+      }
+    }
+    update(phi->dest, value);
+  }
+
+  void visit_instruction(int i_index) {
+    auto b_index = graph.instruction_block[i_index];
+    if (!executable_blocks[b_index]) {
+      return;
+    }
+    const auto& block = graph.blocks[b_index];
+    auto& instr = *i_vec[i_index];
+    switch (instr.type) {
+      case op_phi:
+        visit_phi(i_index);
+        break;
+      case op_mov: {
+        auto& mov = static_cast<const binary_instruction&>(instr);
+        update(mov.arg_1, operand_value(mov.arg_2));
+        break;
+      }
+      case op_add:
+      case op_sub:
+      case op_mul:
+      case op_div:
+      case op_shl:
+      case op_sar:
+      case op_udiv:
+      case op_cmp_eq:
+      case op_cmp_neq:
+      case op_cmp_gt:
+      case op_cmp_lt:
+      case op_cmp_lte:
+      case op_cmp_gte: {
+        auto& op = static_cast<const three_addr_instruction&>(instr);
+        update(op.arg_1, evaluate(instr.type, operand_value(op.arg_2), operand_value(op.arg_3)));
+        break;
+      }
+      case op_if: {
+        auto condition = operand_value(static_cast<const binary_instruction&>(instr).arg_1);
+        if (condition.kind == lattice_value::undefined) {
+          return;
+        }
+        auto target = branch_target(i_vec, table, i_index);
+        bool taken = condition.kind == lattice_value::overdefined ||
+                     is_branch_taken(condition.value);
+        bool falls_through = condition.kind == lattice_value::overdefined || !taken;
+        if (taken && target >= 0 && target < i_vec.size()) {
+          mark_edge(b_index, graph.instruction_block[target]);
+        }
+        if (falls_through && i_index + 1 < i_vec.size()) {
+          mark_edge(b_index, graph.instruction_block[i_index + 1]);
+        }
+        return;
+      }
+      default: {
+        std::vector<std::string> defs;
+        instruction_defs(instr, defs);
+        for (const auto& def : defs) {
+          update(def, overdefined_value);
+        }
+        break;
+      }
+    }
+    if (i_index == block.last) {
+      for (auto succ : block.successors) {
+        mark_edge(b_index, succ);
+      }
+    }
+  }
+
+  // Wegman, Zadeck "Constant Propagation with Conditional Branches"
+  void solve() {
+    if (graph.blocks.empty()) {
+      return;
+    }
+    executable_blocks[0] = true;
+    for (int i_index = graph.blocks[0].first; i_index <= graph.blocks[0].last; ++i_index) {
+      visit_instruction(i_index);
+    }
+    while (!flow_work_list.empty() || !ssa_work_list.empty()) {
+      while (!flow_work_list.empty()) {
+        auto edge = flow_work_list.back();
+        flow_work_list.pop_back();
+        const auto& block = graph.blocks[edge.second];
+        if (executable_blocks[edge.second]) {
+          // only phis depend on new edge
+          for (int i_index = block.first;
+               i_index <= block.last && i_vec[i_index]->type == op_phi; ++i_index) {
+            visit_phi(i_index);
+          }
+          continue;
+        }
+        executable_blocks[edge.second] = true;
+        for (int i_index = block.first; i_index <= block.last; ++i_index) {
+          visit_instruction(i_index);
+        }
+      }
+      while (!ssa_work_list.empty()) {
+        auto i_index = ssa_work_list.back();
+        ssa_work_list.pop_back();
+        visit_instruction(i_index);
+      }
+    }
+  }
+
+  const instruction_vec& i_vec;
+  const label_table& table;
+  const block_graph& graph;
+  const variable_universe& universe;
+  std::vector<lattice_value> values;
+  std::vector<std::vector<int>> users;
+  std::vector<bool> executable_blocks;
+  std::set<std::pair<int, int>> executable_edges;
+  std::vector<std::pair<int, int>> flow_work_list;
+  std::vector<int> ssa_work_list;
+};
+}  // namespace
+
+void propagate_constants(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  propagate_constants(i_vec, table, analyses, stats);
+}
+
+void propagate_constants(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                         optimization_stats& stats) {
+  constant_propagation propagation(i_vec, table, analyses);
+  propagation.solve();
+  const auto& graph = propagation.graph;
+
+  // predecessors of blocks with phis are remembered by their last instruction
+  // as folded branches change both edges and block boundaries
+  struct phi_group {
+    int first;
+    int end;
+    std::vector<int> predecessor_lasts;
+  };
+  std::vector<phi_group> phi_groups;
+  for (int b_index = 0; b_index < graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    if (!propagation.executable_blocks[b_index] || i_vec[block.first]->type != op_phi) {
+      continue;
+    }
+    phi_group group{block.first, block.first, {}};
+    while (group.end <= block.last && i_vec[group.end]->type == op_phi) {
+      ++group.end;
+    }
+    for (auto pred : block.predecessors) {
+      group.predecessor_lasts.push_back(graph.blocks[pred].last);
+    }
+    phi_groups.push_back(group);
+  }
+
+  for (int b_index = 0; b_index < graph.blocks.size(); ++b_index) {
+    // unreachable code is left for dead code elimination
+    if (!propagation.executable_blocks[b_index]) {
+      continue;
+    }
+    for (int i_index = graph.blocks[b_index].first; i_index <= graph.blocks[b_index].last;
+         ++i_index) {
+      auto& instr = i_vec[i_index];
+      if (instr->type == op_if) {
+        auto if_instr = static_cast<binary_instruction*>(instr.get());
+        auto condition = propagation.operand_value(if_instr->arg_1);
+        if (condition.kind != lattice_value::constant) {
+          continue;
+        }
+        if (is_branch_taken(condition.value)) {
+          instr = std::make_unique<unary_instruction>(op_jmp, if_instr->arg_2);
+        } else {
+          instr = std::make_unique<noarg_instruction>(op_nop);
+        }
+        ++stats.folded_branches;
+        continue;
+      }
+      if (is_foldable(instr->type)) {
+        std::vector<std::string> defs;
+        instruction_defs(*instr, defs);
+        auto value = propagation.operand_value(defs.front());
+        if (value.kind == lattice_value::constant) {
+          auto source = std::to_string(value.value);
+          if (instr->type != op_mov || static_cast<binary_instruction*>(instr.get())->arg_2 != source) {
+            instr = std::make_unique<binary_instruction>(op_mov, defs.front(), source);
+            ++stats.propagated_constants;
+          }
+          continue;
+        }
+      }
+      if (!is_foldable(instr->type) && instr->type != op_call) {
+        continue;
+      }
+      visit_use_operands(*instr, [&](std::string& arg) {
+        auto value = propagation.operand_value(arg);
+        if (value.kind == lattice_value::constant) {
+          arg = std::to_string(value.value);
+          ++stats.propagated_constants;
+        }
+      });
+    }
+  }
+  if (phi_groups.empty()) {
+    return;
+  }
+
+  // arguments of phis are dropped for removed edges, phi with single
+  // argument left is a copy, placed after remaining phis of its block
+  const auto new_graph = build_basic_blocks(i_vec, build_cfg(i_vec, table));
+  for (const auto& group : phi_groups) {
+    std::vector<int> lasts;
+    const auto& new_block = new_graph.blocks[new_graph.instruction_block[group.first]];
+    if (new_block.first == group.first) {
+      for (auto pred : new_block.predecessors) {
+        lasts.push_back(new_graph.blocks[pred].last);
+      }
+    } else {
+      // block was merged with the one it falls through from
+      lasts.push_back(group.first - 1);
+    }
+    for (int i_index = group.first; i_index != group.end; ++i_index) {
+      if (i_vec[i_index]->type != op_phi) {
+        continue;
+      }
+      auto phi = static_cast<phi_instruction*>(i_vec[i_index].get());
+      std::vector<std::string> args;
+      const auto& old_lasts = group.predecessor_lasts;
+      for (size_t pred_index = 0; pred_index != old_lasts.size(); ++pred_index) {
+        if (std::find(lasts.begin(), lasts.end(), old_lasts[pred_index]) != lasts.end()) {
+          args.push_back(phi->args[pred_index]);
+        }
+      }
+      if (args.size() == 1) {
+        i_vec[i_index] = std::make_unique<binary_instruction>(op_mov, phi->dest, args.front());
+      } else {
+        phi->args = args;
+      }
+    }
+    // jumps land only on the first instruction of the block, so its
+    // leading phis and copies may be reordered
+    std::stable_partition(i_vec.begin() + group.first, i_vec.begin() + group.end,
+                          [](const instruction_ptr& instr) { return instr->type == op_phi; });
+  }
+}
@@ -0,0 +1,602 @@
+#include "yadfa.h"
+
+namespace {
+int32_t wrap(int64_t value) {
+  return static_cast<int32_t>(static_cast<uint32_t>(value));
+}
+
+// value being analyzed may refer to phi whose recurrence is being found,
+// self counts how many times it is added in
+struct evolution_value {
+  bool known = false;
+  int32_t self = 0;
+  std::vector<scev_linear> coefficients;
+};
+
+evolution_value unknown_value() {
+  return {};
+}
+
+evolution_value invariant_value(const scev_linear& value) {
+  return {true, 0, {value}};
+}
+
+evolution_value add_values(const evolution_value& a, const evolution_value& b) {
+  if (!a.known || !b.known) {
+    return unknown_value();
+  }
+  evolution_value result{true, wrap(static_cast<int64_t>(a.self) + b.self), a.coefficients};
+  result.coefficients.resize(std::max(a.coefficients.size(), b.coefficients.size()));
+  for (size_t index = 0; index != b.coefficients.size(); ++index) {
+    result.coefficients[index] = scev_add(result.coefficients[index], b.coefficients[index]);
+  }
+  return result;
+}
+
+evolution_value scale_value(const evolution_value& a, int32_t factor) {
+  if (!a.known) {
+    return a;
+  }
+  evolution_value result{true, wrap(static_cast<int64_t>(a.self) * factor), {}};
+  for (const auto& coefficient : a.coefficients) {
+    result.coefficients.push_back(scev_scale(coefficient, factor));
+  }
+  return result;
+}
+
+// product with invariant value stays linear when coefficients are constants
+evolution_value scale_by_invariant(const evolution_value& a, const evolution_value& invariant) {
+  if (!a.known || !invariant.known || a.self != 0 || invariant.self != 0 ||
+      invariant.coefficients.size() != 1) {
+    return unknown_value();
+  }
+  evolution_value result{true, 0, {}};
+  for (const auto& coefficient : a.coefficients) {
+    if (!coefficient.is_constant()) {
+      return unknown_value();
+    }
+    result.coefficients.push_back(scev_scale(invariant.coefficients.front(), coefficient.constant));
+  }
+  return result;
+}
+
+// constant when value is single constant coefficient without self
+bool constant_of(const evolution_value& value, int32_t& constant) {
+  if (!value.known || value.self != 0 || value.coefficients.size() != 1 ||
+      !value.coefficients.front().is_constant()) {
+    return false;
+  }
+  constant = value.coefficients.front().constant;
+  return true;
+}
+
+scev_linear linear_constant(int32_t value) {
+  scev_linear linear;
+  linear.constant = value;
+  return linear;
+}
+
+scev_linear linear_symbol(const std::string& name) {
+  scev_linear linear;
+  linear.symbols[name] = 1;
+  return linear;
+}
+
+instruction_type mirrored_comparison(instruction_type type) {
+  switch (type) {
+    case op_cmp_lt:
+      return op_cmp_gt;
+    case op_cmp_gt:
+      return op_cmp_lt;
+    case op_cmp_lte:
+      return op_cmp_gte;
+    case op_cmp_gte:
+      return op_cmp_lte;
+    default:
+      return type;
+  }
+}
+
+instruction_type negated_comparison(instruction_type type) {
+  switch (type) {
+    case op_cmp_lt:
+      return op_cmp_gte;
+    case op_cmp_gte:
+      return op_cmp_lt;
+    case op_cmp_gt:
+      return op_cmp_lte;
+    case op_cmp_lte:
+      return op_cmp_gt;
+    case op_cmp_eq:
+      return op_cmp_neq;
+    default:
+      return op_cmp_eq;
+  }
+}
+
+bool is_comparison(instruction_type type) {
+  return type == op_cmp_eq || type == op_cmp_neq || type == op_cmp_gt || type == op_cmp_lt ||
+         type == op_cmp_lte || type == op_cmp_gte;
+}
+
+// inverse of odd number modulo 2^32, each Newton step doubles correct bits
+uint32_t odd_inverse(uint32_t value) {
+  uint32_t inverse = value;
+  for (int step = 0; step != 5; ++step) {
+    inverse *= 2 - value * inverse;
+  }
+  return inverse;
+}
+
+// back edges taken while start + k * step compares with bound as stay says,
+// both of them constant, false when induction variable would wrap around first
+bool constant_trip_count(instruction_type stay, int32_t start, int32_t step, int32_t bound,
+                         uint32_t& count) {
+  int64_t distance = static_cast<int64_t>(bound) - start;
+  // value in iteration which leaves has to fit in 32 bits
+  auto fits = [&](int64_t trips) {
+    auto last = start + trips * static_cast<int64_t>(step);
+    return last >= INT32_MIN && last <= INT32_MAX;
+  };
+  switch (stay) {
+    case op_cmp_lt:
+    case op_cmp_lte: {
+      if (step < 0) {
+        return false;
+      }
+      auto reach = stay == op_cmp_lt ? distance : distance + 1;
+      auto trips = reach <= 0 ? 0 : (reach + step - 1) / step;
+      count = static_cast<uint32_t>(trips);
+      return fits(trips);
+    }
+    case op_cmp_gt:
+    case op_cmp_gte: {
+      if (step > 0) {
+        return false;
+      }
+      auto reach = stay == op_cmp_gt ? -distance : -distance + 1;
+      auto trips = reach <= 0 ? 0 : (reach - step - 1) / -static_cast<int64_t>(step);
+      count = static_cast<uint32_t>(trips);
+      return fits(trips);
+    }
+    case op_cmp_eq:
+      count = start == bound ? 1 : 0;
+      return true;
+    default: {
+      // stays until induction variable wraps around to bound
+      if (step % 2 == 0) {
+        return false;
+      }
+      count = static_cast<uint32_t>(distance) * odd_inverse(static_cast<uint32_t>(step));
+      return true;
+    }
+  }
+}
+
+struct evolution_builder {
+  const instruction_vec& i_vec;
+  const block_graph& graph;
+  const std::vector<natural_loop>& loops;
+  const std::vector<int>& block_loops;
+  std::map<std::string, int> def_positions;
+  std::map<std::string, add_recurrence>& recurrences;
+  std::set<std::string> failed;
+  std::set<std::string> in_progress;
+
+  int loop_of(const std::string& name) const {
+    auto def = def_positions.find(name);
+    if (def == def_positions.end() || def->second < 0) {
+      return -1;
+    }
+    return block_loops[graph.instruction_block[def->second]];
+  }
+
+  // value of operand in terms of recurrences over loop, self is phi being analyzed
+  evolution_value value_of(const std::string& arg, int loop, const std::string& self) {
+    if (is_constant(arg)) {
+      return invariant_value(linear_constant(wrap(std::stoll(arg))));
+    }
+    if (arg == self) {
+      return {true, 1, {scev_linear()}};
+    }
+    auto def = def_positions.find(arg);
+    if (def != def_positions.end() && def->second < 0) {
+      // defined more than once, program is not in SSA form
+      return unknown_value();
+    }
+    if (def == def_positions.end() ||
+        std::find(loops[loop].blocks.begin(), loops[loop].blocks.end(),
+                  graph.instruction_block[def->second]) == loops[loop].blocks.end()) {
+      // copies of constants are not propagated before
+      if (def != def_positions.end() && i_vec[def->second]->type == op_mov) {
+        const auto& source = static_cast<const binary_instruction&>(*i_vec[def->second]).arg_2;
+        if (is_constant(source)) {
+          return invariant_value(linear_constant(wrap(std::stoll(source))));
+        }
+      }
+      return invariant_value(linear_symbol(arg));
+    }
+    if (loop_of(arg) != loop) {
+      // defined in inner loop
+      return unknown_value();
+    }
+    auto known = recurrences.find(arg);
+    if (known != recurrences.end()) {
+      return {true, 0, known->second.coefficients};
+    }
+    if (failed.count(arg) || in_progress.count(arg)) {
+      return unknown_value();
+    }
+    in_progress.insert(arg);
+    auto value = definition_value(def->second, loop, self);
+    in_progress.erase(arg);
+    if (value.known && value.self == 0) {
+      recurrences[arg] = add_recurrence{loop, value.coefficients};
+    } else if (!value.known) {
+      failed.insert(arg);
+    }
+    return value;
+  }
+
+  evolution_value definition_value(int i_index, int loop, const std::string& self) {
+    const auto& instr = *i_vec[i_index];
+    switch (instr.type) {
+      case op_phi:
+        return header_phi(i_index, loop);
+      case op_mov:
+        return value_of(static_cast<const binary_instruction&>(instr).arg_2, loop, self);
+      case op_add:
+      case op_sub:
+      case op_mul:
+      case op_shl:
+        break;
+      default:
+        return unknown_value();
+    }
+    const auto& op = static_cast<const three_addr_instruction&>(instr);
+    auto lhs = value_of(op.arg_2, loop, self);
+    auto rhs = value_of(op.arg_3, loop, self);
+    int32_t constant = 0;
+    switch (instr.type) {
+      case op_add:
+        return add_values(lhs, rhs);
+      case op_sub:
+        return add_values(lhs, scale_value(rhs, -1));
+      case op_mul:
+        if (constant_of(rhs, constant)) {
+          return scale_value(lhs, constant);
+        }
+        if (constant_of(lhs, constant)) {
+          return scale_value(rhs, constant);
+        }
+        return rhs.known && rhs.coefficients.size() == 1 ? scale_by_invariant(lhs, rhs)
+                                                          : scale_by_invariant(rhs, lhs);
+      default:
+        // count is masked as by shift instruction
+        if (constant_of(rhs, constant)) {
+          return scale_value(lhs, wrap(int64_t(1) << (constant & 31)));
+        }
+        return unknown_value();
+    }
+  }
+
+  // phi at header whose value from latch is itself plus recurrence
+  evolution_value header_phi(int i_index, int loop) {
+    const auto& phi = static_cast<const phi_instruction&>(*i_vec[i_index]);
+    const auto header = loops[loop].header;
+    if (graph.instruction_block[i_index] != header) {
+      return unknown_value();
+    }
+    const auto& preds = graph.blocks[header].predecessors;
+    if (preds.size() != 2 || phi.args.size() != 2) {
+      return unknown_value();
+    }
+    const auto& blocks = loops[loop].blocks;
+    bool first_inside = std::find(blocks.begin(), blocks.end(), preds[0]) != blocks.end();
+    bool second_inside = std::find(blocks.begin(), blocks.end(), preds[1]) != blocks.end();
+    if (first_inside == second_inside) {
+      return unknown_value();
+    }
+    auto start = value_of(phi.args[first_inside ? 1 : 0], loop, "");
+    auto next = value_of(phi.args[first_inside ? 0 : 1], loop, phi.dest);
+    if (!start.known || start.self != 0 || start.coefficients.size() != 1 || !next.known ||
+        next.self != 1) {
+      return unknown_value();
+    }
+    evolution_value result{true, 0, start.coefficients};
+    result.coefficients.insert(result.coefficients.end(), next.coefficients.begin(),
+                               next.coefficients.end());
+    // invariant step of zero keeps value of start
+    while (result.coefficients.size() > 1 && result.coefficients.back().is_zero()) {
+      result.coefficients.pop_back();
+    }
+    return result;
+  }
+};
+}  // namespace
+
+scev_linear scev_add(const scev_linear& a, const scev_linear& b) {
+  scev_linear result = a;
+  result.constant = wrap(static_cast<int64_t>(a.constant) + b.constant);
+  for (const auto& symbol : b.symbols) {
+    auto factor = wrap(static_cast<int64_t>(result.symbols[symbol.first]) + symbol.second);
+    if (factor == 0) {
+      result.symbols.erase(symbol.first);
+    } else {
+      result.symbols[symbol.first] = factor;
+    }
+  }
+  return result;
+}
+
+scev_linear scev_scale(const scev_linear& a, int32_t factor) {
+  scev_linear result;
+  result.constant = wrap(static_cast<int64_t>(a.constant) * factor);
+  for (const auto& symbol : a.symbols) {
+    auto scaled = wrap(static_cast<int64_t>(symbol.second) * factor);
+    if (scaled != 0) {
+      result.symbols[symbol.first] = scaled;
+    }
+  }
+  return result;
+}
+
+scalar_evolution::scalar_evolution(const instruction_vec& i_vec, const block_graph& graph,
+                                   const dominator_tree& tree)
+    : loops_(find_natural_loops(graph, tree)), block_loops_(graph.blocks.size(), -1) {
+  // outer loops come first, so inner ones overwrite them
+  for (int loop = 0; loop != loops_.size(); ++loop) {
+    for (auto b_index : loops_[loop].blocks) {
+      block_loops_[b_index] = loop;
+    }
+  }
+  evolution_builder builder{i_vec, graph, loops_, block_loops_, {}, recurrences_, {}, {}};
+  std::vector<std::string> defs;
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    defs.clear();
+    instruction_defs(*i_vec[i_index], defs);
+    for (const auto& def : defs) {
+      auto inserted = builder.def_positions.insert({def, i_index});
+      if (!inserted.second) {
+        inserted.first->second = -1;
+      }
+    }
+  }
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (graph.instruction_block[i_index] < 0) {
+      continue;
+    }
+    auto loop = block_loops_[graph.instruction_block[i_index]];
+    defs.clear();
+    instruction_defs(*i_vec[i_index], defs);
+    if (loop >= 0 && defs.size() == 1) {
+      builder.value_of(defs.front(), loop, "");
+    }
+  }
+
+  for (int loop = 0; loop != loops_.size(); ++loop) {
+    const auto& blocks = loops_[loop].blocks;
+    auto inside = [&blocks](int b_index) {
+      return std::find(blocks.begin(), blocks.end(), b_index) != blocks.end();
+    };
+    int exit_block = -1;
+    int exits = 0;
+    for (auto b_index : blocks) {
+      for (auto succ : graph.blocks[b_index].successors) {
+        if (!inside(succ)) {
+          exit_block = b_index;
+          ++exits;
+        }
+      }
+    }
+    if (exits != 1 || i_vec[graph.blocks[exit_block].last]->type != op_if) {
+      continue;
+    }
+    bool runs_every_iteration = true;
+    for (auto latch : loops_[loop].latches) {
+      runs_every_iteration = runs_every_iteration && tree.dominates(exit_block, latch);
+    }
+    if (!runs_every_iteration) {
+      continue;
+    }
+    const auto& branch = static_cast<const binary_instruction&>(*i_vec[graph.blocks[exit_block].last]);
+    auto condition = builder.def_positions.find(branch.arg_1);
+    if (condition == builder.def_positions.end() || condition->second < 0 ||
+        !is_comparison(i_vec[condition->second]->type)) {
+      continue;
+    }
+    const auto& comparison = static_cast<const three_addr_instruction&>(*i_vec[condition->second]);
+    // loop is left when if jumps out or when it falls through out
+    auto next = graph.blocks[exit_block].last + 1;
+    bool falls_inside = next < i_vec.size() && inside(graph.instruction_block[next]);
+    auto stay = falls_inside ? negated_comparison(comparison.type) : comparison.type;
+    auto lhs = builder.value_of(comparison.arg_2, loop, "");
+    auto rhs = builder.value_of(comparison.arg_3, loop, "");
+    if (!lhs.known || !rhs.known || lhs.self != 0 || rhs.self != 0) {
+      continue;
+    }
+    if (lhs.coefficients.size() == 1 && rhs.coefficients.size() == 2) {
+      std::swap(lhs, rhs);
+      stay = mirrored_comparison(stay);
+    }
+    if (lhs.coefficients.size() != 2 || rhs.coefficients.size() != 1 ||
+        !lhs.coefficients[1].is_constant()) {
+      continue;
+    }
+    const auto& start = lhs.coefficients[0];
+    auto bound = rhs.coefficients[0];
+    auto step = lhs.coefficients[1].constant;
+    trip_count count;
+    count.exit_block = exit_block;
+    if (start.is_constant() && bound.is_constant()) {
+      uint32_t trips = 0;
+      if (!constant_trip_count(stay, start.constant, step, bound.constant, trips)) {
+        continue;
+      }
+      count.difference.constant = static_cast<int32_t>(trips);
+      trip_counts_[loop] = count;
+      continue;
+    }
+    // symbolic count only for steps by one, which can not jump over bound
+    if (stay == op_cmp_lte && step == 1 && bound.is_constant() && bound.constant != INT32_MAX) {
+      stay = op_cmp_lt;
+      ++bound.constant;
+    } else if (stay == op_cmp_gte && step == -1 && bound.is_constant() &&
+               bound.constant != INT32_MIN) {
+      stay = op_cmp_gt;
+      --bound.constant;
+    }
+    auto difference = scev_add(bound, scev_scale(start, -1));
+    if (stay == op_cmp_lt && step == 1) {
+      count.difference = difference;
+    } else if (stay == op_cmp_gt && step == -1) {
+      count.difference = scev_scale(difference, -1);
+    } else if (stay == op_cmp_neq && (step == 1 || step == -1)) {
+      count.difference = scev_scale(difference, step);
+      trip_counts_[loop] = count;
+      continue;
+    } else {
+      continue;
+    }
+    count.guarded = true;
+    count.guard = stay;
+    count.guard_lhs = start;
+    count.guard_rhs = bound;
+    trip_counts_[loop] = count;
+  }
+}
+
+const add_recurrence* scalar_evolution::recurrence(const std::string& name) const {
+  auto recurrence = recurrences_.find(name);
+  return recurrence == recurrences_.end() ? nullptr : &recurrence->second;
+}
+
+const trip_count* scalar_evolution::backedges(int loop) const {
+  auto count = trip_counts_.find(loop);
+  return count == trip_counts_.end() ? nullptr : &count->second;
+}
+
+int32_t evaluate_recurrence(const add_recurrence& recurrence, uint32_t count) {
+  // binomial(count, j) modulo 2^32, products of consecutive numbers stay exact in 128 bits
+  unsigned __int128 binomial = 1;
+  uint32_t value = 0;
+  for (size_t order = 0; order != recurrence.coefficients.size(); ++order) {
+    if (order != 0) {
+      binomial = binomial * (count - (order - 1)) / order;
+    }
+    value += static_cast<uint32_t>(binomial) *
+             static_cast<uint32_t>(recurrence.coefficients[order].constant);
+  }
+  return static_cast<int32_t>(value);
+}
+
+namespace {
+// emits instructions into new temporaries, folding constants on the way
+struct expansion {
+  const std::function<std::string()>& make_temp;
+  instruction_vec& out;
+
+  std::string emit(instruction_type type, const std::string& lhs, const std::string& rhs) {
+    auto temp = make_temp();
+    out.push_back(std::make_unique<binary_instruction>(op_var, temp, "int32"));
+    out.push_back(std::make_unique<three_addr_instruction>(type, temp, lhs, rhs));
+    return temp;
+  }
+
+  std::string add(const std::string& lhs, const std::string& rhs) {
+    if (is_constant(lhs) && is_constant(rhs)) {
+      return std::to_string(wrap(std::stoll(lhs) + std::stoll(rhs)));
+    }
+    if (lhs == "0") {
+      return rhs;
+    }
+    if (rhs == "0") {
+      return lhs;
+    }
+    return is_constant(lhs) ? emit(op_add, rhs, lhs) : emit(op_add, lhs, rhs);
+  }
+
+  std::string multiply(const std::string& lhs, const std::string& rhs) {
+    if (is_constant(lhs) && is_constant(rhs)) {
+      return std::to_string(wrap(std::stoll(lhs) * std::stoll(rhs)));
+    }
+    if (lhs == "0" || rhs == "0") {
+      return "0";
+    }
+    if (lhs == "1") {
+      return rhs;
+    }
+    if (rhs == "1") {
+      return lhs;
+    }
+    return is_constant(lhs) ? emit(op_mul, rhs, lhs) : emit(op_mul, lhs, rhs);
+  }
+
+  std::string linear(const scev_linear& value) {
+    auto result = std::to_string(value.constant);
+    for (const auto& symbol : value.symbols) {
+      result = add(result, multiply(symbol.first, std::to_string(symbol.second)));
+    }
+    return result;
+  }
+
+  // binomial(count, order) for order up to 2, count is unsigned
+  std::string binomial(const std::string& count, size_t order) {
+    if (order == 0) {
+      return "1";
+    }
+    if (order == 1) {
+      return count;
+    }
+    if (is_constant(count)) {
+      uint64_t value = static_cast<uint32_t>(std::stoll(count));
+      return std::to_string(static_cast<int32_t>(static_cast<uint32_t>(value * (value - 1) / 2)));
+    }
+    // half of even one of count and count - 1 times the other one
+    auto half = emit(op_udiv, count, "2");
+    auto odd = emit(op_sub, count, emit(op_shl, half, "1"));
+    return multiply(half, add(add(count, "-1"), odd));
+  }
+};
+}  // namespace
+
+std::string expand_linear(const scev_linear& value,
+                          const std::function<std::string()>& make_temp, instruction_vec& out) {
+  expansion expand{make_temp, out};
+  return expand.linear(value);
+}
+
+bool expand_recurrence(const add_recurrence& recurrence, const std::string& count,
+                       const std::string& dest, const std::function<std::string()>& make_temp,
+                       instruction_vec& out) {
+  if (recurrence.coefficients.size() > 3) {
+    return false;
+  }
+  expansion expand{make_temp, out};
+  std::string value = "0";
+  for (size_t order = 0; order != recurrence.coefficients.size(); ++order) {
+    auto coefficient = expand.linear(recurrence.coefficients[order]);
+    value = expand.add(value, expand.multiply(coefficient, expand.binomial(count, order)));
+  }
+  out.push_back(std::make_unique<binary_instruction>(op_mov, dest, value));
+  return true;
+}
+
+std::string expand_trip_count(const trip_count& count,
+                              const std::function<std::string()>& make_temp,
+                              instruction_vec& out) {
+  expansion expand{make_temp, out};
+  auto difference = expand.linear(count.difference);
+  if (!count.guarded) {
+    return difference;
+  }
+  auto lhs = expand.linear(count.guard_lhs);
+  auto rhs = expand.linear(count.guard_rhs);
+  auto guard = count.guard;
+  if (is_constant(lhs)) {
+    std::swap(lhs, rhs);
+    guard = mirrored_comparison(guard);
+  }
+  // comparison gives 1 or 0, so loop which is not entered takes no back edges
+  return expand.multiply(difference, expand.emit(guard, lhs, rhs));
+}
@@ -0,0 +1,223 @@
+#include "yadfa.h"
+
+namespace {
+// labels and nops are not executed, position of first instruction which is
+int skip_empty(const instruction_vec& i_vec, int i_index) {
+  while (i_index < i_vec.size() &&
+         (i_vec[i_index]->type == op_label || i_vec[i_index]->type == op_nop)) {
+    ++i_index;
+  }
+  return i_index;
+}
+
+std::string& jump_operand(instruction& instr) {
+  return instr.type == op_jmp ? static_cast<unary_instruction&>(instr).arg_1
+                              : static_cast<binary_instruction&>(instr).arg_2;
+}
+
+// label right before target when there is one, relative offset otherwise
+std::string target_operand(const instruction_vec& i_vec, int from, int target) {
+  if (target > 0 && i_vec[target - 1]->type == op_label) {
+    return static_cast<const unary_instruction&>(*i_vec[target - 1]).arg_1;
+  }
+  return std::to_string(target - from);
+}
+
+// follows jumps to jumps and ifs on condition known to be true
+int thread_target(const instruction_vec& i_vec, const label_table& table, int target,
+                  const std::string& true_condition) {
+  std::set<int> visited;
+  while (target >= 0 && target < i_vec.size()) {
+    auto first = skip_empty(i_vec, target);
+    if (first >= i_vec.size() || !visited.insert(first).second) {
+      break;
+    }
+    const auto& instr = *i_vec[first];
+    bool always_jumps =
+        instr.type == op_jmp ||
+        (instr.type == op_if && !true_condition.empty() &&
+         static_cast<const binary_instruction&>(instr).arg_1 == true_condition);
+    if (!always_jumps) {
+      break;
+    }
+    auto next = branch_target(i_vec, table, first);
+    if (next < 0) {
+      break;
+    }
+    target = next;
+  }
+  return target;
+}
+
+// constant last assigned to variable in block before position, empty when not known
+std::string known_value(const instruction_vec& i_vec, const basic_block& block, int i_index,
+                        const std::string& name) {
+  std::vector<std::string> defs;
+  for (int position = i_index - 1; position >= block.first; --position) {
+    defs.clear();
+    instruction_defs(*i_vec[position], defs);
+    if (std::find(defs.begin(), defs.end(), name) == defs.end()) {
+      continue;
+    }
+    if (i_vec[position]->type == op_mov) {
+      const auto& source = static_cast<const binary_instruction&>(*i_vec[position]).arg_2;
+      return is_constant(source) ? source : "";
+    }
+    return "";
+  }
+  return "";
+}
+
+bool has_relative_jump(const instruction_vec& i_vec, const basic_block& block) {
+  for (int i_index = block.first; i_index <= block.last; ++i_index) {
+    auto type = i_vec[i_index]->type;
+    if ((type == op_jmp || type == op_if) && is_constant(jump_operand(*i_vec[i_index]))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// unreachable code, nops, jumps to jumps and jumps to next instruction
+bool simplify_branches(instruction_vec& i_vec, label_table& table, const block_graph& graph,
+                       const dominator_tree& tree, instruction_edits& edits,
+                       optimization_stats& stats) {
+  bool changed = false;
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    if (tree.dfs_in[b_index] == -1) {
+      // labels may be targets of reachable jumps, declarations give slots
+      for (int i_index = block.first; i_index <= block.last; ++i_index) {
+        if (i_vec[i_index]->type != op_label && i_vec[i_index]->type != op_var) {
+          edits.erase(i_index);
+          ++stats.unreachable_instructions;
+          changed = true;
+        }
+      }
+      continue;
+    }
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      if (i_vec[i_index]->type == op_nop) {
+        edits.erase(i_index);
+        changed = true;
+      }
+    }
+    auto& instr = *i_vec[block.last];
+    if (instr.type != op_jmp && instr.type != op_if) {
+      continue;
+    }
+    auto target = branch_target(i_vec, table, block.last);
+    if (target < 0) {
+      continue;
+    }
+    auto threaded = thread_target(
+        i_vec, table, target,
+        instr.type == op_if ? static_cast<binary_instruction&>(instr).arg_1 : "");
+    // condition set by constant on the way to if which tests it
+    auto first = skip_empty(i_vec, threaded);
+    if (instr.type == op_jmp && first < i_vec.size() && i_vec[first]->type == op_if) {
+      const auto& condition = static_cast<const binary_instruction&>(*i_vec[first]).arg_1;
+      auto value = known_value(i_vec, block, block.last, condition);
+      if (!value.empty()) {
+        auto next = std::stoll(value) != 0 ? branch_target(i_vec, table, first) : first + 1;
+        threaded = next < 0 ? threaded : next;
+      }
+    }
+    if (threaded != target) {
+      jump_operand(instr) = target_operand(i_vec, block.last, threaded);
+      ++stats.threaded_jumps;
+      changed = true;
+    }
+    // both ways lead to the same instruction
+    if (skip_empty(i_vec, threaded) == skip_empty(i_vec, block.last + 1)) {
+      edits.erase(block.last);
+      ++stats.removed_jumps;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// block which is reached only by jump from other block moves in place of the jump,
+// blocks ending with ret stay as ret does not leave function
+bool merge_blocks(instruction_vec& i_vec, label_table& table, const block_graph& graph,
+                  const dominator_tree& tree, instruction_edits& edits,
+                  optimization_stats& stats) {
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    if (tree.dfs_in[b_index] == -1 || i_vec[block.last]->type != op_jmp ||
+        is_constant(jump_operand(*i_vec[block.last]))) {
+      continue;
+    }
+    auto target = branch_target(i_vec, table, block.last);
+    if (target <= 0 || target >= i_vec.size()) {
+      continue;
+    }
+    auto succ = graph.instruction_block[target];
+    const auto& succ_block = graph.blocks[succ];
+    // unreachable blocks of labels may still fall into it
+    auto reachable_preds =
+        std::count_if(succ_block.predecessors.begin(), succ_block.predecessors.end(),
+                      [&tree](int pred) { return tree.dfs_in[pred] != -1; });
+    if (succ == b_index || succ_block.first != target || reachable_preds != 1 ||
+        i_vec[succ_block.last]->type != op_jmp || has_relative_jump(i_vec, succ_block)) {
+      continue;
+    }
+    for (int i_index = succ_block.first; i_index <= succ_block.last; ++i_index) {
+      edits.insert_before(block.last, std::move(i_vec[i_index]));
+      edits.erase(i_index);
+    }
+    edits.erase(block.last);
+    ++stats.merged_blocks;
+    return true;
+  }
+  return false;
+}
+
+bool remove_unused_labels(const instruction_vec& i_vec, instruction_edits& edits) {
+  std::set<std::string> used;
+  for (const auto& instr : i_vec) {
+    if (instr->type == op_jmp || instr->type == op_if) {
+      used.insert(jump_operand(*instr));
+    }
+  }
+  bool changed = false;
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type == op_label &&
+        !used.count(static_cast<const unary_instruction&>(*i_vec[i_index]).arg_1)) {
+      edits.erase(i_index);
+      changed = true;
+    }
+  }
+  return changed;
+}
+}  // namespace
+
+void simplify_control_flow(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  simplify_control_flow(i_vec, table, analyses, stats);
+}
+
+void simplify_control_flow(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                           optimization_stats& stats) {
+  // every round removes instructions or moves block, so there are
+  // no more rounds than twice the instructions
+  for (size_t round = 0; round <= 2 * i_vec.size(); ++round) {
+    const auto& graph = analyses.blocks();
+    if (graph.blocks.empty()) {
+      return;
+    }
+    const auto& tree = analyses.dominators();
+    instruction_edits edits;
+    // blocks are moved and labels dropped only when branches settled, as jumps
+    // threaded in this round may refer to labels not used before
+    bool changed = simplify_branches(i_vec, table, graph, tree, edits, stats) ||
+                   merge_blocks(i_vec, table, graph, tree, edits, stats) ||
+                   remove_unused_labels(i_vec, edits);
+    if (!changed) {
+      return;
+    }
+    apply_instruction_edits(i_vec, table, edits);
+    analyses.invalidate();
+  }
+}
@@ -0,0 +1,406 @@
+#include "yadfa.h"
+
+std::vector<bool> find_strict_variables(const instruction_vec& i_vec, const block_graph& graph,
+                                        const dominator_tree& tree,
+                                        const variable_universe& universe,
+                                        std::vector<int>& def_positions) {
+  const int variables = universe.size();
+  def_positions.assign(variables, -1);
+  std::vector<bool> strict(variables, true);
+  std::vector<std::string> defs;
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    defs.clear();
+    instruction_defs(*i_vec[i_index], defs);
+    for (const auto& def : defs) {
+      auto var_index = universe.find(def);
+      strict[var_index] = strict[var_index] && def_positions[var_index] == -1;
+      def_positions[var_index] = i_index;
+    }
+  }
+  auto dominates_use = [&](int var_index, int b_index, int i_index) {
+    auto def_position = def_positions[var_index];
+    if (def_position == -1) {
+      return true;
+    }
+    auto def_block = graph.instruction_block[def_position];
+    if (def_block == b_index) {
+      return def_position < i_index;
+    }
+    return tree.dominates(def_block, b_index);
+  };
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    if (tree.dfs_in[b_index] == -1) {
+      continue;
+    }
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      auto& instr = *i_vec[i_index];
+      if (instr.type == op_phi) {
+        // argument is read at the end of its predecessor
+        const auto& args = static_cast<phi_instruction&>(instr).args;
+        for (size_t pred_index = 0; pred_index != args.size(); ++pred_index) {
+          const auto& pred = graph.blocks[block.predecessors[pred_index]];
+          auto var_index = universe.find(args[pred_index]);
+          if (var_index >= 0 && strict[var_index] &&
+              !dominates_use(var_index, block.predecessors[pred_index], pred.last + 1)) {
+            strict[var_index] = false;
+          }
+        }
+        continue;
+      }
+      visit_use_operands(instr, [&](std::string& arg) {
+        auto var_index = universe.find(arg);
+        if (strict[var_index] && !dominates_use(var_index, b_index, i_index)) {
+          strict[var_index] = false;
+        }
+      });
+    }
+  }
+  return strict;
+}
+
+namespace {
+std::map<std::string, std::string> declared_types(const instruction_vec& i_vec) {
+  std::map<std::string, std::string> types;
+  for (const auto& instr : i_vec) {
+    if (instr->type == op_var) {
+      auto decl = static_cast<binary_instruction*>(instr.get());
+      types.insert({decl->arg_1, decl->arg_2});
+    }
+  }
+  return types;
+}
+
+std::map<std::string, size_t> declaration_indexes(const instruction_vec& i_vec) {
+  std::map<std::string, size_t> indexes;
+  for (size_t i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type == op_var) {
+      indexes.insert({static_cast<binary_instruction*>(i_vec[i_index].get())->arg_1, i_index});
+    }
+  }
+  return indexes;
+}
+
+}  // namespace
+
+parameter_vec parameter_types(const std::vector<std::string>& signature) {
+  parameter_vec types;
+  for (size_t arg_index = 1; arg_index + 1 < signature.size(); arg_index += 2) {
+    types.emplace_back(signature[arg_index], signature[arg_index + 1]);
+  }
+  return types;
+}
+
+void construct_ssa(instruction_vec& i_vec, label_table& table,
+                   const parameter_vec& parameters) {
+  auto cfg = build_cfg(i_vec, table);
+  auto graph = build_basic_blocks(i_vec, cfg);
+  if (graph.blocks.empty()) {
+    return;
+  }
+  if (!graph.blocks[0].predecessors.empty()) {
+    // value of phi in entry block would have to come from outside of program
+    // all jumps keep their targets, as relative distances don't change
+    i_vec.insert(i_vec.begin(), std::make_unique<noarg_instruction>(op_nop));
+    update_label_table(i_vec, table);
+    cfg = build_cfg(i_vec, table);
+    graph = build_basic_blocks(i_vec, cfg);
+  }
+  const auto universe = build_variable_universe(i_vec);
+  const auto liveness = block_liveness_analysis(i_vec, graph, universe, liveness_options());
+  auto tree = build_dominator_tree(graph);
+  const auto frontiers = dominance_frontiers(graph, tree);
+
+  // only declared variables and parameters have a type for their new versions,
+  // other undeclared names are left untouched
+  auto types = declared_types(i_vec);
+  types.insert(parameters.begin(), parameters.end());
+  std::vector<bool> renamed(universe.size(), false);
+  for (size_t var_index = 0; var_index != universe.size(); ++var_index) {
+    renamed[var_index] = types.find(universe.names[var_index]) != types.end();
+  }
+
+  std::vector<std::vector<int>> def_blocks(universe.size());
+  std::vector<std::string> defs;
+  for (int b_index = 0; b_index < graph.blocks.size(); ++b_index) {
+    if (tree.dfs_in[b_index] == -1) {
+      continue;
+    }
+    for (int i_index = graph.blocks[b_index].first; i_index <= graph.blocks[b_index].last;
+         ++i_index) {
+      defs.clear();
+      instruction_defs(*i_vec[i_index], defs);
+      for (const auto& def : defs) {
+        auto var_index = universe.find(def);
+        auto& blocks = def_blocks[var_index];
+        if (blocks.empty() || blocks.back() != b_index) {
+          blocks.push_back(b_index);
+        }
+      }
+    }
+  }
+
+  // pruned SSA, phi is placed in iterated dominance frontier
+  // only where variable is live on entry
+  instruction_edits edits;
+  std::map<const instruction*, int> phi_variables;
+  std::vector<int> has_phi(graph.blocks.size(), -1);
+  std::vector<int> enqueued(graph.blocks.size(), -1);
+  for (int var_index = 0; var_index < universe.size(); ++var_index) {
+    if (!renamed[var_index]) {
+      continue;
+    }
+    auto work_list = def_blocks[var_index];
+    for (auto b_index : work_list) {
+      enqueued[b_index] = var_index;
+    }
+    while (!work_list.empty()) {
+      auto b_index = work_list.back();
+      work_list.pop_back();
+      for (auto frontier : frontiers[b_index]) {
+        if (has_phi[frontier] == var_index ||
+            !test_bit(liveness.live_in[frontier], var_index)) {
+          continue;
+        }
+        has_phi[frontier] = var_index;
+        const auto& name = universe.names[var_index];
+        auto phi = std::make_unique<phi_instruction>(
+            op_phi, name,
+            std::vector<std::string>(graph.blocks[frontier].predecessors.size(), name));
+        phi_variables[phi.get()] = var_index;
+        edits.insert_before(graph.blocks[frontier].first, std::move(phi));
+        if (enqueued[frontier] != var_index) {
+          enqueued[frontier] = var_index;
+          work_list.push_back(frontier);
+        }
+      }
+    }
+  }
+  apply_instruction_edits(i_vec, table, edits);
+  cfg = build_cfg(i_vec, table);
+  graph = build_basic_blocks(i_vec, cfg);
+  tree = build_dominator_tree(graph);
+
+  // renaming walks dominator tree keeping stack of current version per variable
+  std::set<std::string> taken_names(universe.names.begin(), universe.names.end());
+  std::vector<int> counters(universe.size(), 0);
+  std::vector<std::vector<std::string>> stacks(universe.size());
+  std::vector<std::vector<std::string>> versions(universe.size());
+  auto new_version = [&](int var_index) {
+    std::string name;
+    do {
+      name = universe.names[var_index] + "_" + std::to_string(++counters[var_index]);
+    } while (taken_names.find(name) != taken_names.end());
+    taken_names.insert(name);
+    versions[var_index].push_back(name);
+    stacks[var_index].push_back(name);
+    return name;
+  };
+
+  struct rename_frame {
+    int block;
+    size_t next_child;
+    std::vector<int> pushed;
+  };
+  std::vector<rename_frame> rename_stack;
+  auto enter_block = [&](int b_index) {
+    rename_frame frame{b_index, 0, {}};
+    const auto& block = graph.blocks[b_index];
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      auto& instr = *i_vec[i_index];
+      if (instr.type == op_phi) {
+        auto var_index = phi_variables[&instr];
+        static_cast<phi_instruction&>(instr).dest = new_version(var_index);
+        frame.pushed.push_back(var_index);
+        continue;
+      }
+      visit_use_operands(instr, [&](std::string& arg) {
+        auto var_index = universe.find(arg);
+        if (var_index >= 0 && renamed[var_index] && !stacks[var_index].empty()) {
+          arg = stacks[var_index].back();
+        }
+      });
+      visit_def_operands(instr, [&](std::string& arg) {
+        auto var_index = universe.find(arg);
+        if (var_index >= 0 && renamed[var_index]) {
+          arg = new_version(var_index);
+          frame.pushed.push_back(var_index);
+        }
+      });
+    }
+    for (auto succ : block.successors) {
+      const auto& preds = graph.blocks[succ].predecessors;
+      auto pred_index = std::find(preds.begin(), preds.end(), b_index) - preds.begin();
+      for (int i_index = graph.blocks[succ].first;
+           i_index <= graph.blocks[succ].last && i_vec[i_index]->type == op_phi; ++i_index) {
+        auto phi = static_cast<phi_instruction*>(i_vec[i_index].get());
+        auto var_index = phi_variables[phi];
+        if (!stacks[var_index].empty()) {
+          phi->args[pred_index] = stacks[var_index].back();
+        }
+      }
+    }
+    rename_stack.push_back(std::move(frame));
+  };
+  enter_block(0);
+  while (!rename_stack.empty()) {
+    auto& frame = rename_stack.back();
+    const auto& children = tree.children[frame.block];
+    if (frame.next_child < children.size()) {
+      enter_block(children[frame.next_child++]);
+      continue;
+    }
+    for (auto var_index : frame.pushed) {
+      stacks[var_index].pop_back();
+    }
+    rename_stack.pop_back();
+  }
+
+  // every version gets its own declaration next to the original one,
+  // versions of parameters are declared at start of body
+  instruction_edits declarations;
+  const auto indexes = declaration_indexes(i_vec);
+  for (int var_index = 0; var_index < universe.size(); ++var_index) {
+    const auto& name = universe.names[var_index];
+    auto declaration = indexes.find(name);
+    for (const auto& version : versions[var_index]) {
+      auto decl = std::make_unique<binary_instruction>(op_var, version, types.at(name));
+      if (declaration != indexes.end()) {
+        declarations.insert_after(declaration->second, std::move(decl));
+      } else {
+        declarations.insert_before(0, std::move(decl));
+      }
+    }
+  }
+  apply_instruction_edits(i_vec, table, declarations);
+}
+
+copy_vec sequentialize_parallel_copy(const copy_vec& copies,
+                                     const std::function<std::string(const std::string&)>& make_temp) {
+  // Boissinot et al. "Revisiting Out-of-SSA Translation for Correctness,
+  // Code Quality, and Efficiency", constants are written after all moves
+  // as they don't read any location
+  copy_vec sequence;
+  copy_vec constants;
+  std::map<std::string, std::string> location;
+  std::map<std::string, std::string> pred;
+  std::set<std::string> done;
+  std::vector<std::string> ready;
+  std::vector<std::string> to_do;
+  for (const auto& copy : copies) {
+    if (is_constant(copy.second)) {
+      constants.push_back(copy);
+      continue;
+    }
+    location[copy.second] = copy.second;
+    pred[copy.first] = copy.second;
+    to_do.push_back(copy.first);
+  }
+  for (const auto& dest : to_do) {
+    // destination which is not read by any copy can be written immediately
+    if (location.find(dest) == location.end()) {
+      ready.push_back(dest);
+    }
+  }
+  while (!to_do.empty()) {
+    while (!ready.empty()) {
+      auto dest = ready.back();
+      ready.pop_back();
+      auto source = pred[dest];
+      auto current = location[source];
+      sequence.push_back({dest, current});
+      done.insert(dest);
+      location[source] = dest;
+      if (source == current && pred.find(source) != pred.end()) {
+        ready.push_back(source);
+      }
+    }
+    auto dest = to_do.back();
+    to_do.pop_back();
+    if (done.find(dest) == done.end()) {
+      // rest is a cycle, break it by saving destination to temporary
+      auto temp = make_temp(dest);
+      sequence.push_back({temp, dest});
+      location[dest] = temp;
+      ready.push_back(dest);
+    }
+  }
+  sequence.insert(sequence.end(), constants.begin(), constants.end());
+  return sequence;
+}
+
+void destruct_ssa(instruction_vec& i_vec, label_table& table) {
+  const auto cfg = build_cfg(i_vec, table);
+  const auto graph = build_basic_blocks(i_vec, cfg);
+  const auto types = declared_types(i_vec);
+  const auto indexes = declaration_indexes(i_vec);
+  const auto universe = build_variable_universe(i_vec);
+  std::set<std::string> taken_names(universe.names.begin(), universe.names.end());
+
+  instruction_edits edits;
+  edits.erased.assign(i_vec.size(), false);
+  size_t temp_counter = 0;
+  auto make_temp = [&](const std::string& like) {
+    std::string name;
+    do {
+      name = "ssa_tmp_" + std::to_string(temp_counter++);
+    } while (taken_names.find(name) != taken_names.end());
+    taken_names.insert(name);
+    auto type_it = types.find(like);
+    auto decl = std::make_unique<binary_instruction>(
+        op_var, name, type_it == types.end() ? "int32" : type_it->second);
+    auto decl_it = indexes.find(like);
+    if (decl_it != indexes.end()) {
+      edits.insert_after(decl_it->second, std::move(decl));
+    } else {
+      edits.insert_before(0, std::move(decl));
+    }
+    return name;
+  };
+  auto emit_moves = [&](instruction_vec& group, const copy_vec& copies) {
+    for (const auto& move : sequentialize_parallel_copy(copies, make_temp)) {
+      group.push_back(std::make_unique<binary_instruction>(op_mov, move.first, move.second));
+    }
+  };
+
+  for (const auto& block : graph.blocks) {
+    std::vector<phi_instruction*> phis;
+    for (int i_index = block.first; i_index <= block.last && i_vec[i_index]->type == op_phi;
+         ++i_index) {
+      phis.push_back(static_cast<phi_instruction*>(i_vec[i_index].get()));
+      edits.erased[i_index] = true;
+    }
+    if (phis.empty()) {
+      continue;
+    }
+    for (size_t pred_index = 0; pred_index != block.predecessors.size(); ++pred_index) {
+      const auto& pred = graph.blocks[block.predecessors[pred_index]];
+      copy_vec copies;
+      for (auto phi : phis) {
+        copies.push_back({phi->dest, phi->args[pred_index]});
+      }
+      const auto last_type = i_vec[pred.last]->type;
+      if (last_type != op_if) {
+        // single successor, copies go to the end of predecessor
+        if (last_type == op_jmp || last_type == op_label) {
+          emit_moves(edits.before[pred.last], copies);
+        } else {
+          emit_moves(edits.after[pred.last], copies);
+        }
+        continue;
+      }
+      // copies on fall through edge of if are executed only when falling through
+      auto target = branch_target(i_vec, table, pred.last);
+      if (block.first == pred.last + 1) {
+        emit_moves(edits.after[pred.last], copies);
+        if (target != block.first) {
+          continue;
+        }
+      }
+      instruction_vec moves;
+      emit_moves(moves, copies);
+      insert_on_taken_edge(i_vec, table, edits, pred.last, std::move(moves), "ssa_");
+    }
+  }
+  apply_instruction_edits(i_vec, table, edits);
+}
@@ -0,0 +1,92 @@
+#include "yadfa.h"
+
+namespace {
+// depth of stack relative to entry of program, joined over all paths to block
+struct stack_depth {
+  enum state { unknown, known };
+  state kind = unknown;
+  int depth = 0;
+};
+}  // namespace
+
+void replace_stack_operations(instruction_vec& i_vec, label_table& table,
+                              optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  replace_stack_operations(i_vec, table, analyses, stats);
+}
+
+void replace_stack_operations(instruction_vec& i_vec, label_table& table,
+                              analysis_manager& analyses, optimization_stats& stats) {
+  const auto& graph = analyses.blocks();
+  if (graph.blocks.empty()) {
+    return;
+  }
+  bool has_stack_operations = std::any_of(i_vec.begin(), i_vec.end(), [](const instruction_ptr& instr) {
+    return instr->type == op_push || instr->type == op_pop;
+  });
+  if (!has_stack_operations) {
+    return;
+  }
+
+  // every path has to reach block with the same depth and no pop
+  // may take value pushed before entry, otherwise stack stays as it is
+  std::vector<stack_depth> entry_depths(graph.blocks.size());
+  entry_depths[0] = {stack_depth::known, 0};
+  std::vector<int> work_list = {0};
+  int max_depth = 0;
+  while (!work_list.empty()) {
+    auto b_index = work_list.back();
+    work_list.pop_back();
+    const auto& block = graph.blocks[b_index];
+    auto depth = entry_depths[b_index].depth;
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      if (i_vec[i_index]->type == op_push) {
+        max_depth = std::max(max_depth, ++depth);
+      } else if (i_vec[i_index]->type == op_pop && --depth < 0) {
+        return;
+      }
+    }
+    for (auto succ : block.successors) {
+      auto& succ_depth = entry_depths[succ];
+      if (succ_depth.kind == stack_depth::unknown) {
+        succ_depth = {stack_depth::known, depth};
+        work_list.push_back(succ);
+      } else if (succ_depth.depth != depth) {
+        return;
+      }
+    }
+  }
+
+  // value pushed at depth d lives in variable of slot d until it is popped
+  const auto& universe = analyses.universe();
+  std::vector<std::string> slots;
+  instruction_edits edits;
+  for (int depth = 0; depth != max_depth; ++depth) {
+    auto slot = "stack_slot_" + std::to_string(depth);
+    while (universe.find(slot) >= 0) {
+      slot += '_';
+    }
+    slots.push_back(slot);
+    edits.insert_before(0, std::make_unique<binary_instruction>(op_var, slot, "int32"));
+  }
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    if (entry_depths[b_index].kind != stack_depth::known) {
+      continue;
+    }
+    auto depth = entry_depths[b_index].depth;
+    for (int i_index = block.first; i_index <= block.last; ++i_index) {
+      auto& instr = i_vec[i_index];
+      if (instr->type == op_push) {
+        const auto& arg = static_cast<unary_instruction&>(*instr).arg_1;
+        instr = std::make_unique<binary_instruction>(op_mov, slots[depth++], arg);
+        ++stats.replaced_stack_operations;
+      } else if (instr->type == op_pop) {
+        const auto& arg = static_cast<unary_instruction&>(*instr).arg_1;
+        instr = std::make_unique<binary_instruction>(op_mov, arg, slots[--depth]);
+        ++stats.replaced_stack_operations;
+      }
+    }
+  }
+  apply_instruction_edits(i_vec, table, edits);
+}
@@ -0,0 +1,123 @@
+#include "yadfa.h"
+
+int power_of_two_exponent(uint32_t value) {
+  if (value == 0 || (value & (value - 1)) != 0) {
+    return -1;
+  }
+  int exponent = 0;
+  while ((uint32_t(1) << exponent) != value) {
+    ++exponent;
+  }
+  return exponent;
+}
+
+division_magic signed_division_magic(int32_t divisor) {
+  // Warren, "Hacker's Delight" 10-1, the smallest shift
+  // whose multiplier gives exact quotient for all 32 bit dividends
+  const uint32_t two31 = 0x80000000u;
+  const uint32_t abs_divisor = divisor < 0 ? 0u - static_cast<uint32_t>(divisor) : divisor;
+  const uint32_t t = two31 + (static_cast<uint32_t>(divisor) >> 31);
+  const uint32_t abs_nc = t - 1 - t % abs_divisor;
+  int p = 31;
+  uint32_t q1 = two31 / abs_nc;
+  uint32_t r1 = two31 - q1 * abs_nc;
+  uint32_t q2 = two31 / abs_divisor;
+  uint32_t r2 = two31 - q2 * abs_divisor;
+  uint32_t delta = 0;
+  do {
+    ++p;
+    q1 *= 2;
+    r1 *= 2;
+    if (r1 >= abs_nc) {
+      ++q1;
+      r1 -= abs_nc;
+    }
+    q2 *= 2;
+    r2 *= 2;
+    if (r2 >= abs_divisor) {
+      ++q2;
+      r2 -= abs_divisor;
+    }
+    delta = abs_divisor - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  division_magic magic;
+  magic.multiplier = static_cast<int32_t>(divisor < 0 ? 0u - (q2 + 1) : q2 + 1);
+  magic.shift = p - 32;
+  return magic;
+}
+
+division_magic unsigned_division_magic(uint32_t divisor) {
+  // Warren, "Hacker's Delight" 10-9, multiplier which does not fit
+  // in 32 bits is kept without its top bit and add is set
+  const uint32_t nc = static_cast<uint32_t>(-1) - (0u - divisor) % divisor;
+  int p = 31;
+  uint32_t q1 = 0x80000000u / nc;
+  uint32_t r1 = 0x80000000u - q1 * nc;
+  uint32_t q2 = 0x7FFFFFFFu / divisor;
+  uint32_t r2 = 0x7FFFFFFFu - q2 * divisor;
+  uint32_t delta = 0;
+  division_magic magic;
+  do {
+    ++p;
+    if (r1 >= nc - r1) {
+      q1 = 2 * q1 + 1;
+      r1 = 2 * r1 - nc;
+    } else {
+      q1 = 2 * q1;
+      r1 = 2 * r1;
+    }
+    if (r2 + 1 >= divisor - r2) {
+      if (q2 >= 0x7FFFFFFFu) {
+        magic.add = true;
+      }
+      q2 = 2 * q2 + 1;
+      r2 = 2 * r2 + 1 - divisor;
+    } else {
+      if (q2 >= 0x80000000u) {
+        magic.add = true;
+      }
+      q2 = 2 * q2;
+      r2 = 2 * r2 + 1;
+    }
+    delta = divisor - 1 - r2;
+  } while (p < 64 && (q1 < delta || (q1 == delta && r1 == 0)));
+  magic.multiplier = static_cast<int32_t>(q2 + 1);
+  magic.shift = p - 32;
+  return magic;
+}
+
+void reduce_strength(instruction_vec& i_vec, label_table& table, optimization_stats& stats) {
+  for (auto& instr : i_vec) {
+    if (instr->type != op_mul && instr->type != op_div && instr->type != op_udiv) {
+      continue;
+    }
+    auto op = static_cast<three_addr_instruction*>(instr.get());
+    // constant factor goes right, where emitter looks for it
+    if (instr->type == op_mul && is_constant(op->arg_2) && !is_constant(op->arg_3)) {
+      std::swap(op->arg_2, op->arg_3);
+    }
+    if (!is_constant(op->arg_3) || is_constant(op->arg_2)) {
+      continue;
+    }
+    auto constant = static_cast<int32_t>(std::stoll(op->arg_3));
+    if (instr->type == op_mul) {
+      auto exponent = power_of_two_exponent(static_cast<uint32_t>(constant));
+      if (constant == 0 || constant == 1) {
+        instr = std::make_unique<binary_instruction>(op_mov, op->arg_1,
+                                                     constant == 0 ? "0" : op->arg_2);
+      } else if (constant == -1) {
+        instr = std::make_unique<three_addr_instruction>(op_sub, op->arg_1, "0", op->arg_2);
+      } else if (exponent > 0) {
+        instr = std::make_unique<three_addr_instruction>(op_shl, op->arg_1, op->arg_2,
+                                                         std::to_string(exponent));
+      } else {
+        continue;
+      }
+      ++stats.reduced_operations;
+    } else if (constant == 1) {
+      // the only division by constant which is a plain copy
+      instr = std::make_unique<binary_instruction>(op_mov, op->arg_1, op->arg_2);
+      ++stats.reduced_operations;
+    }
+  }
+}
@@ -0,0 +1,204 @@
+#include "yadfa.h"
+
+namespace {
+using function_body_map = std::map<std::string, const function_instruction*>;
+
+// effects of body itself and of calls of functions already summarized,
+// callees without summary yet are in the same strongly connected component
+function_summary summarize_body(const function_instruction& function,
+                                const function_summary_map& summaries) {
+  function_summary summary;
+  const auto& body = function.body;
+  std::map<std::string, size_t> parameters;
+  for (const auto& parameter : parameter_types(function.args)) {
+    auto parameter_index = parameters.size();
+    parameters[parameter.first] = parameter_index;
+  }
+  summary.reads_args.assign(parameters.size(), false);
+  std::vector<std::string> uses;
+  for (size_t i_index = 0; i_index != body.size(); ++i_index) {
+    const auto& instr = *body[i_index];
+    uses.clear();
+    instruction_uses(instr, uses);
+    for (const auto& use : uses) {
+      auto parameter_it = parameters.find(use);
+      if (parameter_it != parameters.end()) {
+        summary.reads_args[parameter_it->second] = true;
+      }
+    }
+    switch (instr.type) {
+      case op_new:
+      case op_delete:
+        summary.effects |= effect_memory;
+        break;
+      case op_push:
+      case op_pop:
+        summary.effects |= effect_stack;
+        break;
+      case op_jmp:
+      case op_if: {
+        const auto& target = instr.type == op_jmp
+                                 ? static_cast<const unary_instruction&>(instr).arg_1
+                                 : static_cast<const binary_instruction&>(instr).arg_2;
+        // only backward jumps make loops, label of body may be anywhere
+        if (!is_constant(target) || std::stoi(target) <= 0) {
+          summary.effects |= effect_may_not_return;
+        }
+        break;
+      }
+      case op_call: {
+        auto callee = summaries.find(static_cast<const call_instruction&>(instr).args.front());
+        if (callee == summaries.end()) {
+          summary.effects |= effect_io | effect_memory | effect_stack | effect_may_not_return;
+        } else {
+          summary.effects |= callee->second.effects;
+        }
+        break;
+      }
+      default:
+        if (may_trap(instr)) {
+          summary.effects |= effect_may_not_return;
+        }
+        break;
+    }
+  }
+  return summary;
+}
+
+// Tarjan's strongly connected components, finished in reverse topological
+// order, so every callee outside component is summarized before its callers
+struct call_graph_walk {
+  call_graph_walk(const function_body_map& functions, function_summary_map& summaries)
+      : functions(functions), summaries(summaries) {}
+
+  std::vector<std::string> callees(const std::string& name) const {
+    std::vector<std::string> result;
+    for (const auto& instr : functions.at(name)->body) {
+      if (instr->type == op_call) {
+        const auto& callee = static_cast<const call_instruction&>(*instr).args.front();
+        if (functions.find(callee) != functions.end()) {
+          result.push_back(callee);
+        }
+      }
+    }
+    return result;
+  }
+
+  void visit(const std::string& name) {
+    indexes[name] = low_links[name] = next_index++;
+    stack.push_back(name);
+    on_stack.insert(name);
+    for (const auto& callee : callees(name)) {
+      if (indexes.find(callee) == indexes.end()) {
+        visit(callee);
+        low_links[name] = std::min(low_links[name], low_links[callee]);
+      } else if (on_stack.count(callee)) {
+        low_links[name] = std::min(low_links[name], indexes[callee]);
+      }
+    }
+    if (low_links[name] != indexes[name]) {
+      return;
+    }
+    std::vector<std::string> component;
+    do {
+      component.push_back(stack.back());
+      on_stack.erase(stack.back());
+      stack.pop_back();
+    } while (component.back() != name);
+    summarize_component(component);
+  }
+
+  void summarize_component(const std::vector<std::string>& component) {
+    bool recursive = component.size() > 1;
+    for (const auto& callee : callees(component.front())) {
+      recursive = recursive || callee == component.front();
+    }
+    // members see each other as empty summaries until effects stop growing
+    for (const auto& name : component) {
+      summaries[name] = function_summary();
+    }
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (const auto& name : component) {
+        auto summary = summarize_body(*functions.at(name), summaries);
+        if (recursive) {
+          summary.effects |= effect_may_not_return;
+        }
+        if (summary.effects != summaries[name].effects) {
+          changed = true;
+        }
+        summaries[name] = summary;
+      }
+    }
+  }
+
+  const function_body_map& functions;
+  function_summary_map& summaries;
+  std::map<std::string, int> indexes;
+  std::map<std::string, int> low_links;
+  std::vector<std::string> stack;
+  std::set<std::string> on_stack;
+  int next_index = 0;
+};
+
+}  // namespace
+
+function_summary_map summarize_functions(const instruction_vec& program,
+                                         const builtin_functions_map& builtin_functions) {
+  function_summary_map summaries;
+  for (const auto& builtin : builtin_functions) {
+    function_summary summary;
+    summary.effects = builtin.second.effects;
+    summary.reads_args.assign(builtin.second.args.size(), true);
+    summaries[builtin.first] = summary;
+  }
+  function_body_map functions;
+  for (const auto& instr : program) {
+    if (instr->type == op_function) {
+      auto function = static_cast<const function_instruction*>(instr.get());
+      functions[function->args.front()] = function;
+    }
+  }
+  call_graph_walk walk(functions, summaries);
+  for (const auto& function : functions) {
+    if (walk.indexes.find(function.first) == walk.indexes.end()) {
+      walk.visit(function.first);
+    }
+  }
+  return summaries;
+}
+
+void simplify_calls(instruction_vec& i_vec, label_table& table,
+                    const function_summary_map& summaries, optimization_stats& stats) {
+  std::vector<bool> erased(i_vec.size(), false);
+  bool has_erased = false;
+  for (size_t i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type != op_call) {
+      continue;
+    }
+    auto& args = static_cast<call_instruction&>(*i_vec[i_index]).args;
+    auto summary = summaries.find(args.front());
+    if (summary == summaries.end()) {
+      continue;
+    }
+    // call without result has nothing to give but its effects
+    if (summary->second.is_pure()) {
+      erased[i_index] = true;
+      has_erased = true;
+      ++stats.removed_pure_calls;
+      continue;
+    }
+    const auto& reads_args = summary->second.reads_args;
+    for (size_t arg_index = 1; arg_index < args.size() && arg_index <= reads_args.size();
+         ++arg_index) {
+      if (!reads_args[arg_index - 1] && !is_constant(args[arg_index])) {
+        args[arg_index] = "0";
+        ++stats.unread_call_arguments;
+      }
+    }
+  }
+  if (has_erased) {
+    erase_instructions(i_vec, table, erased);
+  }
+}
@@ -0,0 +1,106 @@
+#include "yadfa.h"
+
+namespace {
+// ret does not leave function in generated code, so call is in tail position
+// when nothing but labels, nops and jumps lie between it and end of body
+bool is_tail_position(const instruction_vec& i_vec, const label_table& table, int i_index) {
+  std::set<int> visited;
+  auto position = i_index + 1;
+  while (position >= 0 && position < i_vec.size() && visited.insert(position).second) {
+    auto type = i_vec[position]->type;
+    if (type == op_jmp) {
+      position = branch_target(i_vec, table, position);
+    } else if (type == op_label || type == op_nop || type == op_ret) {
+      ++position;
+    } else {
+      return false;
+    }
+  }
+  return position == i_vec.size();
+}
+
+std::set<std::string> variable_names(const instruction_vec& i_vec) {
+  std::set<std::string> names;
+  std::vector<std::string> args;
+  for (const auto& instr : i_vec) {
+    args.clear();
+    if (instr->type == op_var) {
+      args.push_back(static_cast<const binary_instruction&>(*instr).arg_1);
+    }
+    instruction_uses(*instr, args);
+    instruction_defs(*instr, args);
+    names.insert(args.begin(), args.end());
+  }
+  return names;
+}
+}  // namespace
+
+bool is_tail_call(const instruction_vec& i_vec, const label_table& table, int i_index) {
+  if (i_vec[i_index]->type != op_call || !is_tail_position(i_vec, table, i_index)) {
+    return false;
+  }
+  // objects on stack of caller may be passed to callee
+  return std::none_of(i_vec.begin(), i_vec.end(),
+                      [](const instruction_ptr& instr) { return instr->type == op_alloca; });
+}
+
+void eliminate_tail_recursion(instruction_vec& i_vec, label_table& table,
+                              const std::vector<std::string>& signature,
+                              optimization_stats& stats) {
+  const auto& name = signature.front();
+  const auto formals = parameter_types(signature);
+  auto names = variable_names(i_vec);
+  std::string entry_label;
+  instruction_edits edits;
+  for (int i_index = 0; i_index != i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type != op_call) {
+      continue;
+    }
+    const auto& args = static_cast<const call_instruction&>(*i_vec[i_index]).args;
+    if (args.front() != name || formals.size() + 1 != args.size() ||
+        !is_tail_call(i_vec, table, i_index)) {
+      continue;
+    }
+    if (entry_label.empty()) {
+      entry_label = fresh_label(table, name + "_entry_");
+      edits.insert_before(0, std::make_unique<unary_instruction>(op_label, entry_label));
+    }
+    // parameters are assigned in order, argument which is parameter
+    // assigned before it is copied first
+    std::map<std::string, size_t> parameters;
+    for (size_t arg_index = 0; arg_index != formals.size(); ++arg_index) {
+      parameters[formals[arg_index].first] = arg_index;
+    }
+    std::vector<std::string> sources(args.begin() + 1, args.end());
+    for (size_t arg_index = 0; arg_index != sources.size(); ++arg_index) {
+      auto& source = sources[arg_index];
+      auto parameter = parameters.find(source);
+      if (parameter == parameters.end() || parameter->second >= arg_index ||
+          args[parameter->second + 1] == source) {
+        continue;
+      }
+      auto copy = "tail_" + source;
+      for (size_t counter = 0; names.count(copy); ++counter) {
+        copy = "tail_" + source + "_" + std::to_string(counter);
+      }
+      names.insert(copy);
+      const auto& type = formals[parameter->second].second;
+      edits.insert_before(i_index, std::make_unique<binary_instruction>(op_var, copy, type));
+      edits.insert_before(i_index, std::make_unique<binary_instruction>(op_mov, copy, source));
+      source = copy;
+    }
+    for (size_t arg_index = 0; arg_index != sources.size(); ++arg_index) {
+      const auto& parameter = formals[arg_index].first;
+      if (sources[arg_index] != parameter) {
+        edits.insert_before(
+            i_index, std::make_unique<binary_instruction>(op_mov, parameter, sources[arg_index]));
+      }
+    }
+    edits.insert_before(i_index, std::make_unique<unary_instruction>(op_jmp, entry_label));
+    edits.erase(i_index);
+    ++stats.eliminated_tail_calls;
+  }
+  if (!entry_label.empty()) {
+    apply_instruction_edits(i_vec, table, edits);
+  }
+}
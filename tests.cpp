@@ -2,6 +2,81 @@
 
 #include "yadfa.h"
 
+namespace {
+std::vector<int32_t> recorded_values;
+
+void record_value(int32_t value) {
+  recorded_values.push_back(value);
+}
+
+// record passes its argument to recorded_values
+builtin_functions_map record_builtins() {
+  builtin_functions_map builtins;
+  builtins["record"] = builtin_function{(void*)record_value, {type_int32}, effect_io};
+  return builtins;
+}
+
+// i counts from 0 while it is below bound, body runs before i steps and exit
+// after loop, bound which is not known is computed by addition so it is not
+// constant before sccp either
+instruction_vec make_counting_loop(const std::string& bound, bool known, instruction_vec prologue,
+                                   instruction_vec body, instruction_vec exit) {
+  instruction_vec program;
+  for (auto name : {"i", "c", "n"}) {
+    program.push_back(std::make_unique<binary_instruction>(op_var, name, "int32"));
+  }
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "n", "0"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "n", "n", bound));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "i", "0"));
+  auto append = [&program](instruction_vec& part) {
+    std::move(part.begin(), part.end(), std::back_inserter(program));
+  };
+  append(prologue);
+  program.push_back(std::make_unique<unary_instruction>(op_label, "loop"));
+  append(body);
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "1"));
+  program.push_back(
+      std::make_unique<three_addr_instruction>(op_cmp_lt, "c", "i", known ? bound : "n"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "loop"));
+  append(exit);
+  return program;
+}
+
+// counting loop which sums i in s and records s and i after it
+instruction_vec make_sum_loop(const std::string& bound, bool known) {
+  instruction_vec prologue;
+  prologue.push_back(std::make_unique<binary_instruction>(op_var, "s", "int32"));
+  prologue.push_back(std::make_unique<binary_instruction>(op_mov, "s", "0"));
+  instruction_vec body;
+  body.push_back(std::make_unique<three_addr_instruction>(op_add, "s", "s", "i"));
+  instruction_vec exit;
+  exit.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "s"}));
+  exit.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "i"}));
+  return make_counting_loop(bound, known, std::move(prologue), std::move(body), std::move(exit));
+}
+
+// count(5) records 5 + 4 + 3 + 2 + 1, its parameter is assigned in loop
+instruction_vec make_parameter_loop_program(label_table& table) {
+  instruction_vec body;
+  body.push_back(std::make_unique<binary_instruction>(op_var, "s", "int32"));
+  body.push_back(std::make_unique<binary_instruction>(op_var, "c", "int32"));
+  body.push_back(std::make_unique<binary_instruction>(op_mov, "s", "0"));
+  body.push_back(std::make_unique<unary_instruction>(op_label, "top"));
+  body.push_back(std::make_unique<three_addr_instruction>(op_add, "s", "s", "n"));
+  body.push_back(std::make_unique<three_addr_instruction>(op_sub, "n", "n", "1"));
+  body.push_back(std::make_unique<three_addr_instruction>(op_cmp_gt, "c", "n", "0"));
+  body.push_back(std::make_unique<binary_instruction>(op_if, "c", "top"));
+  body.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "s"}));
+  body.push_back(std::make_unique<noarg_instruction>(op_ret));
+  update_label_table(body, table);
+  instruction_vec program;
+  program.push_back(std::make_unique<function_instruction>(
+      op_function, std::vector<std::string>{"count", "n", "int32"}, std::move(body)));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"count", "5"}));
+  return program;
+}
+}  // namespace
+
 void test_build_instruction_vec_by_hand() {
   instruction_vec program;
   program.push_back(std::make_unique<binary_instruction>(op_var, "a", "int32"));
@@ -44,3 +119,1259 @@ void test_jmp_code() {
   control_flow_graph expected_cfg = {{0, 1}, {1, 2}, {2, 3}, {3, 4}, {4, 2}};
   assert(cfg == expected_cfg);
 }
+
+void test_parallel_liveness() {
+  // chain of variables wide enough to span several partitions
+  // with a loop so that fixpoint needs more than one pass
+  instruction_vec program;
+  constexpr int variables = 300;
+  for (int var_index = 0; var_index != variables; ++var_index) {
+    program.push_back(std::make_unique<binary_instruction>(
+        op_var, "v" + std::to_string(var_index), "int32"));
+  }
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "v0", "1"));
+  for (int var_index = 1; var_index != variables; ++var_index) {
+    program.push_back(std::make_unique<three_addr_instruction>(
+        op_add, "v" + std::to_string(var_index), "v" + std::to_string(var_index - 1),
+        "v" + std::to_string(variables - var_index)));
+  }
+  program.push_back(std::make_unique<binary_instruction>(op_if, "v1", "-200"));
+  program.push_back(std::make_unique<noarg_instruction>(op_nop));
+  label_table table;
+  auto cfg = build_cfg(program, table);
+  auto serial = liveness_analysis(program, cfg);
+  for (size_t partition_bits : {64, 512}) {
+    liveness_options options;
+    options.partition_bits = partition_bits;
+    options.threads = 4;
+    auto parallel = liveness_analysis(program, cfg, options);
+    assert(serial.size() == parallel.size());
+    for (const auto& node : serial) {
+      assert(node.second.in_set == parallel[node.first].in_set);
+      assert(node.second.out_set == parallel[node.first].out_set);
+    }
+  }
+  // v50 is read inside of the loop and never written there
+  // so it stays live around the back edge
+  const auto& live_out = serial[variables + variables];
+  assert(std::find(live_out.out_set.begin(), live_out.out_set.end(), "v50") !=
+         live_out.out_set.end());
+}
+
+void test_live_intervals() {
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "a", "1"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "a"}));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "b", "2"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "a", "3"));
+  // loop reading b written before the loop
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "a", "a", "b"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "a"}));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "a", "-2"));
+  program.push_back(std::make_unique<noarg_instruction>(op_nop));
+  label_table table;
+  auto cfg = build_cfg(program, table);
+  auto graph = build_basic_blocks(program, cfg);
+  auto universe = build_variable_universe(program);
+  auto liveness = block_liveness_analysis(program, graph, universe, liveness_options());
+  auto intervals = build_live_intervals(program, graph, universe, liveness);
+  const auto& a = intervals[universe.find("a")];
+  std::vector<live_range> expected_a = {{0, 1}, {3, 6}};
+  assert(a.ranges == expected_a);
+  std::vector<size_t> expected_a_uses = {0, 1, 3, 4, 5, 6};
+  assert(a.use_positions == expected_a_uses);
+  const auto& b = intervals[universe.find("b")];
+  std::vector<live_range> expected_b = {{2, 6}};
+  assert(b.ranges == expected_b);
+}
+
+void test_coalesce_copies() {
+  // both representations of interference graph behave the same
+  for (size_t nodes : {size_t(16), interference_matrix_limit + 16}) {
+    interference_graph graph(nodes);
+    graph.add_edge(1, 2);
+    graph.add_edge(2, 3);
+    graph.add_edge(3, 1);
+    graph.add_edge(3, 1);
+    assert(graph.interfere(2, 1) && graph.degree(3) == 2);
+    graph.add_edge(4, 5);
+    // node with fewer neighbours moves into the other one
+    assert(graph.merge(4, 3) == 3);
+    assert(!graph.interfere(4, 5) && graph.interfere(3, 5) && graph.interfere(1, 3));
+    assert(graph.neighbours(3) == std::vector<int>({1, 2, 5}) && graph.degree(3) == 3);
+    assert(graph.neighbours(4).empty() && graph.degree(5) == 1);
+    // neighbour of both keeps one edge
+    graph.add_edge(6, 1);
+    assert(graph.merge(3, 6) == 3 && graph.degree(1) == 2 && graph.degree(3) == 3);
+  }
+
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_var, "e", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "f", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "g", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "e", "3"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "f", "e"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "g", "e", "f"));
+  // g is redefined while its copy is alive, so it interferes with f
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "f", "g"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "g", "g", "g"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "g", "g", "f"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "g"}));
+  label_table table;
+  assert(coalesce_copies(program, table) == 1);
+  std::string expected[] = {"var f int32", "var g int32", "mov f 3", "add g f f",
+                            "mov f g", "add g g g", "add g g f", "call writeln (g)"};
+  assert(program.size() == 8);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+}
+
+void test_ssa() {
+  // swap cycle, fan out of a and constant have to keep parallel semantics
+  copy_vec copies = {{"a", "b"}, {"b", "a"}, {"c", "a"}, {"d", "5"}};
+  int temps = 0;
+  auto sequence = sequentialize_parallel_copy(copies, [&temps](const std::string&) {
+    return "t" + std::to_string(temps++);
+  });
+  std::map<std::string, int> values = {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}};
+  for (const auto& move : sequence) {
+    values[move.first] = is_constant(move.second) ? std::stoi(move.second) : values[move.second];
+  }
+  assert(values["a"] == 2 && values["b"] == 1 && values["c"] == 1 && values["d"] == 5);
+  // copy of a to c already breaks the cycle
+  assert(temps == 0 && sequence.size() == 4);
+  // pure swap needs temporary
+  sequence = sequentialize_parallel_copy({{"a", "b"}, {"b", "a"}}, [&temps](const std::string&) {
+    return "t" + std::to_string(temps++);
+  });
+  values = {{"a", 1}, {"b", 2}};
+  for (const auto& move : sequence) {
+    values[move.first] = values[move.second];
+  }
+  assert(values["a"] == 2 && values["b"] == 1);
+  assert(temps == 1 && sequence.size() == 3);
+
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_var, "a", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "a", "1"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "a", "2"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "a", "2"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "a"}));
+  label_table table;
+  construct_ssa(program, table);
+  std::string expected[] = {"var a int32", "var a_1 int32", "var a_2 int32", "var a_3 int32",
+                            "mov a_1 1",   "if a_1 2",      "mov a_2 2",     "phi a_3 (a_1 a_2)",
+                            "call writeln (a_3)"};
+  assert(program.size() == 9);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+
+  // parameter counted down in loop gets versions, entry value is read only by phi
+  instruction_vec body;
+  body.push_back(std::make_unique<binary_instruction>(op_var, "c", "int32"));
+  body.push_back(std::make_unique<unary_instruction>(op_label, "down"));
+  body.push_back(std::make_unique<three_addr_instruction>(op_sub, "n", "n", "1"));
+  body.push_back(std::make_unique<three_addr_instruction>(op_cmp_gt, "c", "n", "0"));
+  body.push_back(std::make_unique<binary_instruction>(op_if, "c", "down"));
+  body.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "n"}));
+  update_label_table(body, table);
+  construct_ssa(body, table, parameter_types({"count", "n", "int32"}));
+  std::string renamed[] = {"var n_1 int32",      "var n_2 int32",     "var c int32",
+                           "var c_1 int32",      "label down:",       "phi n_1 (n n_2)",
+                           "sub n_2 n_1 1",      "cmp_gt c_1 n_2 0",  "if c_1 down",
+                           "call writeln (n_2)"};
+  assert(body.size() == 10);
+  for (size_t i_index = 0; i_index != body.size(); ++i_index) {
+    std::ostringstream instr;
+    body[i_index]->dump(instr);
+    assert(instr.str() == renamed[i_index]);
+  }
+
+  // count down loop keeps its sum through sccp and out of ssa
+  auto loop_program = make_parameter_loop_program(table);
+  auto& function = static_cast<function_instruction&>(*loop_program.front());
+  construct_ssa(function.body, table, parameter_types(function.args));
+  optimization_stats stats;
+  propagate_constants(function.body, table, stats);
+  destruct_ssa(function.body, table);
+  auto builtins = record_builtins();
+  recorded_values.clear();
+  exec(loop_program, table, builtins);
+  assert((recorded_values == std::vector<int32_t>{15}));
+}
+
+void test_sccp() {
+  // comparison of two constants decides branch, so only one value reaches phi
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_var, "a", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "b", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "c", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "a", "4"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "b", "5"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_eq, "c", "a", "b"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "2"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "a", "7"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "b", "a", "b"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "b"}));
+  label_table table;
+  construct_ssa(program, table);
+  optimization_stats stats;
+  propagate_constants(program, table, stats);
+  std::string expected[] = {"mov a_1 4", "mov b_1 5", "mov c_1 0",  "nop\n",
+                            "mov a_2 7", "mov a_3 7", "mov b_2 12", "call writeln (12)"};
+  assert(program.size() == 17);
+  for (size_t i_index = 0; i_index != 8; ++i_index) {
+    std::ostringstream instr;
+    program[i_index + 9]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.folded_branches == 1);
+}
+
+void test_gvn() {
+  // b repeats a with swapped operands, d is not available after join
+  instruction_vec program;
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "x"));
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "y"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "a", "x", "y"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "b", "y", "x"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_lt, "c", "x", "y"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "2"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "d", "a", "b"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "e", "x", "y"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "f", "b", "a"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "f"}));
+  label_table table;
+  optimization_stats stats;
+  number_values(program, table, stats);
+  std::string expected[] = {"pop x",     "pop y",     "add a x y",  "mov b a", "cmp_lt c x y",
+                            "if c 2",    "mul d a a", "mov e a",    "mul f a a", "call writeln (f)"};
+  assert(program.size() == 10);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.redundant_expressions == 2);
+}
+
+void test_lazy_code_motion() {
+  // a + b is computed on one side of diamond and again after join
+  instruction_vec program;
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "a"));
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "b"));
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "c"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "3"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "x", "a", "b"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "2"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "x", "0"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "y", "b", "a"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "y"}));
+  label_table table;
+  optimization_stats stats;
+  eliminate_partial_redundancies(program, table, stats);
+  std::string expected[] = {"var pre_tmp_0 int32", "pop a",      "pop b",
+                            "pop c",               "if c 4",     "add pre_tmp_0 a b",
+                            "mov x pre_tmp_0",     "jmp 3",      "mov x 0",
+                            "add pre_tmp_0 a b",   "mov y pre_tmp_0", "call writeln (y)"};
+  assert(program.size() == 12);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.partially_redundant_expressions == 1);
+
+  // quotient which may trap stays after output of path which did not compute it
+  instruction_vec trapping;
+  trapping.push_back(std::make_unique<unary_instruction>(op_pop, "a"));
+  trapping.push_back(std::make_unique<unary_instruction>(op_pop, "b"));
+  trapping.push_back(std::make_unique<unary_instruction>(op_pop, "c"));
+  trapping.push_back(std::make_unique<binary_instruction>(op_if, "c", "other"));
+  trapping.push_back(std::make_unique<three_addr_instruction>(op_div, "t", "a", "b"));
+  trapping.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "t"}));
+  trapping.push_back(std::make_unique<unary_instruction>(op_jmp, "join"));
+  trapping.push_back(std::make_unique<unary_instruction>(op_label, "other"));
+  trapping.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "7"}));
+  trapping.push_back(std::make_unique<unary_instruction>(op_label, "join"));
+  trapping.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "9"}));
+  trapping.push_back(std::make_unique<three_addr_instruction>(op_div, "u", "a", "b"));
+  trapping.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "u"}));
+  update_label_table(trapping, table);
+  optimization_stats trapping_stats;
+  eliminate_partial_redundancies(trapping, table, trapping_stats);
+  assert(trapping.size() == 13 && trapping_stats.partially_redundant_expressions == 0);
+}
+
+void test_value_ranges() {
+  // counter of loop stays in [0, 9] inside and is 10 after it
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_var, "i", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "q", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "c", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "i", "0"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_lt, "c", "i", "10"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "2"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "6"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "q", "i", "4"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "q", "q", "i"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "q"}));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "1"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "-7"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_gte, "c", "i", "10"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "c"}));
+  label_table table;
+  construct_ssa(program, table);
+  auto universe = build_variable_universe(program);
+  auto ranges = analyze_value_ranges(program, table, universe);
+  // phi of counter merges 0 and 10
+  auto counter = std::find_if(program.begin(), program.end(), [](const instruction_ptr& instr) {
+    return instr->type == op_phi && static_cast<phi_instruction&>(*instr).dest.front() == 'i';
+  });
+  assert(counter != program.end());
+  auto counter_range = ranges[universe.find(static_cast<phi_instruction&>(**counter).dest)];
+  assert(counter_range.lo == 0 && counter_range.hi == 10);
+
+  optimization_stats stats;
+  simplify_by_value_ranges(program, table, stats);
+  std::map<instruction_type, int> types;
+  for (const auto& instr : program) {
+    ++types[instr->type];
+  }
+  assert(types[op_sar] == 1 && types[op_udiv] == 1 && types[op_div] == 0);
+  assert(types[op_cmp_gte] == 0 && types[op_cmp_lt] == 1);
+  assert(stats.known_comparisons == 1 && stats.narrowed_operations == 2);
+}
+
+void test_escape_analysis() {
+  // p is only copied and deleted, r is passed to call and stays on heap
+  instruction_vec program;
+  program.push_back(std::make_unique<unary_instruction>(op_new, "p"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "q", "p"));
+  program.push_back(std::make_unique<unary_instruction>(op_delete, "q"));
+  program.push_back(std::make_unique<unary_instruction>(op_new, "r"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "r"}));
+  program.push_back(std::make_unique<unary_instruction>(op_delete, "r"));
+  label_table table;
+  optimization_stats stats;
+  promote_allocations(program, table, stats);
+  std::string expected[] = {"alloca p", "mov q p", "new r", "call writeln (r)", "delete r"};
+  assert(program.size() == 5);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.promoted_allocations == 1);
+
+  // object of previous iteration is still held by q when new runs again
+  program.clear();
+  program.push_back(std::make_unique<unary_instruction>(op_new, "p"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_eq, "c", "p", "q"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "q", "p"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "-3"));
+  promote_allocations(program, table, stats);
+  assert(program.front()->type == op_new && stats.promoted_allocations == 1);
+}
+
+void test_stack_operations() {
+  // swap through stack becomes copies through two slots
+  instruction_vec program;
+  program.push_back(std::make_unique<unary_instruction>(op_push, "a"));
+  program.push_back(std::make_unique<unary_instruction>(op_push, "b"));
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "a"));
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "b"));
+  label_table table;
+  optimization_stats stats;
+  replace_stack_operations(program, table, stats);
+  std::string expected[] = {"var stack_slot_0 int32", "var stack_slot_1 int32",
+                            "mov stack_slot_0 a",     "mov stack_slot_1 b",
+                            "mov a stack_slot_1",     "mov b stack_slot_0"};
+  assert(program.size() == 6);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.replaced_stack_operations == 4);
+
+  // only one side of branch pushes, so depth after join depends on path
+  program.clear();
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "2"));
+  program.push_back(std::make_unique<unary_instruction>(op_push, "a"));
+  program.push_back(std::make_unique<unary_instruction>(op_pop, "b"));
+  replace_stack_operations(program, table, stats);
+  assert(program.size() == 3 && program[1]->type == op_push && program[2]->type == op_pop);
+  assert(stats.replaced_stack_operations == 4);
+}
+
+void test_function_summaries() {
+  auto make_function = [](std::vector<std::string> args, std::vector<instruction*> body) {
+    instruction_vec body_vec;
+    for (auto instr : body) {
+      body_vec.emplace_back(instr);
+    }
+    body_vec.push_back(std::make_unique<noarg_instruction>(op_ret));
+    return std::make_unique<function_instruction>(op_function, args, std::move(body_vec));
+  };
+  instruction_vec program;
+  program.push_back(make_function({"inc", "x", "int32"},
+                                  {new three_addr_instruction(op_add, "y", "x", "1")}));
+  program.push_back(make_function(
+      {"show", "x", "int32", "unused", "int32"},
+      {new call_instruction(op_call, {"inc", "x"}), new call_instruction(op_call, {"writeln", "x"})}));
+  program.push_back(make_function({"spin"}, {new unary_instruction(op_jmp, "0")}));
+  program.push_back(make_function({"even", "n", "int32"}, {new call_instruction(op_call, {"odd", "n"})}));
+  program.push_back(make_function({"odd", "n", "int32"}, {new call_instruction(op_call, {"even", "n"})}));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"inc", "a"}));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"show", "a", "b"}));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"even", "a"}));
+
+  builtin_functions_map builtins;
+  builtins["writeln"] = builtin_function{nullptr, {type_int32}, effect_io};
+  auto summaries = summarize_functions(program, builtins);
+  assert(summaries["inc"].is_pure() && summaries["inc"].reads_args == std::vector<bool>{true});
+  assert(summaries["show"].effects == effect_io);
+  assert((summaries["show"].reads_args == std::vector<bool>{true, false}));
+  assert(summaries["spin"].effects == effect_may_not_return);
+  assert(summaries["even"].effects == effect_may_not_return &&
+         summaries["odd"].effects == effect_may_not_return);
+
+  label_table table;
+  optimization_stats stats;
+  simplify_calls(program, table, summaries, stats);
+  simplify_calls(static_cast<function_instruction&>(*program[1]).body, table, summaries, stats);
+  assert(program.size() == 7);
+  std::ostringstream calls;
+  program[5]->dump(calls) << ';';
+  program[6]->dump(calls);
+  assert(calls.str() == "call show (a 0);call even (a)");
+  // call of inc inside show is gone too
+  assert(static_cast<function_instruction&>(*program[1]).body.size() == 2);
+  assert(stats.removed_pure_calls == 2 && stats.unread_call_arguments == 1);
+}
+
+void test_dead_code_elimination() {
+  // j only feeds itself around loop, division by variable may trap and stays
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_var, "i", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "j", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "q", "int32"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "1"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "j", "j", "i"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "q", "j", "i"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "q", "i", "2"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "i", "-4"));
+  label_table table;
+  optimization_stats stats;
+  eliminate_dead_code(program, table, stats);
+  std::string expected[] = {"var i int32", "var j int32", "var q int32", "add i i 1",
+                            "add j j i",   "div q j i",   "if i -3"};
+  assert(program.size() == 7);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.dead_instructions == 1);
+
+  // without the division j and q are dead as well
+  program.erase(program.begin() + 5);
+  eliminate_dead_code(program, table, stats);
+  assert(program.size() == 3 && stats.dead_instructions == 4);
+}
+
+void test_pass_manager() {
+  instruction_vec body;
+  body.push_back(std::make_unique<binary_instruction>(op_var, "y", "int32"));
+  body.push_back(std::make_unique<three_addr_instruction>(op_add, "y", "x", "x"));
+  body.push_back(std::make_unique<noarg_instruction>(op_ret));
+  instruction_vec program;
+  program.push_back(std::make_unique<function_instruction>(
+      op_function, std::vector<std::string>{"twice", "x", "int32"}, std::move(body)));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "a", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_var, "b", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "a", "2"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "b", "a", "3"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"twice", "b"}));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "b"}));
+  label_table table;
+  auto builtins = record_builtins();
+  builtins["writeln"] = builtin_function{nullptr, {type_int32}, effect_io};
+  optimization_stats stats;
+  auto reports = run_passes(program, table, builtins, "calls,fixpoint(sccp,dce)", stats);
+  // function body and main each run calls, ssa once, the group at least twice
+  // until nothing changes, and out-of-ssa at the end
+  auto report = [&reports](const std::string& name) {
+    return *std::find_if(reports.begin(), reports.end(),
+                         [&name](const pass_report& r) { return r.name == name; });
+  };
+  assert(report("calls").runs == 2 && report("ssa").runs == 2 && report("out-of-ssa").runs == 2);
+  assert(report("sccp").runs >= 4 && report("sccp").runs == report("dce").runs);
+  assert(stats.removed_pure_calls == 1);
+  std::ostringstream out;
+  dump_program(program, out);
+  assert(out.str().find("call writeln (5)") != std::string::npos);
+
+  bool thrown = false;
+  try {
+    run_passes(program, table, builtins, "sccp,vectorize", stats);
+  } catch (const pass_pipeline_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+  thrown = false;
+  try {
+    run_passes(program, table, builtins, "fixpoint(sccp", stats);
+  } catch (const pass_pipeline_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(run_passes(program, table, builtins, optimization_pipeline(0), stats).empty());
+
+  // parameter assigned in loop has no single value
+  for (const auto& pipeline : {std::string("sccp"), optimization_pipeline(1)}) {
+    label_table loop_table;
+    auto loop_program = make_parameter_loop_program(loop_table);
+    run_passes(loop_program, loop_table, builtins, pipeline, stats);
+    recorded_values.clear();
+    exec(loop_program, loop_table, builtins);
+    assert((recorded_values == std::vector<int32_t>{15}));
+  }
+}
+
+void test_analysis_manager() {
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_var, "i", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "i", "0"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "1"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "i", "-1"));
+  program.push_back(std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "i"}));
+  label_table table;
+  analysis_manager analyses(program, table);
+  // intervals pull in everything they are built from, exactly once
+  assert(analyses.intervals().size() == 1);
+  analyses.live_ranges();
+  analyses.dominators();
+  analyses.instruction_liveness();
+  assert(analyses.computations(analysis_cfg) == 1 && analyses.computations(analysis_blocks) == 1 &&
+         analyses.computations(analysis_universe) == 1 &&
+         analyses.computations(analysis_liveness) == 1 &&
+         analyses.computations(analysis_intervals) == 1 &&
+         analyses.computations(analysis_dominators) == 1);
+  assert(analyses.computations(analysis_use_def) == 0);
+  assert(analyses.blocks().blocks.size() == 3 && analyses.dominators().idom[2] == 1);
+
+  // liveness depends on universe, so it goes too although it is claimed preserved
+  analyses.invalidate(analysis_cfg | analysis_blocks | analysis_dominators | analysis_liveness);
+  analyses.dominators();
+  analyses.liveness();
+  assert(analyses.computations(analysis_blocks) == 1 &&
+         analyses.computations(analysis_dominators) == 1);
+  assert(analyses.computations(analysis_universe) == 2 &&
+         analyses.computations(analysis_liveness) == 2);
+
+  // instructions moved, nothing survives
+  program.erase(program.begin() + 1);
+  analyses.invalidate();
+  assert(analyses.blocks().blocks.size() == 3 && analyses.computations(analysis_cfg) == 2);
+  assert(analyses.uses().at(1) == std::vector<std::string>{"i"} &&
+         analyses.defs().at(1) == std::vector<std::string>{"i"});
+}
+
+void test_instruction_edits() {
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_var, "i", "int32"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "i", "0"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "loop"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "1"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "j", "i", "i"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "i", "-2"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "i", "loop"));
+  label_table table;
+  update_label_table(program, table);
+  assert(table.instance["loop"] == 3);
+  const auto* var = program[0].get();
+  const auto* add = program[3].get();
+
+  // erasing only compacts in place, untouched prefix and moved instructions keep identity
+  instruction_edits erase_edits;
+  erase_edits.erase(1);
+  erase_edits.erase(4);
+  apply_instruction_edits(program, table, erase_edits);
+  assert(program.size() == 5 && program[0].get() == var && program[2].get() == add);
+  assert(table.instance["loop"] == 2);
+  assert(static_cast<binary_instruction&>(*program[3]).arg_2 == "-1");
+
+  instruction_edits insert_edits;
+  insert_edits.insert_before(2, std::make_unique<binary_instruction>(op_mov, "k", "i"));
+  insert_edits.insert_after(2, std::make_unique<three_addr_instruction>(op_sub, "k", "k", "i"));
+  assert(!insert_edits.empty() && instruction_edits().empty());
+  apply_instruction_edits(program, table, insert_edits);
+  std::string expected[] = {"var i int32", "label loop:", "mov k i",   "add i i 1",
+                            "sub k k i",   "if i -3",    "if i loop"};
+  assert(program.size() == 7 && program[3].get() == add);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(table.instance["loop"] == 2);
+
+  // only reads are replaced
+  assert(replace_operand(*program[4], "k", "t") == 1);
+  std::ostringstream renamed;
+  program[4]->dump(renamed);
+  assert(renamed.str() == "sub k t i");
+}
+
+void test_strength_reduction() {
+  instruction_vec program;
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "a", "8", "x"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "b", "x", "-1"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "c", "x", "0"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "d", "x", "7"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "e", "x", "1"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "f", "x", "8"));
+  label_table table;
+  optimization_stats stats;
+  reduce_strength(program, table, stats);
+  std::string expected[] = {"shl a x 3", "sub b 0 x", "mov c 0",
+                            "mul d x 7", "mov e x",   "div f x 8"};
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.reduced_operations == 4);
+
+  // sequences emitted for division by constant, computed the same way
+  const int32_t dividends[] = {0, 1, -1, 2, -2, 6, -6, 7, -7, 100, -100, 12345678, -12345678,
+                               INT32_MAX, INT32_MAX - 1, INT32_MIN, INT32_MIN + 1};
+  for (int32_t divisor : {3, -3, 5, 6, -7, 7, 10, 11, 25, 125, 641, -1000, 65537, 1000000007,
+                          INT32_MAX, INT32_MIN + 1}) {
+    auto magic = signed_division_magic(divisor);
+    for (auto x : dividends) {
+      auto high = static_cast<int32_t>((int64_t(x) * magic.multiplier) >> 32);
+      if (divisor > 0 && magic.multiplier < 0) {
+        high += x;
+      } else if (divisor < 0 && magic.multiplier > 0) {
+        high -= x;
+      }
+      high >>= magic.shift;
+      auto quotient = high + static_cast<int32_t>(static_cast<uint32_t>(high) >> 31);
+      assert(quotient == x / divisor);
+    }
+  }
+  for (uint32_t divisor : {3u, 5u, 6u, 7u, 10u, 11u, 641u, 1000u, 65537u, 0x7FFFFFFFu, 0x80000001u,
+                           0xFFFFFFFFu}) {
+    auto magic = unsigned_division_magic(divisor);
+    for (auto value : dividends) {
+      auto x = static_cast<uint32_t>(value);
+      auto high = static_cast<uint32_t>((uint64_t(x) * static_cast<uint32_t>(magic.multiplier)) >> 32);
+      auto quotient = magic.add ? (((x - high) >> 1) + high) >> (magic.shift - 1) : high >> magic.shift;
+      assert(quotient == x / divisor);
+    }
+  }
+
+  // generated code, every product and quotient is passed to record
+  instruction_vec jit_program;
+  jit_program.push_back(std::make_unique<binary_instruction>(op_var, "x", "int32"));
+  jit_program.push_back(std::make_unique<binary_instruction>(op_var, "r", "int32"));
+  std::vector<std::pair<instruction_type, int32_t>> operations = {
+      {op_mul, 0},   {op_mul, -1},  {op_mul, 6},    {op_mul, 9},    {op_mul, -10},
+      {op_mul, 17},  {op_mul, 31},  {op_mul, 100},  {op_div, 1},    {op_div, 4},
+      {op_div, -8},  {op_div, 7},   {op_div, -7},   {op_div, 1000}, {op_div, INT32_MIN},
+      {op_udiv, 1},  {op_udiv, 16}, {op_udiv, 7},   {op_udiv, 10},  {op_udiv, 0x80000001u}};
+  const int32_t inputs[] = {0, 5, -5, 1000003, -1000003, INT32_MAX, INT32_MIN};
+  for (auto x : inputs) {
+    jit_program.push_back(std::make_unique<binary_instruction>(op_mov, "x", std::to_string(x)));
+    for (const auto& operation : operations) {
+      jit_program.push_back(std::make_unique<three_addr_instruction>(
+          operation.first, "r", "x", std::to_string(operation.second)));
+      jit_program.push_back(
+          std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "r"}));
+    }
+  }
+  auto builtins = record_builtins();
+  recorded_values.clear();
+  exec(jit_program, table, builtins);
+  auto recorded = recorded_values.begin();
+  for (auto x : inputs) {
+    for (const auto& operation : operations) {
+      int32_t result = 0;
+      if (operation.first == op_mul) {
+        result = static_cast<int32_t>(static_cast<uint32_t>(x) * static_cast<uint32_t>(operation.second));
+      } else if (operation.first == op_div) {
+        result = x / operation.second;
+      } else {
+        result = static_cast<int32_t>(static_cast<uint32_t>(x) / static_cast<uint32_t>(operation.second));
+      }
+      assert(recorded != recorded_values.end() && *recorded++ == result);
+    }
+  }
+  assert(recorded == recorded_values.end());
+}
+
+void test_loop_invariant_code_motion() {
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "i", "0"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "loop"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "t", "a", "b"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "m", "t", "4"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "q", "a", "d"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_div, "r", "a", "3"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "m"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "q"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "r"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_eq, "e", "i", "7"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "e", "skip"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "w", "a", "1"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "skip"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_lt, "c", "i", "100"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "loop"));
+  program.push_back(
+      std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "w"}));
+  label_table table;
+  update_label_table(program, table);
+  optimization_stats stats;
+  hoist_loop_invariants(program, table, stats);
+
+  // division by variable may trap and w is read after loop which may skip it
+  std::string expected[] = {"mov i 0",          "label loop:",    "add t a b",
+                            "mul m t 4",        "div r a 3",      "label loop_body_2:",
+                            "div q a d",        "add i i m",      "add i i q",
+                            "add i i r",        "cmp_eq e i 7",   "if e skip",
+                            "add w a 1",        "label skip:",    "cmp_lt c i 100",
+                            "if c loop_body_2", "call writeln (w)"};
+  assert(program.size() == 17 && stats.hoisted_instructions == 3);
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+
+  // invariants already left the loop
+  hoist_loop_invariants(program, table, stats);
+  assert(program.size() == 17 && stats.hoisted_instructions == 3);
+}
+
+void test_inliner() {
+  auto make_program = []() {
+    instruction_vec twice_body;
+    twice_body.push_back(std::make_unique<binary_instruction>(op_var, "y", "int32"));
+    twice_body.push_back(std::make_unique<three_addr_instruction>(op_add, "y", "x", "x"));
+    twice_body.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "y"}));
+    twice_body.push_back(std::make_unique<noarg_instruction>(op_ret));
+    instruction_vec countdown_body;
+    countdown_body.push_back(std::make_unique<binary_instruction>(op_var, "c", "int32"));
+    countdown_body.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "n"}));
+    countdown_body.push_back(std::make_unique<three_addr_instruction>(op_cmp_lte, "c", "n", "0"));
+    countdown_body.push_back(std::make_unique<binary_instruction>(op_if, "c", "3"));
+    countdown_body.push_back(std::make_unique<three_addr_instruction>(op_sub, "n", "n", "1"));
+    countdown_body.push_back(std::make_unique<call_instruction>(
+        op_call, std::vector<std::string>{"countdown", "n"}));
+    countdown_body.push_back(std::make_unique<noarg_instruction>(op_ret));
+    instruction_vec program;
+    program.push_back(std::make_unique<function_instruction>(
+        op_function, std::vector<std::string>{"twice", "x", "int32"}, std::move(twice_body)));
+    program.push_back(std::make_unique<function_instruction>(
+        op_function, std::vector<std::string>{"countdown", "n", "int32"},
+        std::move(countdown_body)));
+    program.push_back(std::make_unique<binary_instruction>(op_var, "y", "int32"));
+    program.push_back(std::make_unique<binary_instruction>(op_mov, "y", "5"));
+    program.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"twice", "y"}));
+    program.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"twice", "7"}));
+    program.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"countdown", "2"}));
+    program.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "y"}));
+    return program;
+  };
+  auto builtins = record_builtins();
+  label_table table;
+  auto program = make_program();
+  optimization_stats stats;
+  inline_calls(program, table, program, stats);
+  assert(stats.inlined_calls == 2);
+  size_t calls = 0;
+  for (const auto& instr : program) {
+    if (instr->type == op_call) {
+      const auto& callee = static_cast<call_instruction&>(*instr).args.front();
+      // recursive function is never inlined
+      assert(callee == "countdown" || callee == "record");
+      ++calls;
+    }
+  }
+  assert(calls == 4);
+
+  recorded_values.clear();
+  exec(program, table, builtins);
+  auto inlined_values = recorded_values;
+  recorded_values.clear();
+  auto reference = make_program();
+  exec(reference, table, builtins);
+  // local y of twice does not clash with y of caller
+  assert(inlined_values == recorded_values);
+  assert((recorded_values == std::vector<int32_t>{10, 14, 2, 1, 0, 5}));
+}
+
+void test_instruction_combining() {
+  instruction_vec program;
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "a", "p", "0"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "b", "1", "p"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_sub, "c", "p", "p"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_eq, "d", "p", "p"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "e", "3", "q"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_sub, "f", "e", "4"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "g", "f", "1"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_cmp_lt, "h", "5", "q"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_sub, "i", "q", "p"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "j", "p", "i"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_mul, "k", "q", "p"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_shl, "l", "p", "20"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_shl, "m", "l", "20"));
+  label_table table;
+  optimization_stats stats;
+  combine_instructions(program, table, stats);
+  // definitions of operands are looked through once they are simplified themselves
+  std::string expected[] = {"mov a p",       "mov b p",      "mov c 0",   "mov d 1",
+                            "add e q 3",     "add f q -1",   "mov g q",   "cmp_gt h q 5",
+                            "sub i q p",     "mov j q",      "mul k p q", "shl l p 20",
+                            "mov m 0"};
+  for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+    std::ostringstream instr;
+    program[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  assert(stats.combined_instructions == 15);
+
+  // operand which would cancel changes between both instructions, only order
+  // of operands is canonical
+  instruction_vec changed;
+  changed.push_back(std::make_unique<three_addr_instruction>(op_sub, "t", "p", "b"));
+  changed.push_back(std::make_unique<three_addr_instruction>(op_add, "u", "p", "b"));
+  changed.push_back(std::make_unique<binary_instruction>(op_mov, "b", "1"));
+  changed.push_back(std::make_unique<three_addr_instruction>(op_add, "v", "t", "b"));
+  changed.push_back(std::make_unique<three_addr_instruction>(op_sub, "w", "u", "b"));
+  combine_instructions(changed, table, stats);
+  std::string unchanged[] = {"sub t p b", "add u b p", "mov b 1", "add v b t", "sub w u b"};
+  for (size_t i_index = 0; i_index != changed.size(); ++i_index) {
+    std::ostringstream instr;
+    changed[i_index]->dump(instr);
+    assert(instr.str() == unchanged[i_index]);
+  }
+
+  // long chain of constant additions collapses in one sweep of work list
+  instruction_vec chain;
+  chain.push_back(std::make_unique<three_addr_instruction>(op_add, "x0", "p", "1"));
+  for (int link = 1; link != 1000; ++link) {
+    chain.push_back(std::make_unique<three_addr_instruction>(
+        op_add, "x" + std::to_string(link), "x" + std::to_string(link - 1), "1"));
+  }
+  optimization_stats chain_stats;
+  combine_instructions(chain, table, chain_stats);
+  std::ostringstream last;
+  chain.back()->dump(last);
+  assert(last.str() == "add x999 p 1000" && chain_stats.combined_instructions == 999);
+}
+
+void test_control_flow_simplification() {
+  auto check = [](const instruction_vec& program, const std::vector<std::string>& expected) {
+    assert(program.size() == expected.size());
+    for (size_t i_index = 0; i_index != program.size(); ++i_index) {
+      std::ostringstream instr;
+      program[i_index]->dump(instr);
+      assert(instr.str() == expected[i_index]);
+    }
+  };
+  instruction_vec program;
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "c", "1"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "a"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "d"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "x", "x", "1"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "a"));
+  program.push_back(std::make_unique<binary_instruction>(op_if, "c", "b"));
+  program.push_back(std::make_unique<noarg_instruction>(op_nop));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "d"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "e"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "b"));
+  program.push_back(std::make_unique<binary_instruction>(op_mov, "y", "x"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "f"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "e"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "x", "x", "2"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "b"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "f"));
+  program.push_back(std::make_unique<three_addr_instruction>(op_add, "y", "y", "1"));
+  program.push_back(std::make_unique<unary_instruction>(op_jmp, "done"));
+  program.push_back(std::make_unique<unary_instruction>(op_label, "done"));
+  program.push_back(
+      std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "y"}));
+  label_table table;
+  update_label_table(program, table);
+  optimization_stats stats;
+  simplify_control_flow(program, table, stats);
+  // if on c which is true at its target goes where the second if goes, jmp to jmp is
+  // threaded, block reached only by jump takes its place and jumps to next instruction go
+  check(program, {"mov c 1", "if c b", "add x x 2", "label b:", "mov y x", "add y y 1",
+                  "call writeln (y)"});
+  assert(stats.threaded_jumps == 2 && stats.unreachable_instructions == 3 &&
+         stats.removed_jumps == 3 && stats.merged_blocks == 1);
+
+  // condition set by constant before jump, loop is never entered
+  instruction_vec known;
+  known.push_back(std::make_unique<binary_instruction>(op_mov, "k", "0"));
+  known.push_back(std::make_unique<unary_instruction>(op_jmp, "test"));
+  known.push_back(std::make_unique<unary_instruction>(op_label, "back"));
+  known.push_back(std::make_unique<three_addr_instruction>(op_add, "k", "k", "1"));
+  known.push_back(std::make_unique<unary_instruction>(op_label, "test"));
+  known.push_back(std::make_unique<binary_instruction>(op_if, "k", "back"));
+  known.push_back(
+      std::make_unique<call_instruction>(op_call, std::vector<std::string>{"writeln", "k"}));
+  update_label_table(known, table);
+  optimization_stats known_stats;
+  simplify_control_flow(known, table, known_stats);
+  check(known, {"mov k 0", "call writeln (k)"});
+  assert(known_stats.threaded_jumps == 1 && known_stats.unreachable_instructions == 2);
+}
+
+void test_tail_call_elimination() {
+  auto make_program = [](const std::string& depth) {
+    // alternate(a, b, n) calls alternate(b, a, n - 1) until n reaches 0
+    instruction_vec body;
+    body.push_back(std::make_unique<binary_instruction>(op_var, "c", "int32"));
+    body.push_back(std::make_unique<three_addr_instruction>(op_cmp_lte, "c", "n", "0"));
+    body.push_back(std::make_unique<binary_instruction>(op_if, "c", "4"));
+    body.push_back(std::make_unique<three_addr_instruction>(op_sub, "n", "n", "1"));
+    body.push_back(std::make_unique<call_instruction>(
+        op_call, std::vector<std::string>{"alternate", "b", "a", "n"}));
+    body.push_back(std::make_unique<unary_instruction>(op_jmp, "2"));
+    body.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "a"}));
+    body.push_back(std::make_unique<noarg_instruction>(op_ret));
+    instruction_vec program;
+    program.push_back(std::make_unique<function_instruction>(
+        op_function,
+        std::vector<std::string>{"alternate", "a", "int32", "b", "int32", "n", "int32"},
+        std::move(body)));
+    program.push_back(std::make_unique<call_instruction>(
+        op_call, std::vector<std::string>{"alternate", "1", "2", depth}));
+    return program;
+  };
+  auto builtins = record_builtins();
+  label_table table;
+  auto program = make_program("5");
+  auto& function = static_cast<function_instruction&>(*program.front());
+  optimization_stats stats;
+  eliminate_tail_recursion(function.body, table, function.args, stats);
+  assert(stats.eliminated_tail_calls == 1);
+  // only a is overwritten before it is read
+  std::vector<std::string> expected = {
+      "label alternate_entry_0:", "var c int32", "cmp_lte c n 0", "if c 8", "sub n n 1",
+      "var tail_a int32", "mov tail_a a", "mov a b", "mov b tail_a", "jmp alternate_entry_0",
+      "jmp 2", "call record (a)"};
+  assert(function.body.size() == expected.size() + 1 && function.body.back()->type == op_ret);
+  for (size_t i_index = 0; i_index != expected.size(); ++i_index) {
+    std::ostringstream instr;
+    function.body[i_index]->dump(instr);
+    assert(instr.str() == expected[i_index]);
+  }
+  recorded_values.clear();
+  exec(program, table, builtins);
+  assert((recorded_values == std::vector<int32_t>{2}));
+
+  // call which is not eliminated reuses frame of caller, so depth far past
+  // size of native stack runs both with and without the pass
+  recorded_values.clear();
+  auto deep = make_program("10000001");
+  exec(deep, table, builtins);
+  assert((recorded_values == std::vector<int32_t>{2}));
+}
+
+void test_loop_unrolling() {
+  auto builtins = record_builtins();
+  auto has_branch = [](const instruction_vec& program) {
+    return std::any_of(program.begin(), program.end(),
+                       [](const instruction_ptr& instr) { return instr->type == op_if; });
+  };
+
+  label_table table;
+  auto program = make_sum_loop("5", true);
+  update_label_table(program, table);
+  optimization_stats stats;
+  unroll_loops(program, table, unroll_options(), stats);
+  assert(stats.unrolled_loops == 1 && !has_branch(program));
+  recorded_values.clear();
+  exec(program, table, builtins);
+  assert((recorded_values == std::vector<int32_t>{10, 5}));
+
+  // loop which always runs once, chunks of four and remainder
+  for (auto bound : {"0", "1", "3", "4", "5", "9", "10", "11", "1000"}) {
+    auto program = make_sum_loop(bound, false);
+    update_label_table(program, table);
+    optimization_stats stats;
+    unroll_loops(program, table, unroll_options(), stats);
+    assert(stats.partially_unrolled_loops == 1);
+    recorded_values.clear();
+    exec(program, table, builtins);
+    int32_t n = std::max(1, std::stoi(bound));
+    assert((recorded_values == std::vector<int32_t>{n * (n - 1) / 2, n}));
+  }
+
+  // nothing fits in budget of the lowest levels
+  program = make_sum_loop("5", true);
+  update_label_table(program, table);
+  optimization_stats disabled_stats;
+  unroll_loops(program, table, unroll_options_for_level(1), disabled_stats);
+  assert(disabled_stats.unrolled_loops == 0 && disabled_stats.partially_unrolled_loops == 0);
+  assert(has_branch(program));
+}
+
+void test_scalar_evolution() {
+  auto builtins = record_builtins();
+  auto constant = [](int32_t value) {
+    scev_linear linear;
+    linear.constant = value;
+    return linear;
+  };
+
+  label_table table;
+  auto program = make_sum_loop("10", true);
+  update_label_table(program, table);
+  construct_ssa(program, table);
+  {
+    analysis_manager analyses(program, table);
+    const auto& evolution = analyses.evolution();
+    assert(evolution.loops().size() == 1);
+    const auto* i = evolution.recurrence("i_2");
+    assert(i != nullptr && i->loop == 0);
+    assert((i->coefficients == std::vector<scev_linear>{constant(0), constant(1)}));
+    const auto* s = evolution.recurrence("s_2");
+    assert(s != nullptr);
+    assert((s->coefficients == std::vector<scev_linear>{constant(0), constant(0), constant(1)}));
+    assert(evaluate_recurrence(*s, 10) == 45);
+    // variables defined outside of loops have no recurrence
+    assert(evolution.recurrence("i_1") == nullptr);
+    const auto* count = evolution.backedges(0);
+    assert(count != nullptr && count->is_constant() && count->difference.constant == 9);
+  }
+  optimization_stats stats;
+  delete_loops(program, table, stats);
+  assert(stats.deleted_loops == 1);
+  destruct_ssa(program, table);
+  recorded_values.clear();
+  exec(program, table, builtins);
+  assert((recorded_values == std::vector<int32_t>{45, 10}));
+
+  // loop which always runs once, sums wrap around
+  for (auto bound : {"-5", "0", "1", "2", "7", "1000", "100000"}) {
+    auto program = make_sum_loop(bound, false);
+    update_label_table(program, table);
+    construct_ssa(program, table);
+    {
+      analysis_manager analyses(program, table);
+      const auto* count = analyses.evolution().backedges(0);
+      assert(count != nullptr && count->guarded && count->guard == op_cmp_lt);
+      assert(count->guard_lhs == constant(1) && count->difference.symbols.at("n_2") == 1);
+    }
+    optimization_stats stats;
+    delete_loops(program, table, stats);
+    assert(stats.deleted_loops == 1);
+    destruct_ssa(program, table);
+    recorded_values.clear();
+    exec(program, table, builtins);
+    uint32_t n = std::max(1, std::stoi(bound));
+    auto sum = static_cast<int32_t>(static_cast<uint32_t>(uint64_t(n) * (n - 1) / 2));
+    assert((recorded_values == std::vector<int32_t>{sum, static_cast<int32_t>(n)}));
+  }
+}
+
+void test_induction_variable_simplification() {
+  auto make_program = [](const std::string& bound, const std::string& factor) {
+    instruction_vec prologue;
+    for (auto name : {"j", "t"}) {
+      prologue.push_back(std::make_unique<binary_instruction>(op_var, name, "int32"));
+    }
+    prologue.push_back(std::make_unique<binary_instruction>(op_mov, "j", "0"));
+    instruction_vec body;
+    body.push_back(std::make_unique<three_addr_instruction>(op_mul, "t", "j", factor));
+    body.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "t"}));
+    body.push_back(std::make_unique<three_addr_instruction>(op_add, "j", "j", "1"));
+    // condition keeps its value in the last iteration
+    instruction_vec exit;
+    exit.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "c"}));
+    return make_counting_loop(bound, false, std::move(prologue), std::move(body), std::move(exit));
+  };
+  auto builtins = record_builtins();
+  auto count = [](const instruction_vec& program, instruction_type type) {
+    return std::count_if(program.begin(), program.end(),
+                         [type](const instruction_ptr& instr) { return instr->type == type; });
+  };
+
+  // odd step never repeats, so exit test uses product for any bound
+  for (auto bound : {"0", "1", "5", "1000"}) {
+    label_table table;
+    auto program = make_program(bound, "3");
+    update_label_table(program, table);
+    construct_ssa(program, table);
+    optimization_stats stats;
+    simplify_induction_variables(program, table, stats);
+    assert(stats.merged_induction_variables == 1 && stats.reduced_induction_variables == 1);
+    assert(stats.rewritten_exit_tests == 1);
+    optimization_stats dead_stats;
+    eliminate_dead_code(program, table, dead_stats);
+    // induction variables i and j are gone, product has its own phi
+    assert(count(program, op_phi) == 1);
+    destruct_ssa(program, table);
+    recorded_values.clear();
+    exec(program, table, builtins);
+    std::vector<int32_t> expected;
+    for (int32_t value = 0; value != std::max(1, std::stoi(bound)); ++value) {
+      expected.push_back(value * 3);
+    }
+    expected.push_back(0);
+    assert(recorded_values == expected);
+  }
+
+  // even step may repeat before unknown number of iterations ends
+  label_table table;
+  auto program = make_program("7", "4");
+  update_label_table(program, table);
+  construct_ssa(program, table);
+  optimization_stats stats;
+  simplify_induction_variables(program, table, stats);
+  assert(stats.reduced_induction_variables == 1 && stats.rewritten_exit_tests == 0);
+  destruct_ssa(program, table);
+  recorded_values.clear();
+  exec(program, table, builtins);
+  assert((recorded_values == std::vector<int32_t>{0, 4, 8, 12, 16, 20, 24, 0}));
+}
+
+void test_profile_guided_optimization() {
+  // heavy is too big to inline in loop without profile, light runs only for i over 100
+  auto make_program = []() {
+    instruction_vec heavy_body;
+    heavy_body.push_back(std::make_unique<binary_instruction>(op_var, "y", "int32"));
+    heavy_body.push_back(std::make_unique<binary_instruction>(op_mov, "y", "0"));
+    for (int step = 0; step != 26; ++step) {
+      heavy_body.push_back(std::make_unique<three_addr_instruction>(op_add, "y", "y", "x"));
+    }
+    heavy_body.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "y"}));
+    heavy_body.push_back(std::make_unique<noarg_instruction>(op_ret));
+    instruction_vec light_body;
+    light_body.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"record", "x"}));
+    light_body.push_back(std::make_unique<noarg_instruction>(op_ret));
+    instruction_vec program;
+    program.push_back(std::make_unique<function_instruction>(
+        op_function, std::vector<std::string>{"heavy", "x", "int32"}, std::move(heavy_body)));
+    program.push_back(std::make_unique<function_instruction>(
+        op_function, std::vector<std::string>{"light", "x", "int32"}, std::move(light_body)));
+    program.push_back(std::make_unique<binary_instruction>(op_var, "i", "int32"));
+    program.push_back(std::make_unique<binary_instruction>(op_var, "c", "int32"));
+    program.push_back(std::make_unique<binary_instruction>(op_mov, "i", "0"));
+    program.push_back(std::make_unique<unary_instruction>(op_label, "loop"));
+    program.push_back(std::make_unique<three_addr_instruction>(op_cmp_lte, "c", "i", "100"));
+    program.push_back(std::make_unique<binary_instruction>(op_if, "c", "small"));
+    program.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"light", "i"}));
+    program.push_back(std::make_unique<unary_instruction>(op_label, "small"));
+    program.push_back(
+        std::make_unique<call_instruction>(op_call, std::vector<std::string>{"heavy", "i"}));
+    program.push_back(std::make_unique<three_addr_instruction>(op_add, "i", "i", "1"));
+    program.push_back(std::make_unique<three_addr_instruction>(op_cmp_lt, "c", "i", "20"));
+    program.push_back(std::make_unique<binary_instruction>(op_if, "c", "loop"));
+    return program;
+  };
+  auto builtins = record_builtins();
+  std::vector<int32_t> expected;
+  for (int32_t value = 0; value != 20; ++value) {
+    expected.push_back(value * 26);
+  }
+  auto calls_of = [](const instruction_vec& program, const std::string& name) {
+    return std::count_if(program.begin(), program.end(), [&](const instruction_ptr& instr) {
+      return instr->type == op_call &&
+             static_cast<const call_instruction&>(*instr).args.front() == name;
+    });
+  };
+
+  // counts of blocks survive trip through file
+  execution_profile profile;
+  {
+    label_table table;
+    auto program = make_program();
+    update_label_table(program, table);
+    auto generating = builtins;
+    instrument_program(program, table, generating);
+    recorded_values.clear();
+    exec(program, table, generating);
+    assert(recorded_values == expected);
+    std::stringstream file;
+    write_profile(collected_profile(), file);
+    profile = read_profile(file);
+  }
+  assert((profile.at("heavy") == std::vector<block_counts>{{20, 0}}));
+  assert((profile.at("light") == std::vector<block_counts>{{0, 0}}));
+  const auto& main_counts = profile.at("");
+  assert(main_counts.size() == 4 && main_counts[1].entries == 20 && main_counts[1].taken == 20);
+  assert(main_counts[2].entries == 0 && main_counts[3].entries == 20 && main_counts[3].taken == 19);
+
+  // without profile only light call is cheap enough, with it only heavy one is hot enough
+  for (bool profiled : {false, true}) {
+    label_table table;
+    auto program = make_program();
+    update_label_table(program, table);
+    if (profiled) {
+      annotate_program(program, table, profile);
+    }
+    optimization_stats stats;
+    inline_calls(program, table, program, stats);
+    assert(stats.inlined_calls == 1);
+    assert(calls_of(program, "heavy") == (profiled ? 0 : 1));
+    assert(calls_of(program, "light") == (profiled ? 1 : 0));
+  }
+
+  // block calling light is moved out of the loop and the rest falls through
+  label_table table;
+  auto program = make_program();
+  update_label_table(program, table);
+  annotate_program(program, table, profile);
+  optimization_stats stats;
+  layout_blocks(program, table, stats);
+  assert(stats.moved_blocks != 0);
+  auto light = std::find_if(program.begin(), program.end(), [](const instruction_ptr& instr) {
+    return instr->type == op_call &&
+           static_cast<const call_instruction&>(*instr).args.front() == "light";
+  });
+  assert(std::none_of(light, program.end(), [](const instruction_ptr& instr) {
+    return instr->type == op_call &&
+           static_cast<const call_instruction&>(*instr).args.front() == "heavy";
+  }));
+  recorded_values.clear();
+  exec(program, table, builtins);
+  assert(recorded_values == expected);
+
+  // profile of other program is refused
+  auto other = make_program();
+  other.pop_back();
+  bool refused = false;
+  try {
+    annotate_program(other, table, profile);
+  } catch (const profile_error&) {
+    refused = true;
+  }
+  assert(refused);
+}
@@ -3,3 +3,28 @@
 void test_jmp_code();
 void test_sequential_code();
 void test_build_instruction_vec_by_hand();
+void test_parallel_liveness();
+void test_live_intervals();
+void test_coalesce_copies();
+void test_ssa();
+void test_sccp();
+void test_gvn();
+void test_lazy_code_motion();
+void test_value_ranges();
+void test_escape_analysis();
+void test_stack_operations();
+void test_function_summaries();
+void test_dead_code_elimination();
+void test_pass_manager();
+void test_analysis_manager();
+void test_instruction_edits();
+void test_strength_reduction();
+void test_loop_invariant_code_motion();
+void test_inliner();
+void test_instruction_combining();
+void test_control_flow_simplification();
+void test_tail_call_elimination();
+void test_loop_unrolling();
+void test_scalar_evolution();
+void test_induction_variable_simplification();
+void test_profile_guided_optimization();
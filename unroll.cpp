@@ -0,0 +1,387 @@
+#include "yadfa.h"
+
+namespace {
+// counting loop made of single block which ends with jump back to its start,
+// induction variable is changed by one add of constant step and compared
+// with bound which does not change in loop
+struct counting_loop {
+  int label = 0;
+  int first = 0;
+  int last = 0;
+  std::string induction;
+  int32_t step = 0;
+  // comparison as if induction variable was its left operand
+  instruction_type compare = op_cmp_lt;
+  std::string bound;
+  // comparison reads induction variable after it was stepped
+  bool compares_next = false;
+  std::string condition;
+  // instructions copied for each iteration, declarations stay once
+  size_t size = 0;
+};
+
+instruction_type mirrored(instruction_type type) {
+  switch (type) {
+    case op_cmp_lt:
+      return op_cmp_gt;
+    case op_cmp_gt:
+      return op_cmp_lt;
+    case op_cmp_lte:
+      return op_cmp_gte;
+    case op_cmp_gte:
+      return op_cmp_lte;
+    default:
+      return type;
+  }
+}
+
+instruction_type negated(instruction_type type) {
+  switch (type) {
+    case op_cmp_lt:
+      return op_cmp_gte;
+    case op_cmp_gte:
+      return op_cmp_lt;
+    case op_cmp_gt:
+      return op_cmp_lte;
+    case op_cmp_lte:
+      return op_cmp_gt;
+    case op_cmp_eq:
+      return op_cmp_neq;
+    default:
+      return op_cmp_eq;
+  }
+}
+
+bool compare(instruction_type type, int32_t a, int32_t b) {
+  switch (type) {
+    case op_cmp_eq:
+      return a == b;
+    case op_cmp_neq:
+      return a != b;
+    case op_cmp_gt:
+      return a > b;
+    case op_cmp_lt:
+      return a < b;
+    case op_cmp_lte:
+      return a <= b;
+    default:
+      return a >= b;
+  }
+}
+
+bool is_comparison(instruction_type type) {
+  return type == op_cmp_eq || type == op_cmp_neq || type == op_cmp_gt || type == op_cmp_lt ||
+         type == op_cmp_lte || type == op_cmp_gte;
+}
+
+int32_t wrapping_add(int32_t a, int64_t b) {
+  return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
+
+bool match_counting_loop(const instruction_vec& i_vec, const block_graph& graph,
+                         const natural_loop& loop, counting_loop& result) {
+  const auto& block = graph.blocks[loop.header];
+  if (loop.blocks.size() != 1 || block.first == 0 || i_vec[block.first - 1]->type != op_label ||
+      i_vec[block.last]->type != op_if) {
+    return false;
+  }
+  const auto& latch = static_cast<const binary_instruction&>(*i_vec[block.last]);
+  if (latch.arg_2 != static_cast<const unary_instruction&>(*i_vec[block.first - 1]).arg_1) {
+    return false;
+  }
+  // loop is entered only by falling into it
+  for (auto pred : block.predecessors) {
+    if (pred != loop.header && graph.blocks[pred].last != block.first - 1) {
+      return false;
+    }
+  }
+  std::map<std::string, std::vector<int>> defs;
+  std::vector<std::string> args;
+  result = counting_loop();
+  for (int i_index = block.first; i_index != block.last; ++i_index) {
+    switch (i_vec[i_index]->type) {
+      case op_label:
+      case op_jmp:
+      case op_if:
+      case op_ret:
+      case op_function:
+      case op_pop_args:
+      case op_phi:
+      case op_alloca:
+        return false;
+      case op_var:
+        continue;
+      default:
+        break;
+    }
+    ++result.size;
+    args.clear();
+    instruction_defs(*i_vec[i_index], args);
+    for (const auto& def : args) {
+      defs[def].push_back(i_index);
+    }
+  }
+  auto condition_defs = defs.find(latch.arg_1);
+  if (condition_defs == defs.end() || condition_defs->second.size() != 1 ||
+      !is_comparison(i_vec[condition_defs->second.front()]->type)) {
+    return false;
+  }
+  auto compare_index = condition_defs->second.front();
+  const auto& comparison = static_cast<const three_addr_instruction&>(*i_vec[compare_index]);
+  auto is_invariant = [&defs](const std::string& arg) {
+    return is_constant(arg) || defs.find(arg) == defs.end();
+  };
+  // induction variable is the operand stepped by its only definition
+  for (int operand = 0; operand != 2; ++operand) {
+    const auto& induction = operand == 0 ? comparison.arg_2 : comparison.arg_3;
+    const auto& bound = operand == 0 ? comparison.arg_3 : comparison.arg_2;
+    auto induction_defs = defs.find(induction);
+    if (induction_defs == defs.end() || induction_defs->second.size() != 1 ||
+        !is_invariant(bound)) {
+      continue;
+    }
+    auto step_index = induction_defs->second.front();
+    const auto& instr = *i_vec[step_index];
+    if (instr.type != op_add && instr.type != op_sub) {
+      continue;
+    }
+    const auto& step_op = static_cast<const three_addr_instruction&>(instr);
+    std::string step;
+    if (step_op.arg_2 == induction && is_constant(step_op.arg_3)) {
+      step = step_op.arg_3;
+    } else if (instr.type == op_add && step_op.arg_3 == induction && is_constant(step_op.arg_2)) {
+      step = step_op.arg_2;
+    } else {
+      continue;
+    }
+    auto step_value = static_cast<int32_t>(std::stoll(step));
+    if (instr.type == op_sub) {
+      step_value = wrapping_add(0, -static_cast<int64_t>(step_value));
+    }
+    if (step_value == 0 || step_value == INT32_MIN) {
+      continue;
+    }
+    result.label = block.first - 1;
+    result.first = block.first;
+    result.last = block.last;
+    result.induction = induction;
+    result.step = step_value;
+    result.compare = operand == 0 ? comparison.type : mirrored(comparison.type);
+    result.bound = bound;
+    result.compares_next = step_index < compare_index;
+    result.condition = latch.arg_1;
+    return true;
+  }
+  return false;
+}
+
+// constant last assigned to variable in block falling into loop
+bool initial_value(const instruction_vec& i_vec, const block_graph& graph, int header,
+                   const std::string& name, int32_t& value) {
+  const auto& block = graph.blocks[header - 1];
+  std::vector<std::string> defs;
+  for (int i_index = block.last; i_index >= block.first; --i_index) {
+    defs.clear();
+    instruction_defs(*i_vec[i_index], defs);
+    if (std::find(defs.begin(), defs.end(), name) == defs.end()) {
+      continue;
+    }
+    if (i_vec[i_index]->type != op_mov) {
+      return false;
+    }
+    const auto& source = static_cast<const binary_instruction&>(*i_vec[i_index]).arg_2;
+    if (!is_constant(source)) {
+      return false;
+    }
+    value = static_cast<int32_t>(std::stoll(source));
+    return true;
+  }
+  return false;
+}
+
+// number of times body runs, 0 when it runs more than limit times
+size_t count_trips(const counting_loop& loop, int32_t start, size_t limit) {
+  auto bound = static_cast<int32_t>(std::stoll(loop.bound));
+  auto value = start;
+  for (size_t trips = 1; trips <= limit; ++trips) {
+    auto next = wrapping_add(value, loop.step);
+    if (!compare(loop.compare, loop.compares_next ? next : value, bound)) {
+      return trips;
+    }
+    value = next;
+  }
+  return 0;
+}
+
+void copy_body(const instruction_vec& i_vec, const counting_loop& loop, size_t copies,
+               instruction_vec& out) {
+  for (size_t copy = 0; copy != copies; ++copy) {
+    for (int i_index = loop.first; i_index != loop.last; ++i_index) {
+      if (i_vec[i_index]->type != op_var) {
+        out.push_back(instruction_ptr(i_vec[i_index]->clone()));
+      }
+    }
+  }
+}
+
+// loop checks once per factor iterations whether all of them will run and
+// leaves the rest to original loop, returns false when there is no such check
+bool unroll_partially(instruction_vec& i_vec, label_table& table, const counting_loop& loop,
+                      size_t factor, const std::function<std::string()>& make_temp,
+                      const std::string& type, instruction_edits& edits) {
+  bool ascending = loop.step > 0;
+  if ((ascending && loop.compare != op_cmp_lt && loop.compare != op_cmp_lte) ||
+      (!ascending && loop.compare != op_cmp_gt && loop.compare != op_cmp_gte)) {
+    return false;
+  }
+  // all comparisons but the last in chunk pass when induction variable
+  // at its start compares with bound moved back by steps between them
+  auto distance = (static_cast<int64_t>(factor) - (loop.compares_next ? 1 : 2)) * loop.step;
+  const auto& loop_label = static_cast<const unary_instruction&>(*i_vec[loop.label]).arg_1;
+  instruction_vec group;
+  std::string limit;
+  if (is_constant(loop.bound)) {
+    auto value = std::stoll(loop.bound) - distance;
+    if (value < INT32_MIN || value > INT32_MAX) {
+      return false;
+    }
+    limit = std::to_string(value);
+  } else {
+    limit = make_temp();
+    auto wrapped = make_temp();
+    group.push_back(std::make_unique<binary_instruction>(op_var, limit, type));
+    group.push_back(std::make_unique<binary_instruction>(op_var, wrapped, "int32"));
+    group.push_back(std::make_unique<three_addr_instruction>(op_sub, limit, loop.bound,
+                                                             std::to_string(distance)));
+    group.push_back(std::make_unique<three_addr_instruction>(
+        ascending ? op_cmp_gt : op_cmp_lt, wrapped, limit, loop.bound));
+    group.push_back(std::make_unique<binary_instruction>(op_if, wrapped, loop_label));
+  }
+  auto enter = make_temp();
+  auto again = make_temp();
+  group.push_back(std::make_unique<binary_instruction>(op_var, enter, "int32"));
+  group.push_back(std::make_unique<binary_instruction>(op_var, again, "int32"));
+  group.push_back(std::make_unique<three_addr_instruction>(negated(loop.compare), enter,
+                                                           loop.induction, limit));
+  group.push_back(std::make_unique<binary_instruction>(op_if, enter, loop_label));
+  auto chunk_label = fresh_label(table, "unrolled_");
+  auto exit_label = fresh_label(table, "unrolled_exit_");
+  group.push_back(std::make_unique<unary_instruction>(op_label, chunk_label));
+  copy_body(i_vec, loop, factor, group);
+  group.push_back(
+      std::make_unique<three_addr_instruction>(loop.compare, again, loop.induction, limit));
+  group.push_back(std::make_unique<binary_instruction>(op_if, again, chunk_label));
+  // last comparison of chunk decides whether original loop takes the rest
+  group.push_back(std::make_unique<binary_instruction>(op_if, loop.condition, loop_label));
+  group.push_back(std::make_unique<unary_instruction>(op_jmp, exit_label));
+  for (auto& instr : group) {
+    edits.insert_before(loop.label, std::move(instr));
+  }
+  edits.insert_after(loop.last, std::make_unique<unary_instruction>(op_label, exit_label));
+  return true;
+}
+}  // namespace
+
+unroll_options unroll_options_for_level(int level) {
+  unroll_options options;
+  if (level < 2) {
+    options.factor = 1;
+    options.budget = 0;
+  } else if (level >= 3) {
+    options.factor = 8;
+    options.budget = 256;
+  }
+  return options;
+}
+
+void unroll_loops(instruction_vec& i_vec, label_table& table, const unroll_options& options,
+                  optimization_stats& stats) {
+  analysis_manager analyses(i_vec, table);
+  unroll_loops(i_vec, table, analyses, options, stats);
+}
+
+void unroll_loops(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                  const unroll_options& options, optimization_stats& stats) {
+  const auto& graph = analyses.blocks();
+  if (graph.blocks.empty()) {
+    return;
+  }
+  const auto& universe = analyses.universe();
+  std::map<std::string, std::string> types;
+  for (const auto& instr : i_vec) {
+    if (instr->type == op_var) {
+      const auto& decl = static_cast<const binary_instruction&>(*instr);
+      types.insert({decl.arg_1, decl.arg_2});
+    }
+  }
+  std::set<std::string> taken;
+  size_t temp_counter = 0;
+  auto make_temp = [&]() {
+    std::string name;
+    do {
+      name = "unroll_tmp_" + std::to_string(temp_counter++);
+    } while (universe.find(name) >= 0 || !taken.insert(name).second);
+    return name;
+  };
+  size_t growth = 0;
+  instruction_edits edits;
+  bool unrolled = false;
+  // loops made of single block are innermost and do not overlap, with profile
+  // budget goes to those run most often
+  auto loops = find_natural_loops(graph, analyses.dominators());
+  auto header_count = [&](const natural_loop& loop) {
+    return i_vec[graph.blocks[loop.header].first]->profile_count;
+  };
+  std::stable_sort(loops.begin(), loops.end(), [&](const natural_loop& a, const natural_loop& b) {
+    return header_count(a) > header_count(b);
+  });
+  for (const auto& loop : loops) {
+    counting_loop counting;
+    if (!match_counting_loop(i_vec, graph, loop, counting) || counting.size == 0) {
+      continue;
+    }
+    // loops which never ran are not worth the growth
+    const auto& latch = *i_vec[counting.last];
+    if (latch.profile_count == 0) {
+      continue;
+    }
+    int32_t start = 0;
+    if (is_constant(counting.bound) &&
+        initial_value(i_vec, graph, loop.header, counting.induction, start)) {
+      auto trips = count_trips(counting, start, (options.budget - growth) / counting.size + 1);
+      if (trips != 0) {
+        // original body stays as the last copy
+        instruction_vec copies;
+        copy_body(i_vec, counting, trips - 1, copies);
+        for (auto& instr : copies) {
+          edits.insert_before(counting.first, std::move(instr));
+        }
+        edits.erase(counting.last);
+        growth += (trips - 1) * counting.size;
+        ++stats.unrolled_loops;
+        unrolled = true;
+        continue;
+      }
+    }
+    auto cost = options.factor * counting.size;
+    if (options.factor < 2 || growth + cost > options.budget) {
+      continue;
+    }
+    // chunk of factor iterations would rarely run
+    auto entries = latch.profile_count - latch.profile_taken;
+    if (latch.profile_taken >= 0 && entries > 0 &&
+        latch.profile_count < static_cast<int64_t>(options.factor) * entries) {
+      continue;
+    }
+    auto type = types.find(counting.induction);
+    if (unroll_partially(i_vec, table, counting, options.factor, make_temp,
+                         type == types.end() ? "int32" : type->second, edits)) {
+      growth += cost;
+      ++stats.partially_unrolled_loops;
+      unrolled = true;
+    }
+  }
+  if (unrolled) {
+    apply_instruction_edits(i_vec, table, edits);
+  }
+}
@@ -12,6 +12,10 @@ bool is_identifier(char c) {
   return isalpha(c) || c == '_';
 }
 
+bool is_identifier_tail(char c) {
+  return isalnum(c) || c == '_';
+}
+
 bool iscolon(char c) {
   return c == ':';
 }
@@ -36,7 +40,7 @@ std::string getNextToken(scanning_state& state) {
     state.current = end;
   }
   if (!state.eof() && is_identifier(*state.current)) {
-    auto token_end = std::find_if_not(state.current, state.end, is_identifier);
+    auto token_end = std::find_if_not(state.current, state.end, is_identifier_tail);
     std::string token = std::string(state.current, token_end);
     state.current = token_end;
 
@@ -72,16 +76,23 @@ std::string getNextToken(scanning_state& state) {
   return "";
 }
 
+std::string getNextOperand(scanning_state& state) {
+  auto token = getNextToken(state);
+  if (token == "-") {
+    token += getNextToken(state);
+  }
+  return token;
+}
+
 void parse_var(instruction_vec& i_vec, scanning_state& state) {
   auto arg = getNextToken(state);
   auto type = getNextToken(state);
-  auto type_size = getNextToken(state);
-  i_vec.push_back(std::make_unique<binary_instruction>(op_var, arg, type + type_size));
+  i_vec.push_back(std::make_unique<binary_instruction>(op_var, arg, type));
 }
 
 void parse_mov(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
   i_vec.push_back(std::make_unique<binary_instruction>(op_mov, arg_1, arg_2));
 }
 
@@ -123,7 +134,7 @@ void parse_call(instruction_vec& i_vec, scanning_state& state) {
   std::string token;
   // handle function signature
   do {
-    token = getNextToken(state);
+    token = getNextOperand(state);
     if (token != ")") {
       function_args.push_back(token);
     }
@@ -137,39 +148,65 @@ void parse_ret(instruction_vec& i_vec, scanning_state& state) {
 
 void parse_add(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_add, arg_1, arg_2, arg_3));
 }
 
 void parse_sub(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_sub, arg_1, arg_2, arg_3));
 }
 
 void parse_mul(instruction_vec &i_vec, scanning_state &state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(
       std::make_unique<three_addr_instruction>(op_mul, arg_1, arg_2, arg_3));
 }
 
 void parse_div(instruction_vec &i_vec, scanning_state &state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(
       std::make_unique<three_addr_instruction>(op_div, arg_1, arg_2, arg_3));
 }
 
+void parse_shl(instruction_vec& i_vec, scanning_state& state) {
+  auto arg_1 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
+  i_vec.push_back(std::make_unique<three_addr_instruction>(op_shl, arg_1, arg_2, arg_3));
+}
+
+void parse_sar(instruction_vec& i_vec, scanning_state& state) {
+  auto arg_1 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
+  i_vec.push_back(std::make_unique<three_addr_instruction>(op_sar, arg_1, arg_2, arg_3));
+}
+
+void parse_udiv(instruction_vec& i_vec, scanning_state& state) {
+  auto arg_1 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
+  i_vec.push_back(std::make_unique<three_addr_instruction>(op_udiv, arg_1, arg_2, arg_3));
+}
+
 void parse_new(instruction_vec& i_vec, scanning_state& state) {
   auto arg = getNextToken(state);
   i_vec.push_back(std::make_unique<unary_instruction>(op_new, arg));
 }
 
+void parse_alloca(instruction_vec& i_vec, scanning_state& state) {
+  auto arg = getNextToken(state);
+  i_vec.push_back(std::make_unique<unary_instruction>(op_alloca, arg));
+}
+
 void parse_delete(instruction_vec& i_vec, scanning_state& state) {
   auto arg = getNextToken(state);
   i_vec.push_back(std::make_unique<unary_instruction>(op_delete, arg));
@@ -177,43 +214,43 @@ void parse_delete(instruction_vec& i_vec, scanning_state& state) {
 
 void parse_cmp_eq(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_cmp_eq, arg_1, arg_2, arg_3));
 }
 
 void parse_cmp_neq(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_cmp_neq, arg_1, arg_2, arg_3));
 }
 
 void parse_cmp_lt(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_cmp_lt, arg_1, arg_2, arg_3));
 }
 
 void parse_cmp_lte(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_cmp_lte, arg_1, arg_2, arg_3));
 }
 
 void parse_cmp_gt(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_cmp_gt, arg_1, arg_2, arg_3));
 }
 
 void parse_cmp_gte(instruction_vec& i_vec, scanning_state& state) {
   auto arg_1 = getNextToken(state);
-  auto arg_2 = getNextToken(state);
-  auto arg_3 = getNextToken(state);
+  auto arg_2 = getNextOperand(state);
+  auto arg_3 = getNextOperand(state);
   i_vec.push_back(std::make_unique<three_addr_instruction>(op_cmp_gte, arg_1, arg_2, arg_3));
 }
 
@@ -251,6 +288,20 @@ void parse_function(instruction_vec& i_vec, scanning_state& state, label_table&
       op_function, function_args, std::move(body)));
 }
 
+void parse_phi(instruction_vec& i_vec, scanning_state& state) {
+  auto dest = getNextToken(state);
+  auto open_bracket = getNextToken(state);
+  std::vector<std::string> args;
+  std::string token;
+  do {
+    token = getNextOperand(state);
+    if (token != ")") {
+      args.push_back(token);
+    }
+  } while (token != ")" && !state.eof());
+  i_vec.push_back(std::make_unique<phi_instruction>(op_phi, dest, args));
+}
+
 void parse_nop(instruction_vec& i_vec, scanning_state& state, label_table& table) {
   i_vec.push_back(std::make_unique<noarg_instruction>(op_nop));
 }
@@ -294,10 +345,18 @@ std::string parse_instruction(instruction_vec &program, scanning_state &state,
     parse_mul(program, state);
   } else if (token == "div") {
     parse_div(program, state);
+  } else if (token == "shl") {
+    parse_shl(program, state);
+  } else if (token == "sar") {
+    parse_sar(program, state);
+  } else if (token == "udiv") {
+    parse_udiv(program, state);
   } else if (token == "new") {
     parse_new(program, state);
   } else if (token == "delete") {
     parse_delete(program, state);
+  } else if (token == "alloca") {
+    parse_alloca(program, state);
   } else if (token == "cmp_eq") {
     parse_cmp_eq(program, state);
   } else if (token == "cmp_neq") {
@@ -316,6 +375,8 @@ std::string parse_instruction(instruction_vec &program, scanning_state &state,
     parse_function(program, state, table);
   } else if (token == "nop") {
     parse_nop(program, state, table);
+  } else if (token == "phi") {
+    parse_phi(program, state);
   } else if (!state.eof()) {
     throw parse_exception("undefined opcode : " + token +
                           " in line : " + std::to_string(state.line_number));
@@ -335,7 +396,6 @@ instruction_vec parse(const std::string& filename, label_table& table) {
 }
 
 control_flow_graph build_cfg(const instruction_vec& i_vec, const label_table& table) {
-  std::stack<int> call_stack;
   control_flow_graph cfg;
   if (i_vec.empty()) {
     return cfg;
@@ -345,8 +405,10 @@ control_flow_graph build_cfg(const instruction_vec& i_vec, const label_table& ta
     return cfg;
   }
   for (int i_index = 0; i_index < i_vec.size();++i_index) {
-    if (i_vec[i_index]->type != op_jmp && i_vec[i_index]->type != op_call &&
-        i_vec[i_index]->type != op_if && i_vec[i_index]->type != op_ret) {
+    // call always returns to the next instruction
+    // so from intraprocedural point of view it's just sequential code
+    if (i_vec[i_index]->type != op_jmp && i_vec[i_index]->type != op_if &&
+        i_vec[i_index]->type != op_ret) {
       // last instruction does not have continuation
       // insert -1 in this case
       if (i_index == i_vec.size() - 1) {
@@ -379,22 +441,24 @@ control_flow_graph build_cfg(const instruction_vec& i_vec, const label_table& ta
       } else {
         cfg.insert({i_index, i_index + 1});
       }
-    } else if (i_vec[i_index]->type == op_call) {
-      auto arg = static_cast<unary_instruction*>(i_vec[i_index].get())->arg_1;
-      cfg.insert({i_index, i_index + std::stoi(arg)});
-      cfg.insert({i_index, i_index + 1});
-      call_stack.push(i_index);
     } else if (i_vec[i_index]->type == op_ret) {
-      if (!call_stack.empty()) {
-        auto new_index = call_stack.top();
-        call_stack.pop();
-        cfg.insert({i_index, new_index + 1});
-      }
+      cfg.insert({i_index, -1});
     }
   }
   return cfg;
 }
 
+int branch_target(const instruction_vec& i_vec, const label_table& table, int i_index) {
+  const auto& instr = i_vec[i_index];
+  auto arg = instr->type == op_jmp ? static_cast<unary_instruction*>(instr.get())->arg_1
+                                   : static_cast<binary_instruction*>(instr.get())->arg_2;
+  if (is_constant(arg)) {
+    return i_index + std::stoi(arg);
+  }
+  auto label_it = table.instance.find(arg);
+  return label_it == table.instance.end() ? -1 : label_it->second;
+}
+
 control_flow_graph build_backward_cfg(const control_flow_graph& cfg) {
   control_flow_graph backward_cfg;
   for (const auto& node : cfg) {
@@ -405,75 +469,408 @@ control_flow_graph build_backward_cfg(const control_flow_graph& cfg) {
   return backward_cfg;
 }
 
+block_graph build_basic_blocks(const instruction_vec& i_vec, const control_flow_graph& cfg) {
+  block_graph graph;
+  const int size = static_cast<int>(i_vec.size());
+  graph.instruction_block.assign(size, -1);
+  if (size == 0) {
+    return graph;
+  }
+  // leaders are first instruction, targets of jumps
+  // and instructions which follow any non sequential instruction
+  std::vector<bool> leaders(size, false);
+  leaders[0] = true;
+  for (int i_index = 0; i_index < size; ++i_index) {
+    auto range = cfg.equal_range(i_index);
+    if (std::distance(range.first, range.second) == 1 && range.first->second == i_index + 1) {
+      continue;
+    }
+    if (i_index + 1 < size) {
+      leaders[i_index + 1] = true;
+    }
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second >= 0 && it->second < size) {
+        leaders[it->second] = true;
+      }
+    }
+  }
+  for (int i_index = 0; i_index < size; ++i_index) {
+    if (leaders[i_index]) {
+      basic_block block;
+      block.first = i_index;
+      graph.blocks.push_back(block);
+    }
+    graph.blocks.back().last = i_index;
+    graph.instruction_block[i_index] = graph.blocks.size() - 1;
+  }
+  for (int b_index = 0; b_index < graph.blocks.size(); ++b_index) {
+    auto& block = graph.blocks[b_index];
+    auto range = cfg.equal_range(block.last);
+    for (auto it = range.first; it != range.second; ++it) {
+      // -1 and out of range targets leave the program
+      if (it->second < 0 || it->second >= size) {
+        continue;
+      }
+      auto succ = graph.instruction_block[it->second];
+      if (std::find(block.successors.begin(), block.successors.end(), succ) ==
+          block.successors.end()) {
+        block.successors.push_back(succ);
+        graph.blocks[succ].predecessors.push_back(b_index);
+      }
+    }
+  }
+  return graph;
+}
+
+dominator_tree build_dominator_tree(const block_graph& graph) {
+  dominator_tree tree;
+  const int blocks = graph.blocks.size();
+  tree.idom.assign(blocks, -1);
+  tree.children.assign(blocks, {});
+  tree.dfs_in.assign(blocks, -1);
+  tree.dfs_out.assign(blocks, -1);
+  if (blocks == 0) {
+    return tree;
+  }
+
+  // postorder of blocks reachable from entry
+  std::vector<int> postorder_index(blocks, -1);
+  std::vector<int> postorder;
+  std::vector<bool> visited(blocks, false);
+  std::vector<std::pair<int, size_t>> dfs_stack;
+  dfs_stack.push_back({0, 0});
+  visited[0] = true;
+  while (!dfs_stack.empty()) {
+    auto& top = dfs_stack.back();
+    const auto& successors = graph.blocks[top.first].successors;
+    if (top.second < successors.size()) {
+      auto succ = successors[top.second++];
+      if (!visited[succ]) {
+        visited[succ] = true;
+        dfs_stack.push_back({succ, 0});
+      }
+    } else {
+      postorder_index[top.first] = postorder.size();
+      postorder.push_back(top.first);
+      dfs_stack.pop_back();
+    }
+  }
+  tree.reverse_postorder.assign(postorder.rbegin(), postorder.rend());
+
+  // Cooper, Harvey, Kennedy "A Simple, Fast Dominance Algorithm"
+  auto intersect = [&](int a, int b) {
+    while (a != b) {
+      while (postorder_index[a] < postorder_index[b]) {
+        a = tree.idom[a];
+      }
+      while (postorder_index[b] < postorder_index[a]) {
+        b = tree.idom[b];
+      }
+    }
+    return a;
+  };
+  tree.idom[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto b_index : tree.reverse_postorder) {
+      if (b_index == 0) {
+        continue;
+      }
+      int new_idom = -1;
+      for (auto pred : graph.blocks[b_index].predecessors) {
+        if (tree.idom[pred] == -1) {
+          continue;
+        }
+        new_idom = new_idom == -1 ? pred : intersect(pred, new_idom);
+      }
+      if (new_idom != tree.idom[b_index]) {
+        tree.idom[b_index] = new_idom;
+        changed = true;
+      }
+    }
+  }
+  tree.idom[0] = -1;
+  for (auto b_index : tree.reverse_postorder) {
+    if (tree.idom[b_index] != -1) {
+      tree.children[tree.idom[b_index]].push_back(b_index);
+    }
+  }
+
+  // interval numbering answers dominance queries in constant time
+  int counter = 0;
+  dfs_stack.clear();
+  dfs_stack.push_back({0, 0});
+  tree.dfs_in[0] = counter++;
+  while (!dfs_stack.empty()) {
+    auto& top = dfs_stack.back();
+    const auto& children = tree.children[top.first];
+    if (top.second < children.size()) {
+      auto child = children[top.second++];
+      tree.dfs_in[child] = counter++;
+      dfs_stack.push_back({child, 0});
+    } else {
+      tree.dfs_out[top.first] = counter++;
+      dfs_stack.pop_back();
+    }
+  }
+  return tree;
+}
+
+bool dominator_tree::dominates(int a, int b) const {
+  if (dfs_in[a] == -1 || dfs_in[b] == -1) {
+    return false;
+  }
+  return dfs_in[a] <= dfs_in[b] && dfs_out[b] <= dfs_out[a];
+}
+
+std::vector<std::vector<int>> dominance_frontiers(const block_graph& graph,
+                                                  const dominator_tree& tree) {
+  std::vector<std::vector<int>> frontiers(graph.blocks.size());
+  for (int b_index = 0; b_index < graph.blocks.size(); ++b_index) {
+    const auto& preds = graph.blocks[b_index].predecessors;
+    if (preds.size() < 2 || tree.dfs_in[b_index] == -1) {
+      continue;
+    }
+    for (auto pred : preds) {
+      auto runner = pred;
+      while (runner != -1 && runner != tree.idom[b_index] && tree.dfs_in[runner] != -1) {
+        auto& frontier = frontiers[runner];
+        if (frontier.empty() || frontier.back() != b_index) {
+          frontier.push_back(b_index);
+        }
+        runner = tree.idom[runner];
+      }
+    }
+  }
+  return frontiers;
+}
+
+std::vector<natural_loop> find_natural_loops(const block_graph& graph, const dominator_tree& tree) {
+  std::map<int, natural_loop> loops;
+  for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    if (tree.dfs_in[b_index] == -1) {
+      continue;
+    }
+    for (auto succ : graph.blocks[b_index].successors) {
+      if (tree.dominates(succ, b_index)) {
+        loops[succ].header = succ;
+        loops[succ].latches.push_back(b_index);
+      }
+    }
+  }
+  std::vector<natural_loop> result;
+  for (auto& entry : loops) {
+    auto& loop = entry.second;
+    std::vector<bool> in_loop(graph.blocks.size(), false);
+    in_loop[loop.header] = true;
+    std::vector<int> work_list(loop.latches.begin(), loop.latches.end());
+    while (!work_list.empty()) {
+      auto b_index = work_list.back();
+      work_list.pop_back();
+      if (in_loop[b_index]) {
+        continue;
+      }
+      in_loop[b_index] = true;
+      for (auto pred : graph.blocks[b_index].predecessors) {
+        work_list.push_back(pred);
+      }
+    }
+    for (int b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+      if (in_loop[b_index]) {
+        loop.blocks.push_back(b_index);
+      }
+    }
+    result.push_back(std::move(loop));
+  }
+  // loop has more blocks than any loop nested in it
+  std::stable_sort(result.begin(), result.end(), [](const natural_loop& a, const natural_loop& b) {
+    return a.blocks.size() > b.blocks.size();
+  });
+  return result;
+}
+
+std::vector<int> loop_depths(const block_graph& graph, const std::vector<natural_loop>& loops) {
+  std::vector<int> depths(graph.blocks.size(), 0);
+  for (const auto& loop : loops) {
+    for (auto b_index : loop.blocks) {
+      ++depths[b_index];
+    }
+  }
+  return depths;
+}
+
+bool is_constant(const std::string& arg) {
+  if (arg.empty()) {
+    return false;
+  }
+  if (isminus(arg[0])) {
+    return arg.size() > 1 && isdigit(arg[1]);
+  }
+  return isdigit(arg[0]);
+}
+
+namespace {
+void visit_variable(std::string& arg, const operand_visitor& visitor) {
+  if (!arg.empty() && !is_constant(arg)) {
+    visitor(arg);
+  }
+}
+}  // namespace
+
+void visit_use_operands(instruction& instr, const operand_visitor& visitor) {
+  switch (instr.type) {
+    case op_mov:
+      visit_variable(static_cast<binary_instruction&>(instr).arg_2, visitor);
+      break;
+    case op_push:
+    case op_delete:
+      visit_variable(static_cast<unary_instruction&>(instr).arg_1, visitor);
+      break;
+    case op_if:
+      visit_variable(static_cast<binary_instruction&>(instr).arg_1, visitor);
+      break;
+    case op_phi:
+      for (auto& arg : static_cast<phi_instruction&>(instr).args) {
+        visit_variable(arg, visitor);
+      }
+      break;
+    case op_call: {
+      // args[0] is function name
+      auto& args = static_cast<call_instruction&>(instr).args;
+      for (size_t arg_index = 1; arg_index < args.size(); ++arg_index) {
+        visit_variable(args[arg_index], visitor);
+      }
+      break;
+    }
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_div:
+    case op_shl:
+    case op_sar:
+    case op_udiv:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+      visit_variable(static_cast<three_addr_instruction&>(instr).arg_2, visitor);
+      visit_variable(static_cast<three_addr_instruction&>(instr).arg_3, visitor);
+      break;
+    default:
+      break;
+  }
+}
+
+void visit_def_operands(instruction& instr, const operand_visitor& visitor) {
+  switch (instr.type) {
+    case op_mov:
+      visit_variable(static_cast<binary_instruction&>(instr).arg_1, visitor);
+      break;
+    case op_pop:
+    case op_new:
+    case op_alloca:
+      visit_variable(static_cast<unary_instruction&>(instr).arg_1, visitor);
+      break;
+    case op_add:
+    case op_sub:
+    case op_mul:
+    case op_div:
+    case op_shl:
+    case op_sar:
+    case op_udiv:
+    case op_cmp_eq:
+    case op_cmp_neq:
+    case op_cmp_gt:
+    case op_cmp_lt:
+    case op_cmp_lte:
+    case op_cmp_gte:
+      visit_variable(static_cast<three_addr_instruction&>(instr).arg_1, visitor);
+      break;
+    case op_pop_args:
+      for (auto& arg : static_cast<pop_args_instruction&>(instr).args) {
+        visit_variable(arg.first, visitor);
+      }
+      break;
+    case op_phi:
+      visit_variable(static_cast<phi_instruction&>(instr).dest, visitor);
+      break;
+    default:
+      break;
+  }
+}
+
+void instruction_uses(const instruction& instr, std::vector<std::string>& out_uses) {
+  visit_use_operands(const_cast<instruction&>(instr),
+                     [&out_uses](std::string& arg) { out_uses.push_back(arg); });
+}
+
+void instruction_defs(const instruction& instr, std::vector<std::string>& out_defs) {
+  visit_def_operands(const_cast<instruction&>(instr),
+                     [&out_defs](std::string& arg) { out_defs.push_back(arg); });
+}
+
 void build_use_def_sets(const instruction_vec& i_vec, gen_set& out_gen_set,
                         kill_set& out_kill_set) {
+  std::vector<std::string> uses;
+  std::vector<std::string> defs;
   for (int i_index = 0; i_index < i_vec.size(); ++i_index) {
-    switch (i_vec[i_index]->type) {
-      case op_var:  // for decl, do nothing
-        break;
-      case op_mov:
-        out_kill_set[i_index].push_back(
-            static_cast<binary_instruction*>(i_vec[i_index].get())->arg_1);
-        if (static_cast<binary_instruction*>(i_vec[i_index].get())->arg_2[0] != '-' &&
-            !isdigit(static_cast<binary_instruction*>(i_vec[i_index].get())->arg_2[0])) {
-          out_gen_set[i_index].push_back(
-              static_cast<binary_instruction*>(i_vec[i_index].get())->arg_2);
-        }
-        break;
-      case op_push:
-        out_gen_set[i_index].push_back(
-            static_cast<unary_instruction*>(i_vec[i_index].get())->arg_1);
-        break;
-      case op_pop:
-        out_gen_set[i_index].push_back(
-            static_cast<unary_instruction*>(i_vec[i_index].get())->arg_1);
-        break;
-      case op_jmp:  // for unconditional jmp, do nothing
-        break;
-      case op_if:
-        out_gen_set[i_index].push_back(
-            static_cast<binary_instruction*>(i_vec[i_index].get())->arg_1);
-        break;
-      case op_call:  // do nothing
-      case op_function:
-        break;
-      case op_add:
-      case op_sub:
-      case op_mul:
-      case op_div:
-        out_kill_set[i_index].push_back(
-            static_cast<three_addr_instruction*>(i_vec[i_index].get())->arg_1);
-        out_gen_set[i_index].push_back(
-            static_cast<three_addr_instruction*>(i_vec[i_index].get())->arg_2);
-        out_gen_set[i_index].push_back(
-            static_cast<three_addr_instruction*>(i_vec[i_index].get())->arg_3);
-        break;
-      case op_ret:  // do nothing
-        break;
-      case op_new:
-      case op_delete:
-        out_gen_set[i_index].push_back(
-            static_cast<three_addr_instruction*>(i_vec[i_index].get())->arg_1);
-        break;
-      case op_cmp_eq:
-      case op_cmp_neq:
-      case op_cmp_gt:
-      case op_cmp_lt:
-      case op_cmp_lte:
-      case op_cmp_gte:
-        out_kill_set[i_index].push_back(
-            static_cast<three_addr_instruction*>(i_vec[i_index].get())->arg_1);
-        out_gen_set[i_index].push_back(
-            static_cast<three_addr_instruction*>(i_vec[i_index].get())->arg_2);
-        out_gen_set[i_index].push_back(
-            static_cast<three_addr_instruction*>(i_vec[i_index].get())->arg_3);
-        break;
-      case op_label:  // do nothing
-        break;
+    uses.clear();
+    defs.clear();
+    instruction_uses(*i_vec[i_index], uses);
+    instruction_defs(*i_vec[i_index], defs);
+    if (!uses.empty()) {
+      out_gen_set[i_index] = uses;
+    }
+    if (!defs.empty()) {
+      out_kill_set[i_index] = defs;
     }
   }
 }
 
+int variable_universe::add(const std::string& name) {
+  auto it = index.find(name);
+  if (it != index.end()) {
+    return it->second;
+  }
+  int var_index = names.size();
+  index.insert({name, var_index});
+  names.push_back(name);
+  return var_index;
+}
+
+int variable_universe::find(const std::string& name) const {
+  auto it = index.find(name);
+  if (it == index.end()) {
+    return -1;
+  }
+  return it->second;
+}
+
+variable_universe build_variable_universe(const instruction_vec& i_vec) {
+  variable_universe universe;
+  std::vector<std::string> args;
+  for (const auto& instr : i_vec) {
+    args.clear();
+    if (instr->type == op_var) {
+      args.push_back(static_cast<binary_instruction*>(instr.get())->arg_1);
+    }
+    instruction_uses(*instr, args);
+    instruction_defs(*instr, args);
+    for (const auto& arg : args) {
+      universe.add(arg);
+    }
+  }
+  // numbering follows names order so that sets built from bits are sorted
+  std::sort(universe.names.begin(), universe.names.end());
+  for (int var_index = 0; var_index != universe.names.size(); ++var_index) {
+    universe.index[universe.names[var_index]] = var_index;
+  }
+  return universe;
+}
+
 void dump_raw_use_def_set_impl(const std::map<int, std::vector<std::string>>& input_set,
                                std::ostream& out) {
   for (const auto& node : input_set) {
@@ -643,99 +1040,247 @@ void dump_raw_liveness(const liveness_sets& liveness_sets_input, std::ostream& o
   }
 }
 
-liveness_sets liveness_analysis(const instruction_vec& i_vec, const control_flow_graph& cfg) {
-  const auto backward_cfg = build_backward_cfg(cfg);
-  gen_set output_gen_set;
-  kill_set output_kill_set;
-  build_use_def_sets(i_vec, output_gen_set, output_kill_set);
+namespace {
+// backward bit vector dataflow restricted to words [first_word, last_word)
+// blocks are visited in reverse linear order, which for reducible flow graphs
+// converges in number of passes bounded by loop nesting depth
+void solve_liveness_partition(const block_graph& graph, const std::vector<bit_vector>& gen,
+                              const std::vector<bit_vector>& kill, block_liveness& result,
+                              size_t first_word, size_t last_word) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int b_index = graph.blocks.size() - 1; b_index >= 0; --b_index) {
+      const auto& block = graph.blocks[b_index];
+      auto& live_in = result.live_in[b_index];
+      auto& live_out = result.live_out[b_index];
+      for (size_t word = first_word; word != last_word; ++word) {
+        // OUT(block) = U IN(s) where s E succ(block)
+        uint64_t out = 0;
+        for (auto succ : block.successors) {
+          out |= result.live_in[succ][word];
+        }
+        live_out[word] = out;
+        // IN(block) = GEN(block) U (OUT(block) -- KILL(block))
+        uint64_t in = gen[b_index][word] | (out & ~kill[b_index][word]);
+        if (in != live_in[word]) {
+          live_in[word] = in;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+}  // namespace
+
+block_liveness block_liveness_analysis(const instruction_vec& i_vec, const block_graph& graph,
+                                       const variable_universe& universe,
+                                       const liveness_options& options) {
+  const size_t words = bit_vector_words(universe.size());
+  const size_t blocks = graph.blocks.size();
+  std::vector<bit_vector> gen(blocks, bit_vector(words, 0));
+  std::vector<bit_vector> kill(blocks, bit_vector(words, 0));
+  std::vector<std::string> uses;
+  std::vector<std::string> defs;
+  for (size_t b_index = 0; b_index != blocks; ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    for (int i_index = block.last; i_index >= block.first; --i_index) {
+      uses.clear();
+      defs.clear();
+      instruction_uses(*i_vec[i_index], uses);
+      instruction_defs(*i_vec[i_index], defs);
+      for (const auto& var : defs) {
+        auto var_index = universe.find(var);
+        set_bit(kill[b_index], var_index);
+        clear_bit(gen[b_index], var_index);
+      }
+      for (const auto& var : uses) {
+        set_bit(gen[b_index], universe.find(var));
+      }
+    }
+  }
 
-  std::vector<std::string> in_set;
-  std::vector<std::string> out_set;
-  liveness_sets liveness_map;
+  block_liveness result;
+  result.live_in.assign(blocks, bit_vector(words, 0));
+  result.live_out.assign(blocks, bit_vector(words, 0));
 
-  auto end_node_it = backward_cfg.find(-1);
-  auto range = backward_cfg.equal_range(-1);
-  // end node must always exists
-  assert(end_node_it != backward_cfg.end());
-  // end node has only one predessor
-  assert(std::distance(range.first, range.second) == 1);
-
-  auto end_node = end_node_it->second;
-  std::stack<int> workList;
-  workList.push(end_node);
-  while (!workList.empty()) {
-    auto current_node = workList.top();
-    workList.pop();
-
-    // OUT(node) = U IN(p) where p E succ(node)
-    std::vector<std::string> union_of_in_set;
-    auto successors_range = cfg.equal_range(current_node);
-    for (auto succ_begin = successors_range.first; succ_begin != successors_range.second;
-         ++succ_begin) {
-      std::set_union(liveness_map[succ_begin->second].in_set.begin(),
-                     liveness_map[succ_begin->second].in_set.end(), union_of_in_set.begin(),
-                     union_of_in_set.end(),
-                     std::inserter(union_of_in_set, union_of_in_set.begin()));
-    }
-    liveness_map[current_node].out_set = union_of_in_set;
-
-    // IN(node) = (OUT(node -- KILL_SET(node)) U GEN_SET(node)
-    std::vector<std::string> out_kill_diff;
-    std::set_difference(liveness_map[current_node].out_set.begin(),
-                        liveness_map[current_node].out_set.end(),
-                        output_kill_set[current_node].begin(), output_kill_set[current_node].end(),
-                        std::inserter(out_kill_diff, out_kill_diff.begin()));
-
-    std::set_union(out_kill_diff.begin(), out_kill_diff.end(), output_gen_set[current_node].begin(),
-                   output_gen_set[current_node].end(),
-                   std::inserter(liveness_map[current_node].in_set,
-                                 liveness_map[current_node].in_set.begin()));
-
-    auto next_node_it = backward_cfg.find(current_node);
-    if (next_node_it != backward_cfg.end()) {
-      workList.push(next_node_it->second);
+  size_t partition_words = words;
+  if (options.partition_bits != 0) {
+    partition_words = std::max<size_t>(1, options.partition_bits / bits_per_word);
+  }
+  const size_t partitions = words == 0 ? 0 : (words + partition_words - 1) / partition_words;
+  auto solve = [&](size_t partition) {
+    auto first_word = partition * partition_words;
+    auto last_word = std::min(words, first_word + partition_words);
+    solve_liveness_partition(graph, gen, kill, result, first_word, last_word);
+  };
+
+  const size_t threads = std::min(options.threads, partitions);
+  if (threads <= 1) {
+    for (size_t partition = 0; partition != partitions; ++partition) {
+      solve(partition);
     }
+    return result;
+  }
+  // cfg, gen and kill sets are shared read only
+  // every partition writes only its own words of live sets
+  std::atomic<size_t> next_partition(0);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t != threads; ++t) {
+    workers.emplace_back([&]() {
+      for (auto partition = next_partition++; partition < partitions;
+           partition = next_partition++) {
+        solve(partition);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
   }
+  return result;
+}
+
+liveness_sets liveness_analysis(const instruction_vec& i_vec, const control_flow_graph& cfg) {
+  return liveness_analysis(i_vec, cfg, liveness_options());
+}
 
+liveness_sets liveness_analysis(const instruction_vec& i_vec, const control_flow_graph& cfg,
+                                const liveness_options& options) {
+  const auto graph = build_basic_blocks(i_vec, cfg);
+  const auto universe = build_variable_universe(i_vec);
+  const auto block_sets = block_liveness_analysis(i_vec, graph, universe, options);
+  return expand_block_liveness(i_vec, graph, universe, block_sets);
+}
+
+liveness_sets expand_block_liveness(const instruction_vec& i_vec, const block_graph& graph,
+                                    const variable_universe& universe,
+                                    const block_liveness& block_sets) {
+  auto to_names = [&universe](const bit_vector& bits) {
+    std::vector<std::string> names;
+    for (size_t var_index = 0; var_index != universe.size(); ++var_index) {
+      if (test_bit(bits, var_index)) {
+        names.push_back(universe.names[var_index]);
+      }
+    }
+    return names;
+  };
+
+  liveness_sets liveness_map;
+  std::vector<std::string> uses;
+  std::vector<std::string> defs;
+  for (size_t b_index = 0; b_index != graph.blocks.size(); ++b_index) {
+    const auto& block = graph.blocks[b_index];
+    auto live = block_sets.live_out[b_index];
+    for (int i_index = block.last; i_index >= block.first; --i_index) {
+      liveness_map[i_index].out_set = to_names(live);
+      uses.clear();
+      defs.clear();
+      instruction_uses(*i_vec[i_index], uses);
+      instruction_defs(*i_vec[i_index], defs);
+      for (const auto& var : defs) {
+        clear_bit(live, universe.find(var));
+      }
+      for (const auto& var : uses) {
+        set_bit(live, universe.find(var));
+      }
+      liveness_map[i_index].in_set = to_names(live);
+    }
+  }
   return liveness_map;
 }
 
-variable_interval_map compute_variables_live_ranges(const liveness_sets& live_sets) {
+namespace {
+// ranges are collected backwards, so the last element is always the earliest one
+void add_live_range(live_interval& interval, size_t from, size_t to) {
+  auto& ranges = interval.ranges;
+  if (!ranges.empty() && ranges.back().first <= to + 1) {
+    ranges.back().first = std::min(ranges.back().first, from);
+    ranges.back().second = std::max(ranges.back().second, to);
+    return;
+  }
+  ranges.push_back({from, to});
+}
+}  // namespace
+
+live_interval_vec build_live_intervals(const instruction_vec& i_vec, const block_graph& graph,
+                                       const variable_universe& universe,
+                                       const block_liveness& liveness) {
+  live_interval_vec intervals(universe.size());
+  for (size_t var_index = 0; var_index != universe.size(); ++var_index) {
+    intervals[var_index].variable = universe.names[var_index];
+  }
+  std::vector<std::string> uses;
+  std::vector<std::string> defs;
+  for (int b_index = graph.blocks.size() - 1; b_index >= 0; --b_index) {
+    const auto& block = graph.blocks[b_index];
+    // everything live at the end of block is live across whole block
+    // until definition shortens it
+    auto live = liveness.live_out[b_index];
+    for (size_t word = 0; word != live.size(); ++word) {
+      for (auto bits = live[word]; bits != 0; bits &= bits - 1) {
+        auto var_index = word * bits_per_word + __builtin_ctzll(bits);
+        add_live_range(intervals[var_index], block.first, block.last);
+      }
+    }
+    for (int i_index = block.last; i_index >= block.first; --i_index) {
+      uses.clear();
+      defs.clear();
+      instruction_uses(*i_vec[i_index], uses);
+      instruction_defs(*i_vec[i_index], defs);
+      for (const auto& var : defs) {
+        auto var_index = universe.find(var);
+        auto& interval = intervals[var_index];
+        if (test_bit(live, var_index)) {
+          interval.ranges.back().first = i_index;
+          clear_bit(live, var_index);
+        } else {
+          // value is never read, still it occupies its location at definition
+          add_live_range(interval, i_index, i_index);
+        }
+        interval.use_positions.push_back(i_index);
+      }
+      for (const auto& var : uses) {
+        auto var_index = universe.find(var);
+        add_live_range(intervals[var_index], block.first, i_index);
+        if (intervals[var_index].use_positions.empty() ||
+            intervals[var_index].use_positions.back() != i_index) {
+          intervals[var_index].use_positions.push_back(i_index);
+        }
+        set_bit(live, var_index);
+      }
+    }
+  }
+  for (auto& interval : intervals) {
+    std::reverse(interval.ranges.begin(), interval.ranges.end());
+    std::reverse(interval.use_positions.begin(), interval.use_positions.end());
+  }
+  return intervals;
+}
+
+variable_interval_map variable_live_ranges(const live_interval_vec& intervals) {
   variable_interval_map variables_intervals;
-  std::multimap<std::string, int> variable_live_points;
-  for (const auto& in_out_live_set : live_sets) {
-    for (const auto& variable : in_out_live_set.second.in_set) {
-      variable_live_points.insert({variable, in_out_live_set.first});
-    }
-    for (const auto& variable : in_out_live_set.second.out_set) {
-      variable_live_points.insert({variable, in_out_live_set.first});
-    }
-  }
-  int previous = variable_live_points.begin()->second;
-  int begin = previous;
-  std::string previousVar = variable_live_points.begin()->first;
-  int index = 0;
-  for (const auto& var : variable_live_points) {
-    if (var.second - previous > 1 || var.first != previousVar) {
-      live_range range;
-      range.first = begin;
-      range.second = previous;
-      variables_intervals.insert({previousVar, range});
-      begin = var.second;
-      previousVar = var.first;
-    }
-    if (index == variable_live_points.size() - 1) {
-      live_range range;
-      range.first = begin;
-      range.second = var.second;
-      variables_intervals.insert({previousVar, range});
-    }
-    previous = var.second;
-    ++index;
+  for (const auto& interval : intervals) {
+    for (const auto& range : interval.ranges) {
+      variables_intervals.insert({interval.variable, range});
+    }
   }
   return variables_intervals;
 }
 
+void dump_live_intervals(const live_interval_vec& intervals, std::ostream& out) {
+  for (const auto& interval : intervals) {
+    out << interval.variable;
+    for (const auto& range : interval.ranges) {
+      out << " [" << range.first << "," << range.second << "]";
+    }
+    out << " uses :";
+    for (auto position : interval.use_positions) {
+      out << ' ' << position;
+    }
+    out << std::endl;
+  }
+}
+
 void dump_variable_intervals(const variable_interval_map& variables_intervals, std::ostream& out) {
   for (const auto& interval : variables_intervals) {
     out << interval.first << "[" << interval.second.first << "," << interval.second.second << "]"
@@ -800,57 +1345,227 @@ void generate_gnuplot_interval(const variable_interval_map& variables_intervals)
   }
 }
 
-instruction_vec remove_dead_code(const instruction_vec& i_vec,
-                                 const variable_interval_map& variables_intervals) {
-  instruction_vec optimized_i_vec;
-  std::set<size_t> added_instructions;
+void dump_optimization_stats(const optimization_stats& stats, std::ostream& out) {
+  out << "removed copies : " << stats.removed_copies << '\n';
+  out << "propagated constants : " << stats.propagated_constants << '\n';
+  out << "folded branches : " << stats.folded_branches << '\n';
+  out << "redundant expressions : " << stats.redundant_expressions << '\n';
+  out << "partially redundant expressions : " << stats.partially_redundant_expressions << '\n';
+  out << "known comparisons : " << stats.known_comparisons << '\n';
+  out << "narrowed operations : " << stats.narrowed_operations << '\n';
+  out << "promoted allocations : " << stats.promoted_allocations << '\n';
+  out << "replaced stack operations : " << stats.replaced_stack_operations << '\n';
+  out << "removed pure calls : " << stats.removed_pure_calls << '\n';
+  out << "unread call arguments : " << stats.unread_call_arguments << '\n';
+  out << "dead instructions : " << stats.dead_instructions << '\n';
+  out << "reduced operations : " << stats.reduced_operations << '\n';
+  out << "hoisted instructions : " << stats.hoisted_instructions << '\n';
+  out << "inlined calls : " << stats.inlined_calls << '\n';
+  out << "combined instructions : " << stats.combined_instructions << '\n';
+  out << "unreachable instructions : " << stats.unreachable_instructions << '\n';
+  out << "threaded jumps : " << stats.threaded_jumps << '\n';
+  out << "removed jumps : " << stats.removed_jumps << '\n';
+  out << "merged blocks : " << stats.merged_blocks << '\n';
+  out << "eliminated tail calls : " << stats.eliminated_tail_calls << '\n';
+  out << "unrolled loops : " << stats.unrolled_loops << '\n';
+  out << "partially unrolled loops : " << stats.partially_unrolled_loops << '\n';
+  out << "deleted loops : " << stats.deleted_loops << '\n';
+  out << "merged induction variables : " << stats.merged_induction_variables << '\n';
+  out << "reduced induction variables : " << stats.reduced_induction_variables << '\n';
+  out << "rewritten exit tests : " << stats.rewritten_exit_tests << '\n';
+  out << "moved blocks : " << stats.moved_blocks << '\n';
+}
 
-  for (int line_index = 0; line_index != i_vec.size(); ++line_index) {
-    const auto& instr = i_vec[line_index];
-    if (instr->type == op_var) {
-      // add all variables decl for now
-      auto var_name = static_cast<binary_instruction*>(instr.get())->arg_1;
-      std::unique_ptr<instruction> var_instr(instr->clone());
-      optimized_i_vec.push_back(std::move(var_instr));
-    }
-    // for now just copy function, nop, jmp, label and call statements
-    // their behavior should be correctly implemented during
-    // building use-def sets
-    else if (instr->type == op_function || instr->type == op_call || instr->type == op_jmp ||
-             instr->type == op_nop || instr->type == op_label) {
-      std::unique_ptr<instruction> var_instr(instr->clone());
-      optimized_i_vec.push_back(std::move(var_instr));
-    } else {
-      for (const auto& interval : variables_intervals) {
-        if (instr->is_arg_equal(interval.first)) {
-          // check live range
-          if (interval.second.first > line_index || interval.second.second < line_index) {
-            continue;
-          }
-          // intervals for different variable may overlap
-          // prevent that
-          if (added_instructions.find(line_index) != added_instructions.end()) {
-            continue;
-          }
-          std::unique_ptr<instruction> var_instr(instr->clone());
-          optimized_i_vec.push_back(std::move(var_instr));
-          added_instructions.insert(line_index);
+void dump_program(const instruction_vec& i_vec, std::ostream& out) {
+  for (const auto& i : i_vec) {
+    i->dump(out);
+    out << '\n';
+  }
+}
+
+void update_label_table(const instruction_vec& i_vec, label_table& table, size_t from) {
+  for (size_t i_index = from; i_index < i_vec.size(); ++i_index) {
+    if (i_vec[i_index]->type == op_label) {
+      // label points to instruction which follows it
+      table.instance[static_cast<unary_instruction*>(i_vec[i_index].get())->arg_1] = i_index + 1;
+    }
+  }
+}
+
+void instruction_edits::erase(size_t i_index) {
+  if (erased.size() <= i_index) {
+    erased.resize(i_index + 1, false);
+  }
+  erased[i_index] = true;
+}
+
+void instruction_edits::insert_before(size_t i_index, instruction_ptr instr) {
+  before[i_index].push_back(std::move(instr));
+}
+
+void instruction_edits::insert_after(size_t i_index, instruction_ptr instr) {
+  after[i_index].push_back(std::move(instr));
+}
+
+bool instruction_edits::empty() const {
+  return before.empty() && after.empty() &&
+         std::find(erased.begin(), erased.end(), true) == erased.end();
+}
+
+void apply_instruction_edits(instruction_vec& i_vec, label_table& table, instruction_edits& edits) {
+  const size_t size = i_vec.size();
+  edits.erased.resize(size, false);
+  // instructions before first edited position keep their indexes
+  size_t first = std::find(edits.erased.begin(), edits.erased.end(), true) - edits.erased.begin();
+  if (!edits.before.empty()) {
+    first = std::min(first, edits.before.begin()->first);
+  }
+  if (!edits.after.empty()) {
+    first = std::min(first, edits.after.begin()->first + 1);
+  }
+  if (first >= size && edits.before.empty() && edits.after.empty()) {
+    return;
+  }
+  first = std::min(first, size);
+
+  // every old position owns slot [before, instruction, after]
+  // jump to old position lands on first instruction of its slot
+  // or on the next non empty slot
+  std::vector<int> slot_start(size + 1);
+  std::vector<int> new_position(size);
+  int position = 0;
+  for (size_t i_index = 0; i_index != size; ++i_index) {
+    slot_start[i_index] = position;
+    auto before_it = edits.before.find(i_index);
+    if (before_it != edits.before.end()) {
+      position += before_it->second.size();
+    }
+    new_position[i_index] = position;
+    if (!edits.erased[i_index]) {
+      ++position;
+    }
+    auto after_it = edits.after.find(i_index);
+    if (after_it != edits.after.end()) {
+      position += after_it->second.size();
+    }
+  }
+  slot_start[size] = position;
+
+  auto retarget = [&](std::string& offset, size_t old_index) {
+    if (!is_constant(offset)) {
+      return;
+    }
+    auto target = static_cast<int>(old_index) + std::stoi(offset);
+    if (target < 0 || target > static_cast<int>(size)) {
+      return;
+    }
+    offset = std::to_string(slot_start[target] - new_position[old_index]);
+  };
+  for (size_t i_index = 0; i_index != size; ++i_index) {
+    auto& instr = i_vec[i_index];
+    if (edits.erased[i_index]) {
+      continue;
+    }
+    if (instr->type == op_jmp) {
+      retarget(static_cast<unary_instruction*>(instr.get())->arg_1, i_index);
+    } else if (instr->type == op_if) {
+      retarget(static_cast<binary_instruction*>(instr.get())->arg_2, i_index);
+    }
+  }
+
+  if (edits.before.empty() && edits.after.empty()) {
+    // stable compaction, surviving instructions only move down
+    size_t out = first;
+    for (size_t i_index = first; i_index != size; ++i_index) {
+      if (!edits.erased[i_index]) {
+        i_vec[out++] = std::move(i_vec[i_index]);
+      }
+    }
+    i_vec.resize(out);
+  } else {
+    instruction_vec tail;
+    tail.reserve(position - first);
+    auto append_group = [&tail](std::map<size_t, instruction_vec>& groups, size_t i_index) {
+      auto it = groups.find(i_index);
+      if (it != groups.end()) {
+        for (auto& instr : it->second) {
+          tail.push_back(std::move(instr));
         }
       }
+    };
+    // instructions inserted after the last untouched one start the tail
+    if (first != 0) {
+      append_group(edits.after, first - 1);
+    }
+    for (size_t i_index = first; i_index != size; ++i_index) {
+      append_group(edits.before, i_index);
+      if (!edits.erased[i_index]) {
+        tail.push_back(std::move(i_vec[i_index]));
+      }
+      append_group(edits.after, i_index);
+    }
+    append_group(edits.before, size);
+    i_vec.resize(first);
+    for (auto& instr : tail) {
+      i_vec.push_back(std::move(instr));
     }
   }
+  update_label_table(i_vec, table, first);
+}
 
-  return optimized_i_vec;
+size_t replace_operand(instruction& instr, const std::string& from, const std::string& to) {
+  size_t replaced = 0;
+  visit_use_operands(instr, [&](std::string& arg) {
+    if (arg == from) {
+      arg = to;
+      ++replaced;
+    }
+  });
+  return replaced;
 }
 
-instruction_vec optimize(const instruction_vec& i_vec,
-                         const variable_interval_map& variables_intervals) {
-  return remove_dead_code(i_vec, variables_intervals);
+void erase_instructions(instruction_vec& i_vec, label_table& table,
+                        const std::vector<bool>& erased) {
+  instruction_edits edits;
+  edits.erased = erased;
+  apply_instruction_edits(i_vec, table, edits);
 }
 
-void dump_program(const instruction_vec& i_vec, std::ostream& out) {
-  for (const auto& i : i_vec) {
-    i->dump(out);
-    out << '\n';
+std::string fresh_label(label_table& table, const std::string& prefix) {
+  for (size_t counter = table.instance.size();; ++counter) {
+    auto name = prefix + std::to_string(counter);
+    if (table.instance.find(name) == table.instance.end()) {
+      // reserve name until labels are recomputed
+      table.instance[name] = -1;
+      return name;
+    }
+  }
+}
+
+void insert_on_taken_edge(instruction_vec& i_vec, label_table& table, instruction_edits& edits,
+                          int if_index, instruction_vec instructions,
+                          const std::string& label_prefix) {
+  // taken edge of if is split with new block placed right after it
+  auto if_instr = static_cast<binary_instruction*>(i_vec[if_index].get());
+  auto target_label = if_instr->arg_2;
+  if (is_constant(target_label)) {
+    auto target = branch_target(i_vec, table, if_index);
+    target_label = fresh_label(table, label_prefix + "target_");
+    edits.before[target].insert(edits.before[target].begin(),
+                                std::make_unique<unary_instruction>(op_label, target_label));
+  }
+  auto edge_label = fresh_label(table, label_prefix + "edge_");
+  auto join_label = fresh_label(table, label_prefix + "join_");
+  if_instr->arg_2 = edge_label;
+  auto& group = edits.after[if_index];
+  group.push_back(std::make_unique<unary_instruction>(op_jmp, join_label));
+  group.push_back(std::make_unique<unary_instruction>(op_label, edge_label));
+  for (auto& instr : instructions) {
+    group.push_back(std::move(instr));
+  }
+  group.push_back(std::make_unique<unary_instruction>(op_jmp, target_label));
+  group.push_back(std::make_unique<unary_instruction>(op_label, join_label));
+  if (if_index + 1 == i_vec.size()) {
+    group.push_back(std::make_unique<noarg_instruction>(op_nop));
   }
 }
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <map>
@@ -11,6 +15,8 @@
 #include <sstream>
 #include <stack>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "tests.h"
@@ -54,7 +60,12 @@ enum instruction_type {
   op_label,
   op_function,
   op_nop,
-  op_pop_args
+  op_pop_args,
+  op_phi,
+  op_shl,  // <<
+  op_sar,  // >> keeping sign
+  op_udiv,  // division of unsigned values
+  op_alloca // object in stack frame of function
 };
 
 class file_not_found_exception : public std::runtime_error {
@@ -70,6 +81,10 @@ struct instruction {
   virtual ~instruction() = default;
 
   instruction_type type;
+  // times instruction ran and times if jumped in profiled run, -1 when unknown,
+  // copies made by passes keep counts of original
+  int64_t profile_count = -1;
+  int64_t profile_taken = -1;
 
  protected:
   std::ostream& dump_type(std::ostream& out) {
@@ -146,6 +161,21 @@ struct instruction {
       case op_pop_args:
         out << std::string("pop_args");
         break;
+      case op_phi:
+        out << std::string("phi");
+        break;
+      case op_shl:
+        out << std::string("shl");
+        break;
+      case op_sar:
+        out << std::string("sar");
+        break;
+      case op_udiv:
+        out << std::string("udiv");
+        break;
+      case op_alloca:
+        out << std::string("alloca");
+        break;
       default:
         break;
     }
@@ -173,7 +203,11 @@ struct unary_instruction : public instruction {
   unary_instruction(instruction_type t, std::string arg) : instruction(t), arg_1(arg) {}
   std::string arg_1;
   std::ostream& dump(std::ostream& out) {
-    return dump_type(out) << ' ' << arg_1;
+    dump_type(out) << ' ' << arg_1;
+    if (type == op_label) {
+      out << ':';
+    }
+    return out;
   }
   instruction* clone() {
     return new unary_instruction(*this);
@@ -291,6 +325,35 @@ struct pop_args_instruction : public instruction {
   }
 };
 
+// arguments follow order of predecessors of block which starts with phi
+struct phi_instruction : public instruction {
+  phi_instruction(instruction_type t, const std::string& d, const std::vector<std::string>& a)
+      : instruction(t), dest(d), args(a) {}
+  std::string dest;
+  std::vector<std::string> args;
+  std::ostream& dump(std::ostream& out) {
+    dump_type(out) << ' ' << dest << " (";
+    bool first = true;
+    for (const auto& a : args) {
+      if (!first) {
+        out << ' ';
+      }
+      first = false;
+      out << a;
+    }
+    out << ')';
+    return out;
+  }
+  instruction* clone() { return new phi_instruction(*this); }
+  bool is_arg_equal(const std::string& value) const {
+    if (dest == value) return true;
+    for (const auto& a : args) {
+      if (a == value) return true;
+    }
+    return false;
+  }
+};
+
 struct function_instruction : public instruction {
   function_instruction(instruction_type t, std::vector<std::string> a,
                        instruction_vec i_vec)
@@ -325,6 +388,10 @@ struct function_instruction : public instruction {
     }
 
     out << ')';
+    for (const auto& i : body) {
+      out << "\n  ";
+      i->dump(out);
+    }
     return out;
   }
   instruction *clone() { return new function_instruction(*this); }
@@ -354,9 +421,12 @@ struct scanning_state {
 bool isbracket(char c);
 bool isminus(char c);
 bool is_identifier(char c);
+bool is_identifier_tail(char c);
 bool iscolon(char c);
 
 std::string getNextToken(scanning_state& state);
+// variable or constant, which may be negative
+std::string getNextOperand(scanning_state& state);
 
 void parse_var(instruction_vec& i_vec, scanning_state& state);
 void parse_mov(instruction_vec& i_vec, scanning_state& state);
@@ -370,8 +440,12 @@ void parse_add(instruction_vec& i_vec, scanning_state& state);
 void parse_sub(instruction_vec& i_vec, scanning_state& state);
 void parse_mul(instruction_vec &i_vec, scanning_state &state);
 void parse_div(instruction_vec &i_vec, scanning_state &state);
+void parse_shl(instruction_vec& i_vec, scanning_state& state);
+void parse_sar(instruction_vec& i_vec, scanning_state& state);
+void parse_udiv(instruction_vec& i_vec, scanning_state& state);
 void parse_new(instruction_vec& i_vec, scanning_state& state);
 void parse_delete(instruction_vec& i_vec, scanning_state& state);
+void parse_alloca(instruction_vec& i_vec, scanning_state& state);
 void parse_cmp_eq(instruction_vec& i_vec, scanning_state& state);
 void parse_cmp_neq(instruction_vec& i_vec, scanning_state& state);
 void parse_cmp_lt(instruction_vec& i_vec, scanning_state& state);
@@ -380,6 +454,7 @@ void parse_cmp_gt(instruction_vec& i_vec, scanning_state& state);
 void parse_cmp_gte(instruction_vec& i_vec, scanning_state& state);
 void parse_label(instruction_vec& i_vec, scanning_state& state, label_table& table);
 void parse_function(instruction_vec& i_vec, scanning_state& state, label_table& table);
+void parse_phi(instruction_vec& i_vec, scanning_state& state);
 
 std::string read_file(const std::string file);
 
@@ -402,10 +477,93 @@ using liveness_sets = std::map<int, in_out_sets>;
 
 control_flow_graph build_cfg(const instruction_vec& i_vec, const label_table& table);
 
+// index of instruction which jmp or if at i_index transfers control to
+// -1 for unknown label
+int branch_target(const instruction_vec& i_vec, const label_table& table, int i_index);
+
 control_flow_graph build_backward_cfg(const control_flow_graph& cfg);
 
+// maximal straight line sequence of instructions [first, last]
+// successors and predecessors are indexes of other blocks
+struct basic_block {
+  int first = 0;
+  int last = 0;
+  std::vector<int> successors;
+  std::vector<int> predecessors;
+};
+
+struct block_graph {
+  std::vector<basic_block> blocks;
+  // index of block for each instruction
+  std::vector<int> instruction_block;
+};
+
+block_graph build_basic_blocks(const instruction_vec& i_vec, const control_flow_graph& cfg);
+
+// constants are numbers, optionally negative
+bool is_constant(const std::string& arg);
+
+// variables read and written by single instruction
+void instruction_uses(const instruction& instr, std::vector<std::string>& out_uses);
+void instruction_defs(const instruction& instr, std::vector<std::string>& out_defs);
+
+// visitors get every variable operand which is read (uses) or written (defs)
+// and may rename it in place
+using operand_visitor = std::function<void(std::string& arg)>;
+void visit_use_operands(instruction& instr, const operand_visitor& visitor);
+void visit_def_operands(instruction& instr, const operand_visitor& visitor);
+
 void build_use_def_sets(const instruction_vec& i_vec, gen_set& out_gen_set, kill_set& out_kill_set);
 
+// dense numbering of all variables used or defined in a program
+struct variable_universe {
+  std::unordered_map<std::string, int> index;
+  std::vector<std::string> names;
+  int add(const std::string& name);
+  int find(const std::string& name) const;
+  size_t size() const { return names.size(); }
+};
+
+variable_universe build_variable_universe(const instruction_vec& i_vec);
+
+using bit_vector = std::vector<uint64_t>;
+
+constexpr size_t bits_per_word = 64;
+
+inline size_t bit_vector_words(size_t bits) {
+  return (bits + bits_per_word - 1) / bits_per_word;
+}
+
+inline bool test_bit(const bit_vector& bits, size_t index) {
+  return (bits[index / bits_per_word] >> (index % bits_per_word)) & 1;
+}
+
+inline void set_bit(bit_vector& bits, size_t index) {
+  bits[index / bits_per_word] |= uint64_t(1) << (index % bits_per_word);
+}
+
+inline void clear_bit(bit_vector& bits, size_t index) {
+  bits[index / bits_per_word] &= ~(uint64_t(1) << (index % bits_per_word));
+}
+
+// liveness is separable by variable, so the variable universe may be split
+// into partitions of partition_bits variables, each one solved on its own thread
+// partition_bits equal 0 means one partition solved on calling thread
+// parallel-liveness uses 512 bits, eight words of each bit vector per partition
+struct liveness_options {
+  size_t partition_bits = 0;
+  size_t threads = 1;
+};
+
+struct block_liveness {
+  std::vector<bit_vector> live_in;
+  std::vector<bit_vector> live_out;
+};
+
+block_liveness block_liveness_analysis(const instruction_vec& i_vec, const block_graph& graph,
+                                       const variable_universe& universe,
+                                       const liveness_options& options);
+
 void dump_raw_use_def_set_impl(const std::map<int, std::vector<std::string>>& input_set,
                                std::ostream& out);
 
@@ -434,26 +592,624 @@ void dump_raw_liveness(const liveness_sets& liveness_sets_input, std::ostream& o
 
 liveness_sets liveness_analysis(const instruction_vec& i_vec, const control_flow_graph& cfg);
 
-variable_interval_map compute_variables_live_ranges(const liveness_sets& live_sets);
+liveness_sets liveness_analysis(const instruction_vec& i_vec, const control_flow_graph& cfg,
+                                const liveness_options& options);
+
+// block level results expanded back to instruction granularity
+liveness_sets expand_block_liveness(const instruction_vec& i_vec, const block_graph& graph,
+                                    const variable_universe& universe,
+                                    const block_liveness& block_sets);
+
+// live interval with lifetime holes, ranges are sorted and disjoint
+// use positions contain both reads and writes of variable
+struct live_interval {
+  std::string variable;
+  std::vector<live_range> ranges;
+  std::vector<size_t> use_positions;
+};
+
+using live_interval_vec = std::vector<live_interval>;
+
+// Wimmer/Franz interval construction, blocks are visited in reverse linear order
+// starting from block live out sets, so intervals stay correct across back edges
+// one interval per variable of universe, ordered as universe
+live_interval_vec build_live_intervals(const instruction_vec& i_vec, const block_graph& graph,
+                                       const variable_universe& universe,
+                                       const block_liveness& liveness);
+
+variable_interval_map variable_live_ranges(const live_interval_vec& intervals);
+
+void dump_live_intervals(const live_interval_vec& intervals, std::ostream& out);
 
 void dump_variable_intervals(const variable_interval_map& variables_intervals, std::ostream& out);
 
+// graphs up to this number of nodes are kept as triangular bit matrix
+// bigger ones as sorted adjacency lists
+constexpr size_t interference_matrix_limit = 2048;
+
+// number of registers conservative coalescing tries to keep graph colorable with
+// x86-64 general purpose registers without rsp and rbp
+constexpr size_t coalescing_register_count = 14;
+
+// nodes are variable indexes of variable_universe
+class interference_graph {
+ public:
+  explicit interference_graph(size_t nodes);
+  void add_edge(int a, int b);
+  void remove_edge(int a, int b);
+  bool interfere(int a, int b) const;
+  std::vector<int> neighbours(int node) const;
+  size_t degree(int node) const { return degrees[node]; }
+  size_t size() const { return degrees.size(); }
+  // joins nodes which do not interfere, edges of the one with fewer neighbours
+  // move to the other, which is returned
+  int merge(int a, int b);
+
+ private:
+  size_t matrix_index(int a, int b) const;
+
+  bool use_matrix;
+  bit_vector matrix;
+  std::vector<std::vector<int>> adjacency;
+  std::vector<size_t> degrees;
+};
+
+interference_graph build_interference_graph(const instruction_vec& i_vec,
+                                            const block_graph& graph,
+                                            const variable_universe& universe,
+                                            const block_liveness& liveness);
+
+// conservative (Briggs/George) coalescing of non interfering copy related variables
+// coalesced copies are removed, returns number of removed copies
+size_t coalesce_copies(instruction_vec& i_vec, label_table& table);
+
+class analysis_manager;
+size_t coalesce_copies(instruction_vec& i_vec, label_table& table, analysis_manager& analyses);
+
 void generate_gnuplot_interval(const variable_interval_map& variables_intervals);
-instruction_vec remove_dead_code(const instruction_vec& i_vec,
-                                 const variable_interval_map& variables_intervals);
 
-instruction_vec optimize(const instruction_vec& i_vec,
-                         const variable_interval_map& variables_intervals);
+struct optimization_stats {
+  size_t removed_copies = 0;
+  size_t propagated_constants = 0;
+  size_t folded_branches = 0;
+  size_t redundant_expressions = 0;
+  size_t partially_redundant_expressions = 0;
+  size_t known_comparisons = 0;
+  size_t narrowed_operations = 0;
+  size_t promoted_allocations = 0;
+  size_t replaced_stack_operations = 0;
+  size_t removed_pure_calls = 0;
+  size_t unread_call_arguments = 0;
+  size_t dead_instructions = 0;
+  size_t reduced_operations = 0;
+  size_t hoisted_instructions = 0;
+  size_t inlined_calls = 0;
+  size_t combined_instructions = 0;
+  size_t unreachable_instructions = 0;
+  size_t threaded_jumps = 0;
+  size_t removed_jumps = 0;
+  size_t merged_blocks = 0;
+  size_t eliminated_tail_calls = 0;
+  size_t unrolled_loops = 0;
+  size_t partially_unrolled_loops = 0;
+  size_t deleted_loops = 0;
+  size_t merged_induction_variables = 0;
+  size_t reduced_induction_variables = 0;
+  size_t rewritten_exit_tests = 0;
+  size_t moved_blocks = 0;
+};
+
+void dump_optimization_stats(const optimization_stats& stats, std::ostream& out);
+
 
 void dump_program(const instruction_vec& i_vec, std::ostream& out);
 
+// recompute indexes of labels defined in i_vec at or after position from
+void update_label_table(const instruction_vec& i_vec, label_table& table, size_t from = 0);
+
+// batch of changes applied to program in single pass
+// positions are indexes of instructions before any edit
+// jumps to a position land on instructions inserted before it,
+// instructions inserted after it are executed only when falling through
+// inserted instructions with relative jumps are not retargeted
+struct instruction_edits {
+  std::vector<bool> erased;
+  std::map<size_t, instruction_vec> before;
+  std::map<size_t, instruction_vec> after;
+
+  void erase(size_t i_index);
+  void insert_before(size_t i_index, instruction_ptr instr);
+  void insert_after(size_t i_index, instruction_ptr instr);
+  bool empty() const;
+};
+
+// relative jumps and labels are retargeted, instructions are moved, never copied,
+// and those before the first edited position stay untouched
+// edits which only erase compact program in place
+void apply_instruction_edits(instruction_vec& i_vec, label_table& table, instruction_edits& edits);
+
+// replaces every read of variable from by to, returns number of replaced operands
+size_t replace_operand(instruction& instr, const std::string& from, const std::string& to);
+
+void erase_instructions(instruction_vec& i_vec, label_table& table,
+                        const std::vector<bool>& erased);
+
+// name of label which is not in table, reserved until labels are recomputed
+std::string fresh_label(label_table& table, const std::string& prefix);
+
+// instructions are executed only when if at if_index jumps,
+// they are placed in new block right after it
+void insert_on_taken_edge(instruction_vec& i_vec, label_table& table, instruction_edits& edits,
+                          int if_index, instruction_vec instructions,
+                          const std::string& label_prefix);
+
+// SSA stuff
+struct dominator_tree {
+  // immediate dominator of each block, -1 for entry and unreachable blocks
+  std::vector<int> idom;
+  std::vector<std::vector<int>> children;
+  std::vector<int> reverse_postorder;
+  // preorder and postorder numbers in dominator tree, -1 for unreachable blocks
+  std::vector<int> dfs_in;
+  std::vector<int> dfs_out;
+  bool dominates(int a, int b) const;
+};
+
+dominator_tree build_dominator_tree(const block_graph& graph);
+
+std::vector<std::vector<int>> dominance_frontiers(const block_graph& graph,
+                                                  const dominator_tree& tree);
+
+// natural loop of all back edges to header, blocks are sorted
+struct natural_loop {
+  int header = 0;
+  std::vector<int> blocks;
+  std::vector<int> latches;
+};
+
+// outer loops come before loops nested in them
+std::vector<natural_loop> find_natural_loops(const block_graph& graph, const dominator_tree& tree);
+
+// number of loops each block is in
+std::vector<int> loop_depths(const block_graph& graph, const std::vector<natural_loop>& loops);
+
+// sum of constant and loop invariant variables times their factors,
+// arithmetic wraps around at 32 bits as in generated code
+struct scev_linear {
+  int32_t constant = 0;
+  std::map<std::string, int32_t> symbols;
+  bool is_constant() const { return symbols.empty(); }
+  bool is_zero() const { return symbols.empty() && constant == 0; }
+  bool operator==(const scev_linear& rhs) const {
+    return constant == rhs.constant && symbols == rhs.symbols;
+  }
+};
+
+scev_linear scev_add(const scev_linear& a, const scev_linear& b);
+scev_linear scev_scale(const scev_linear& a, int32_t factor);
+
+// add recurrence {start,+,step,+,...} over loop header, value in iteration k
+// is sum of coefficients[j] * binomial(k, j), so {start,+,step} is start + k * step
+// and loop invariant value has single coefficient
+struct add_recurrence {
+  int loop = -1;
+  std::vector<scev_linear> coefficients;
+};
+
+// times back edges of loop are taken before it leaves, which is difference
+// when guard holds or loop is not guarded and 0 otherwise
+struct trip_count {
+  // block ending with if which leaves loop
+  int exit_block = -1;
+  scev_linear difference;
+  bool guarded = false;
+  instruction_type guard = op_cmp_lt;
+  scev_linear guard_lhs;
+  scev_linear guard_rhs;
+  bool is_constant() const { return !guarded && difference.is_constant(); }
+};
+
+// induction variables of loops of program in SSA form, phi at loop header whose
+// value from latch is itself plus recurrence becomes recurrence of one more order,
+// values from outside of loop are invariant symbols
+class scalar_evolution {
+ public:
+  scalar_evolution() = default;
+  scalar_evolution(const instruction_vec& i_vec, const block_graph& graph,
+                   const dominator_tree& tree);
+
+  const std::vector<natural_loop>& loops() const { return loops_; }
+  // innermost loop each block is in, -1 outside of loops
+  const std::vector<int>& block_loops() const { return block_loops_; }
+  // recurrence over innermost loop of its definition, null for variables
+  // defined outside of loops and values which are not recurrences
+  const add_recurrence* recurrence(const std::string& name) const;
+  // null when loop does not leave by single if running in every iteration
+  // with induction variable compared against invariant value
+  const trip_count* backedges(int loop) const;
+
+ private:
+  std::vector<natural_loop> loops_;
+  std::vector<int> block_loops_;
+  std::map<std::string, add_recurrence> recurrences_;
+  std::map<int, trip_count> trip_counts_;
+};
+
+// value of recurrence in iteration count evaluated at compile time
+int32_t evaluate_recurrence(const add_recurrence& recurrence, uint32_t count);
+
+// appends instructions which compute linear value, returns its constant or variable
+std::string expand_linear(const scev_linear& value,
+                          const std::function<std::string()>& make_temp, instruction_vec& out);
+
+// appends instructions which assign value of recurrence after back edges of loop were
+// taken count times to dest, count is constant or variable, temporaries come from
+// make_temp and are declared, false when recurrence is of too high order
+bool expand_recurrence(const add_recurrence& recurrence, const std::string& count,
+                       const std::string& dest, const std::function<std::string()>& make_temp,
+                       instruction_vec& out);
+
+// same for number of times back edges are taken, returns its constant or variable
+std::string expand_trip_count(const trip_count& count,
+                              const std::function<std::string()>& make_temp,
+                              instruction_vec& out);
+
+// analyses cached by analysis_manager, each one also depends on those it is built from
+enum analysis_kind : unsigned {
+  analysis_none = 0,
+  analysis_cfg = 1,
+  analysis_use_def = 2,
+  analysis_universe = 4,
+  analysis_blocks = 8,       // cfg
+  analysis_dominators = 16,  // blocks
+  analysis_liveness = 32,    // blocks, universe
+  analysis_intervals = 64,   // blocks, universe, liveness
+  analysis_evolution = 128,  // blocks, dominators
+  analysis_all = 255
+};
+
+// computes analyses of one program or function body on demand and keeps them
+// until transformation invalidates them, program has to outlive manager
+class analysis_manager {
+ public:
+  analysis_manager(const instruction_vec& i_vec, const label_table& table,
+                   const liveness_options& options = liveness_options());
+
+  const control_flow_graph& cfg();
+  const gen_set& uses();
+  const kill_set& defs();
+  const variable_universe& universe();
+  const block_graph& blocks();
+  const dominator_tree& dominators();
+  const block_liveness& liveness();
+  const liveness_sets& instruction_liveness();
+  const live_interval_vec& intervals();
+  const variable_interval_map& live_ranges();
+  const scalar_evolution& evolution();
+
+  // drops every analysis which is not preserved or depends on one which is not
+  void invalidate(unsigned preserved = analysis_none);
+
+  // number of times analysis was computed, for tests and pass reports
+  size_t computations(analysis_kind kind) const;
+
+ private:
+  bool is_cached(analysis_kind kind) const { return (cached & kind) != 0; }
+  void computed(analysis_kind kind);
+
+  const instruction_vec& i_vec;
+  const label_table& table;
+  liveness_options options;
+  unsigned cached = analysis_none;
+  std::map<analysis_kind, size_t> counts;
+  control_flow_graph cfg_result;
+  gen_set uses_result;
+  kill_set defs_result;
+  variable_universe universe_result;
+  block_graph blocks_result;
+  dominator_tree dominators_result;
+  block_liveness liveness_result;
+  liveness_sets instruction_liveness_result;
+  bool has_instruction_liveness = false;
+  live_interval_vec intervals_result;
+  variable_interval_map live_ranges_result;
+  bool has_live_ranges = false;
+  scalar_evolution evolution_result;
+};
+
+// variables with at most one definition, which dominates all their uses as in strict SSA,
+// hold one value everywhere they are visible, both vectors are indexed as universe
+// def_positions get index of the only definition or -1
+std::vector<bool> find_strict_variables(const instruction_vec& i_vec, const block_graph& graph,
+                                        const dominator_tree& tree,
+                                        const variable_universe& universe,
+                                        std::vector<int>& def_positions);
+
+using parameter_vec = std::vector<std::pair<std::string, std::string>>;
+
+// parameters with their types in order of function signature, which is name
+// followed by pairs of parameter and its type
+parameter_vec parameter_types(const std::vector<std::string>& signature);
+
+// Cytron et al. construction pruned with liveness, every definition
+// of declared variable or parameter gets new version named variable_N
+void construct_ssa(instruction_vec& i_vec, label_table& table,
+                   const parameter_vec& parameters = {});
+
+using copy_vec = std::vector<std::pair<std::string, std::string>>;
+
+// orders parallel copy (dest, source) pairs, make_temp returns new variable
+// of the same type as its argument, which breaks cycles
+copy_vec sequentialize_parallel_copy(const copy_vec& copies,
+                                     const std::function<std::string(const std::string&)>& make_temp);
+
+// replaces phis with sequentialized parallel copies at the end of predecessors
+// critical edges are split
+void destruct_ssa(instruction_vec& i_vec, label_table& table);
+
+// Wegman-Zadeck sparse conditional constant propagation on SSA form
+// constant operands become immediates, constant definitions become mov
+// and if with known condition becomes jmp or nop
+void propagate_constants(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void propagate_constants(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                         optimization_stats& stats);
+
+// dominator scoped hash based value numbering on SSA form, expression
+// computed again on the same value numbers becomes copy of the first one
+// and uses of copies read the first one
+void number_values(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void number_values(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                   optimization_stats& stats);
+
+// interval of 32 bit values, empty when lo is above hi
+struct value_range {
+  int64_t lo = 1;
+  int64_t hi = 0;
+  bool is_empty() const { return lo > hi; }
+  bool operator==(const value_range& rhs) const {
+    return (is_empty() && rhs.is_empty()) || (lo == rhs.lo && hi == rhs.hi);
+  }
+};
+
+// interval lattice over strict variables of SSA form, widened at loop headers
+// and narrowed by conditions of branches which dominate uses
+// ranges are indexed as universe, variables with many definitions get full range
+std::vector<value_range> analyze_value_ranges(const instruction_vec& i_vec,
+                                              const label_table& table,
+                                              const variable_universe& universe);
+
+// comparisons and branch conditions with known outcome become constants,
+// division of non negative values becomes sar by constant 2^k or udiv
+void simplify_by_value_ranges(instruction_vec& i_vec, label_table& table,
+                              optimization_stats& stats);
+void simplify_by_value_ranges(instruction_vec& i_vec, label_table& table,
+                              analysis_manager& analyses, optimization_stats& stats);
+
+// objects of new whose address is only copied, compared and deleted do not
+// escape function, they become alloca in stack frame and their deletes are removed
+void promote_allocations(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void promote_allocations(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                         optimization_stats& stats);
+
+// when every path reaches each block with the same stack depth and nothing
+// pops below depth at entry, value pushed at depth d is copied to variable
+// stack_slot_d and pop copies it back, otherwise push and pop are kept
+void replace_stack_operations(instruction_vec& i_vec, label_table& table,
+                              optimization_stats& stats);
+void replace_stack_operations(instruction_vec& i_vec, label_table& table,
+                              analysis_manager& analyses, optimization_stats& stats);
+
+// division which may trap by zero or overflow
+bool may_trap(const instruction& instr);
+
+// mark and sweep over def-use chains, starting from instructions with effects,
+// every definition of variable read by marked instruction is marked,
+// unmarked instructions and declarations of unreferenced variables are removed
+void eliminate_dead_code(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void eliminate_dead_code(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                         optimization_stats& stats);
+
+// expressions times block and edge sets above this number of bits
+// are not worth lazy code motion
+constexpr size_t lazy_code_motion_bits_limit = size_t(1) << 28;
+
+// Knoop-Ruething-Steffen lazy code motion over lexically equal expressions,
+// computations redundant on some paths are inserted on the other paths
+// as late as possible and the redundant ones read temporary
+void eliminate_partial_redundancies(instruction_vec& i_vec, label_table& table,
+                                    optimization_stats& stats);
+
+// what call may do besides reading its arguments, bit flags
+enum function_effect : unsigned {
+  effect_none = 0,
+  effect_io = 1,             // reads or writes outside world
+  effect_memory = 2,         // allocates or frees objects
+  effect_stack = 4,          // pushes or pops values of caller
+  effect_may_not_return = 8  // loops, recurses or divides by value which may trap
+};
+
 struct builtin_function {
   void *function_pointer = nullptr;
   std::vector<builtin_type> args;
+  unsigned effects = effect_io;
 };
 
 using builtin_functions_map = std::map<std::string, builtin_function>;
 
+struct function_summary {
+  unsigned effects = effect_none;
+  // for every argument whether function reads it
+  std::vector<bool> reads_args;
+  // calls have no result, so pure call does nothing
+  bool is_pure() const { return effects == effect_none; }
+};
+
+using function_summary_map = std::map<std::string, function_summary>;
+
+// bottom up over strongly connected components of call graph,
+// builtins are summarized by their declared effects and read all arguments
+function_summary_map summarize_functions(const instruction_vec& program,
+                                         const builtin_functions_map& builtin_functions);
+
+// calls of pure functions are removed, arguments which callee
+// never reads become 0 so their computation is dead
+void simplify_calls(instruction_vec& program, label_table& table,
+                    const function_summary_map& summaries, optimization_stats& stats);
+
+// calls of functions defined in program are replaced by copies of their bodies
+// when body is cheap enough for how deep in loops call is, recursive functions stay
+void inline_calls(instruction_vec& i_vec, label_table& table, const instruction_vec& program,
+                  optimization_stats& stats);
+void inline_calls(instruction_vec& i_vec, label_table& table, const instruction_vec& program,
+                  analysis_manager& analyses, optimization_stats& stats);
+
+// exponent of power of two or -1
+int power_of_two_exponent(uint32_t value);
+
+// Granlund-Montgomery division by constant, quotient is high half of product
+// of dividend and multiplier shifted right by shift, add marks unsigned
+// multipliers which need 33 bits and are kept without the top one
+struct division_magic {
+  int32_t multiplier = 0;
+  int shift = 0;
+  bool add = false;
+};
+
+// divisor is neither 0, 1, -1 nor power of two in absolute value
+division_magic signed_division_magic(int32_t divisor);
+
+// divisor is neither 0 nor power of two
+division_magic unsigned_division_magic(uint32_t divisor);
+
+// multiplication by 0, 1, -1 and 2^k becomes mov, sub and shl, constant
+// factors are moved right and division by 1 becomes mov, other products
+// and quotients by constants are left to code generator
+void reduce_strength(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+
+// instructions of natural loop computing the same value in every iteration
+// are moved to new preheader in front of its header, trapping divisions stay,
+// works on program without phis
+void hoist_loop_invariants(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void hoist_loop_invariants(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                           optimization_stats& stats);
+
+// local algebraic simplification of single instructions, which may look at definitions
+// of operands holding one value, rules are kept in table and applied until none matches
+void combine_instructions(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void combine_instructions(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                          optimization_stats& stats);
+
+// removes unreachable code, nops and unused labels, threads jumps to jumps and ifs
+// whose condition is known on the way to them, drops jumps to next instruction and moves
+// block reached by single jump in place of that jump
+void simplify_control_flow(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void simplify_control_flow(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                           optimization_stats& stats);
+
+// call which is last thing function does, callee may reuse frame of caller
+bool is_tail_call(const instruction_vec& i_vec, const label_table& table, int i_index);
+
+// calls of function to itself in tail position become jumps to its entry
+// after parameters are assigned, signature is name followed by parameters and types
+void eliminate_tail_recursion(instruction_vec& i_vec, label_table& table,
+                              const std::vector<std::string>& signature,
+                              optimization_stats& stats);
+
+// loop runs factor copies of its body between checks of induction variable,
+// growth of program in instructions stays within budget
+struct unroll_options {
+  size_t factor = 4;
+  size_t budget = 64;
+};
+
+unroll_options unroll_options_for_level(int level);
+
+// counting loops of single block with known number of iterations become straight
+// code, others run factor iterations at once and leave the rest to original loop
+void unroll_loops(instruction_vec& i_vec, label_table& table, const unroll_options& options,
+                  optimization_stats& stats);
+void unroll_loops(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                  const unroll_options& options, optimization_stats& stats);
+
+// innermost loops without effects whose number of iterations is known are replaced
+// by closed forms of induction variables used after them, program is in SSA form
+void delete_loops(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void delete_loops(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                  optimization_stats& stats);
+
+// header phis of innermost loops with the same recurrence are merged, products of
+// induction variables become new variables advanced by addition and exit test of
+// variable used for nothing else compares other one, program is in SSA form
+void simplify_induction_variables(instruction_vec& i_vec, label_table& table,
+                                  optimization_stats& stats);
+void simplify_induction_variables(instruction_vec& i_vec, label_table& table,
+                                  analysis_manager& analyses, optimization_stats& stats);
+
+// times block was entered and its if jumped
+struct block_counts {
+  uint64_t entries = 0;
+  uint64_t taken = 0;
+  bool operator==(const block_counts& rhs) const {
+    return entries == rhs.entries && taken == rhs.taken;
+  }
+};
+
+// counts of blocks of every body in their order, main program has empty name
+using execution_profile = std::map<std::string, std::vector<block_counts>>;
+
+class profile_error : public std::runtime_error {
+ public:
+  profile_error(const std::string& what) : std::runtime_error(what) {}
+};
+
+// calls of counting builtins are put at entry of every block and before every if,
+// builtins are added to map and count into counters read by collected_profile
+void instrument_program(instruction_vec& program, label_table& table,
+                        builtin_functions_map& builtin_functions);
+execution_profile collected_profile();
+
+void write_profile(const execution_profile& profile, std::ostream& out);
+execution_profile read_profile(std::istream& in);
+
+// instructions of freshly parsed program get counts of their blocks
+void annotate_program(instruction_vec& program, const label_table& table,
+                      const execution_profile& profile);
+
+// with profile counts blocks are chained along most frequent edges so hot
+// successors are reached by falling through, cold blocks go to the end
+void layout_blocks(instruction_vec& i_vec, label_table& table, optimization_stats& stats);
+void layout_blocks(instruction_vec& i_vec, label_table& table, analysis_manager& analyses,
+                   optimization_stats& stats);
+
+class pass_pipeline_error : public std::runtime_error {
+ public:
+  pass_pipeline_error(const std::string& what) : std::runtime_error(what) {}
+};
+
+// cumulative cost of pass over main program and all function bodies
+struct pass_report {
+  std::string name;
+  size_t runs = 0;
+  double milliseconds = 0;
+  long instruction_delta = 0;
+  long memory_delta_kib = 0;
+  // analyses pass had to compute because earlier passes did not preserve them
+  size_t analysis_computations = 0;
+};
+
+// pipeline for -O0 to -O3, passes are separated by commas,
+// fixpoint(pass,...) repeats its passes until program stops changing
+std::string optimization_pipeline(int level);
+
+// runs pipeline on every function body and then on main program, SSA form
+// is constructed and destructed around passes which need it
+std::vector<pass_report> run_passes(instruction_vec& program, label_table& table,
+                                    const builtin_functions_map& builtin_functions,
+                                    const std::string& pipeline, optimization_stats& stats,
+                                    const unroll_options& unrolling = unroll_options());
+
+void dump_pass_reports(const std::vector<pass_report>& reports, std::ostream& out);
+
 // Code gen stuff
 void gen_x64(const instruction_vec &i_vec, const asmjit::JitRuntime &rt,
              asmjit::CodeHolder &code, const label_table &ltable,